@@ -0,0 +1,237 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "arena.h"
+
+
+/*  Everything is handed out on 16 byte boundaries.  */
+
+#define ARENA_ALIGN(a)       (((a) + 15) & ~((int64_t) 15))
+
+#define CHUNK_HEADER         ARENA_ALIGN ((int64_t) sizeof (ARENA_CHUNK))
+
+
+static ARENA_COUNTERS   counters;
+static pthread_mutex_t  counter_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/*  Add to the system allocation counters.  This only gets called when we actually go to the system so the lock is
+    not an issue.  */
+
+void arena_count (int64_t mallocs, int64_t frees, int64_t bytes)
+{
+  pthread_mutex_lock (&counter_mutex);
+
+  counters.mallocs += mallocs;
+  counters.frees += frees;
+  counters.bytes += bytes;
+
+  pthread_mutex_unlock (&counter_mutex);
+}
+
+
+
+void arena_get_counters (ARENA_COUNTERS *c)
+{
+  pthread_mutex_lock (&counter_mutex);
+
+  *c = counters;
+
+  pthread_mutex_unlock (&counter_mutex);
+}
+
+
+
+static ARENA_CHUNK *arena_new_chunk (int64_t size)
+{
+  ARENA_CHUNK       *chunk;
+
+
+  if ((chunk = (ARENA_CHUNK *) malloc (CHUNK_HEADER + size)) == NULL)
+    {
+      perror ("Allocating arena memory");
+      exit (-1);
+    }
+
+  arena_count (1, 0, CHUNK_HEADER + size);
+
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+
+  return (chunk);
+}
+
+
+
+/*  Set up an arena with an initial chunk of size bytes.  */
+
+void arena_init (ARENA *arena, int64_t size)
+{
+  arena->chunk = arena_new_chunk (ARENA_ALIGN (size));
+  arena->total = 0;
+}
+
+
+
+/*  Get size bytes from the arena.  The memory is good until the next arena_reset.  */
+
+void *arena_alloc (ARENA *arena, int64_t size)
+{
+  ARENA_CHUNK       *chunk;
+  int64_t           new_size;
+  void              *ptr;
+
+
+  size = ARENA_ALIGN (size);
+
+  if (arena->chunk->used + size > arena->chunk->size)
+    {
+      /*  Double up (at least) so that we don't end up with a long chain.  */
+
+      new_size = 2 * arena->chunk->size;
+      while (new_size < size) new_size *= 2;
+
+      chunk = arena_new_chunk (new_size);
+      chunk->next = arena->chunk;
+      arena->chunk = chunk;
+    }
+
+  ptr = (uint8_t *) arena->chunk + CHUNK_HEADER + arena->chunk->used;
+
+  arena->chunk->used += size;
+  arena->total += size;
+
+  return (ptr);
+}
+
+
+
+void *arena_calloc (ARENA *arena, int64_t size)
+{
+  void              *ptr = arena_alloc (arena, size);
+
+  memset (ptr, 0, size);
+
+  return (ptr);
+}
+
+
+
+/*  Throw away everything allocated since the last reset.  If we had to chain chunks this time around we replace them
+    with one chunk that is big enough to hold all of it.  */
+
+void arena_reset (ARENA *arena)
+{
+  ARENA_CHUNK       *chunk, *next;
+  int64_t           size;
+
+
+  if (arena->chunk->next != NULL)
+    {
+      size = 0;
+      for (chunk = arena->chunk ; chunk != NULL ; chunk = next)
+        {
+          next = chunk->next;
+          size += chunk->size;
+          free (chunk);
+          arena_count (0, 1, 0);
+        }
+
+      arena->chunk = arena_new_chunk (size);
+    }
+
+  arena->chunk->used = 0;
+  arena->total = 0;
+
+  pthread_mutex_lock (&counter_mutex);
+  counters.resets++;
+  pthread_mutex_unlock (&counter_mutex);
+}
+
+
+
+void arena_free (ARENA *arena)
+{
+  ARENA_CHUNK       *chunk, *next;
+
+
+  for (chunk = arena->chunk ; chunk != NULL ; chunk = next)
+    {
+      next = chunk->next;
+      free (chunk);
+      arena_count (0, 1, 0);
+    }
+
+  arena->chunk = NULL;
+  arena->total = 0;
+}
+
+
+
+/*  Make sure that buffer can hold need elements of elem_size bytes.  *alloc is the number of elements currently
+    allocated.  The buffer grows geometrically so appending one element at a time costs almost nothing.  Returns the
+    (possibly moved) buffer.  */
+
+void *grow_buffer (void *buffer, int64_t *alloc, int64_t need, int64_t elem_size)
+{
+  int64_t           new_alloc;
+
+
+  if (need <= *alloc) return (buffer);
+
+  new_alloc = *alloc ? *alloc : 256;
+  while (new_alloc < need) new_alloc *= 2;
+
+  if ((buffer = realloc (buffer, new_alloc * elem_size)) == NULL)
+    {
+      perror ("Allocating buffer memory");
+      exit (-1);
+    }
+
+  arena_count (1, 0, (new_alloc - *alloc) * elem_size);
+
+  *alloc = new_alloc;
+
+  return (buffer);
+}
@@ -0,0 +1,95 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+
+  /*  A simple bump allocator.  Allocations come out of one big chunk and are all thrown away at once with
+      arena_reset.  If a chunk fills up we chain on a bigger one and, at the next reset, replace the chain with a single
+      chunk big enough to hold everything so that once we've seen the biggest cell we never call malloc again.  */
+
+  typedef struct ARENA_CHUNK
+  {
+    struct ARENA_CHUNK *next;
+    int64_t           size;
+    int64_t           used;
+  } ARENA_CHUNK;
+
+
+  typedef struct
+  {
+    ARENA_CHUNK       *chunk;                 /*  Current chunk (the older ones hang off of next)  */
+    int64_t           total;                  /*  Bytes allocated since the last reset  */
+  } ARENA;
+
+
+  /*  System allocation counters.  Everything that goes through the arena or grow_buffer is counted here.  */
+
+  typedef struct
+  {
+    int64_t           mallocs;                /*  Calls to malloc/calloc/realloc  */
+    int64_t           frees;
+    int64_t           bytes;                  /*  Total bytes requested from the system  */
+    int64_t           resets;                 /*  Arena resets  */
+  } ARENA_COUNTERS;
+
+
+  void arena_init (ARENA *arena, int64_t size);
+  void *arena_alloc (ARENA *arena, int64_t size);
+  void *arena_calloc (ARENA *arena, int64_t size);
+  void arena_reset (ARENA *arena);
+  void arena_free (ARENA *arena);
+
+  void *grow_buffer (void *buffer, int64_t *alloc, int64_t need, int64_t elem_size);
+
+  void arena_count (int64_t mallocs, int64_t frees, int64_t bytes);
+  void arena_get_counters (ARENA_COUNTERS *counters);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
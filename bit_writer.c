@@ -0,0 +1,151 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdlib.h>
+
+#include "bit_writer.h"
+
+
+/*
+
+    Specialized offset packers.  Every vertex after the first in a segment is stored as a lon offset and a lat offset
+    using the same two bit widths for the whole segment so the inner loop is the same few operations over and over.
+    When the widths are known at compile time the compiler can fold the masks and shifts into constants and, when the
+    two widths together fit in 32 bits, write each pair with a single bit_writer_put.  We build specialized versions
+    for the widths that make up the vast majority of the SWBD segments and use the generic one for everything else.
+
+*/
+
+
+static inline __attribute__ ((always_inline))
+void pack_offsets_body (BIT_WRITER *writer, const int32_t *segx, const int32_t *segy, int32_t count, int32_t bias_x,
+                        int32_t bias_y, int32_t lon_offset_bits, int32_t lat_offset_bits)
+{
+  int32_t           k;
+  uint32_t          xoff, yoff;
+
+
+  for (k = 1 ; k < count ; k++)
+    {
+      xoff = (uint32_t) ((segx[k] - segx[k - 1]) + bias_x);
+      yoff = (uint32_t) ((segy[k] - segy[k - 1]) + bias_y);
+
+
+      /*  The offsets are always less than 2 ** bits (that's how the widths were computed) so we can just butt them up
+          against each other.  */
+
+      if (lon_offset_bits + lat_offset_bits <= 32)
+        {
+          bit_writer_put (writer, lon_offset_bits + lat_offset_bits, (xoff << lat_offset_bits) | yoff);
+        }
+      else
+        {
+          bit_writer_put (writer, lon_offset_bits, xoff);
+          bit_writer_put (writer, lat_offset_bits, yoff);
+        }
+    }
+}
+
+
+
+static void pack_offsets_generic (BIT_WRITER *writer, const int32_t *segx, const int32_t *segy, int32_t count,
+                                  int32_t bias_x, int32_t bias_y, int32_t lon_offset_bits, int32_t lat_offset_bits)
+{
+  pack_offsets_body (writer, segx, segy, count, bias_x, bias_y, lon_offset_bits, lat_offset_bits);
+}
+
+
+
+#define PACK_SPECIAL(LB, AB) \
+static void pack_offsets_##LB##_##AB (BIT_WRITER *writer, const int32_t *segx, const int32_t *segy, int32_t count, \
+                                      int32_t bias_x, int32_t bias_y, int32_t lon_offset_bits, int32_t lat_offset_bits) \
+{ \
+  (void) lon_offset_bits; \
+  (void) lat_offset_bits; \
+  pack_offsets_body (writer, segx, segy, count, bias_x, bias_y, LB, AB); \
+}
+
+#define PACK_ROW(LB) \
+  PACK_SPECIAL (LB, 5) PACK_SPECIAL (LB, 6) PACK_SPECIAL (LB, 7) PACK_SPECIAL (LB, 8) PACK_SPECIAL (LB, 9) \
+  PACK_SPECIAL (LB, 10) PACK_SPECIAL (LB, 11) PACK_SPECIAL (LB, 12) PACK_SPECIAL (LB, 13) PACK_SPECIAL (LB, 14)
+
+PACK_ROW (5)
+PACK_ROW (6)
+PACK_ROW (7)
+PACK_ROW (8)
+PACK_ROW (9)
+PACK_ROW (10)
+PACK_ROW (11)
+PACK_ROW (12)
+PACK_ROW (13)
+PACK_ROW (14)
+
+
+#define PACK_ENTRY(LB, AB) [LB][AB] = pack_offsets_##LB##_##AB,
+
+#define PACK_ROW_ENTRIES(LB) \
+  PACK_ENTRY (LB, 5) PACK_ENTRY (LB, 6) PACK_ENTRY (LB, 7) PACK_ENTRY (LB, 8) PACK_ENTRY (LB, 9) \
+  PACK_ENTRY (LB, 10) PACK_ENTRY (LB, 11) PACK_ENTRY (LB, 12) PACK_ENTRY (LB, 13) PACK_ENTRY (LB, 14)
+
+static PACK_OFFSETS_FUNC pack_table[33][33] =
+  {
+    PACK_ROW_ENTRIES (5)
+    PACK_ROW_ENTRIES (6)
+    PACK_ROW_ENTRIES (7)
+    PACK_ROW_ENTRIES (8)
+    PACK_ROW_ENTRIES (9)
+    PACK_ROW_ENTRIES (10)
+    PACK_ROW_ENTRIES (11)
+    PACK_ROW_ENTRIES (12)
+    PACK_ROW_ENTRIES (13)
+    PACK_ROW_ENTRIES (14)
+  };
+
+
+
+/*  Get the offset packer for a pair of widths (1 to 32 bits each).  */
+
+PACK_OFFSETS_FUNC pack_offsets_func (int32_t lon_offset_bits, int32_t lat_offset_bits)
+{
+  PACK_OFFSETS_FUNC func = NULL;
+
+
+  if (lon_offset_bits >= 0 && lon_offset_bits <= 32 && lat_offset_bits >= 0 && lat_offset_bits <= 32)
+    func = pack_table[lon_offset_bits][lat_offset_bits];
+
+  return (func != NULL ? func : pack_offsets_generic);
+}
@@ -0,0 +1,128 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __BIT_WRITER_H__
+#define __BIT_WRITER_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+
+  /*  Streaming big endian bit writer.  Bits are accumulated in a 64 bit register and written out 32 bits at a time
+      so the layout is exactly the same as repeated nvutility bit_pack calls (most significant bit first) but we don't
+      have to figure out the byte and bit position for every field.  The output buffer doesn't need to be zeroed.  */
+
+  typedef struct
+  {
+    uint8_t           *buffer;                /*  Next byte to be written  */
+    uint64_t          acc;                    /*  Pending bits are the low nbits bits of acc  */
+    int32_t           nbits;                  /*  Number of pending bits (always less than 32 between calls)  */
+  } BIT_WRITER;
+
+
+  static inline void bit_writer_init (BIT_WRITER *writer, uint8_t *buffer)
+  {
+    writer->buffer = buffer;
+    writer->acc = 0;
+    writer->nbits = 0;
+  }
+
+
+  /*  Add the low numbits (1 to 32) bits of value.  */
+
+  static inline void bit_writer_put (BIT_WRITER *writer, int32_t numbits, uint32_t value)
+  {
+    uint32_t          word;
+
+    writer->acc = (writer->acc << numbits) | ((uint64_t) value & ((((uint64_t) 1) << numbits) - 1));
+    writer->nbits += numbits;
+
+    if (writer->nbits >= 32)
+      {
+        writer->nbits -= 32;
+        word = (uint32_t) (writer->acc >> writer->nbits);
+
+        writer->buffer[0] = (uint8_t) (word >> 24);
+        writer->buffer[1] = (uint8_t) (word >> 16);
+        writer->buffer[2] = (uint8_t) (word >> 8);
+        writer->buffer[3] = (uint8_t) word;
+        writer->buffer += 4;
+      }
+  }
+
+
+  /*  Write out whatever is left, padded with zero bits to a byte boundary.  Returns a pointer to the byte after the
+      last one written.  */
+
+  static inline uint8_t *bit_writer_flush (BIT_WRITER *writer)
+  {
+    while (writer->nbits > 0)
+      {
+        if (writer->nbits >= 8)
+          {
+            writer->nbits -= 8;
+            *writer->buffer++ = (uint8_t) (writer->acc >> writer->nbits);
+          }
+        else
+          {
+            *writer->buffer++ = (uint8_t) (writer->acc << (8 - writer->nbits));
+            writer->nbits = 0;
+          }
+      }
+
+    return (writer->buffer);
+  }
+
+
+  /*  Packs the count - 1 lon/lat offset pairs of a segment.  */
+
+  typedef void (*PACK_OFFSETS_FUNC) (BIT_WRITER *writer, const int32_t *segx, const int32_t *segy, int32_t count,
+                                     int32_t bias_x, int32_t bias_y, int32_t lon_offset_bits, int32_t lat_offset_bits);
+
+
+  PACK_OFFSETS_FUNC pack_offsets_func (int32_t lon_offset_bits, int32_t lat_offset_bits);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __BUILD_SWBD_H__
+#define __BUILD_SWBD_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "nvutility.h"
+
+#include "shapefil.h"
+#include "version.h"
+#include "arena.h"
+#include "cell_store.h"
+#include "cell_writer.h"
+#include "shp_map.h"
+#include "convert.h"
+#include "ccl_reader.h"
+#include "zip_reader.h"
+#include "read_ahead.h"
+#include "metrics.h"
+
+
+  /*  Number of one-degree cells in latitude and longitude.  */
+
+#define CELL_ROWS            180
+#define CELL_COLS            360
+
+
+  /*  The size of the ASCII version string at the start of the file (CCL_VERSION_SIZE) and of the version plus the
+      180 X 360 header for each format (CCL_HEADER_SIZE (format)) come from ccl_reader.h.  */
+
+
+  /*  stdio buffer size for the output file.  */
+
+#define OUTPUT_BUFFER_SIZE   (8 * 1024 * 1024)
+
+
+  /*  Most threads that -j will start.  */
+
+#define MAX_THREADS          256
+
+
+  /*  Initial size of the per thread scratch arenas used to pack the cells.  They grow to fit the biggest cell.  */
+
+#define SCRATCH_ARENA_SIZE   (1024 * 1024)
+
+
+  /*  Shape file readers.  */
+
+#define READER_SHAPELIB      0
+#define READER_MMAP          1
+
+
+  /*  One input shape file and the one-degree cell that it covers.  The cell column and row are the longitude + 180 and
+      latitude + 90 of the southwest corner of the cell (so they go from 0/0 to 359/179).  If the shape file is in a
+      zip archive, zip says where (zip.zipname is empty otherwise).  */
+
+  typedef struct
+  {
+    char              shpname[512];
+    int32_t           x;
+    int32_t           y;
+    ZIP_SOURCE        zip;
+  } CELL_TASK;
+
+
+  /*  The segment that is currently being built from the input vertices.  One of these per thread.  */
+
+  typedef struct
+  {
+    int32_t           *x;
+    int32_t           *y;
+    int32_t           count;
+    int64_t           alloc;                  /*  Number of points allocated for x and y  */
+    int32_t           *ix;                    /*  Converted points for the current shape  */
+    int32_t           *iy;
+    uint8_t           *bad;                   /*  Set for points on the cell boundaries  */
+    int64_t           convert_alloc;          /*  Number of points allocated for ix, iy, and bad  */
+  } SEGMENT;
+
+
+  /*  Per thread ingest counters.  If timed is set we also keep the thread's total time in the shape files (busy) and
+      how much of it was spent converting and splitting the shapes into segments.  */
+
+  typedef struct
+  {
+    int32_t           files;
+    int32_t           points;
+    int64_t           shapes;
+    int64_t           parts;
+    int64_t           dropped;                /*  Points thrown out by the cell boundary check  */
+    uint8_t           timed;
+    METRICS_TIME      busy;
+    METRICS_TIME      conversion;
+    METRICS_TIME      segmentation;
+  } INGEST_STATS;
+
+
+  int32_t discover_cells (char *dirname, CELL_TASK *task);
+  int32_t select_cells (CELL_TASK *task, int32_t num_tasks, int32_t shard, int32_t num_shards, double *band);
+  int32_t merge_files (char *outname, int32_t num_parts, char **partname);
+  void ingest_cell (CELL_TASK *task, SEGMENT *seg, INGEST_STATS *stats, CELL_STORE *store, int32_t reader,
+                    ZIP_FEEDER *feeder, READ_AHEAD *ahead, int32_t index);
+  void encode_cell (CELL_STORE *store, int32_t x, int32_t y, CELL_BLOCK *block, ARENA *scratch, int32_t stitch,
+                    int32_t coding, uint8_t columnar, int32_t compression, int32_t num_levels, int32_t *tolerance,
+                    METRICS_CELL *metrics);
+  void copy_cell (CCL_READER *reader, int32_t x, int32_t y, CELL_BLOCK *block);
+  int32_t encode_benchmark ();
+  int64_t stitch_cell (const int32_t *rec, int64_t rec_size, int32_t gap, ARENA *scratch, int32_t **stitched);
+  int32_t simplify_segment (int32_t *x, int32_t *y, int32_t count, int32_t tolerance, uint8_t *keep, int32_t *stack);
+  int32_t query_box (char *name, int32_t level, uint8_t clip, double west, double east, double south, double north);
+  int32_t decode_benchmark (char *name);
+  int32_t compress_benchmark (char *name);
+  int32_t cache_benchmark (char *name, int32_t num_threads, int64_t budget);
+  int32_t distance_points (char *name, char *points_name, char *output_name, int32_t num_threads, double max_distance);
+  int32_t distance_benchmark (char *name, int32_t num_threads, double max_distance);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -1,5 +1,5 @@
 INCLUDEPATH += /c/PFM_ABEv7.0.0_Win64/include
-LIBS += -L /c/PFM_ABEv7.0.0_Win64/lib -lnvutility -lgdal -lxml2 -lpoppler -lz -lm -liconv
+LIBS += -L /c/PFM_ABEv7.0.0_Win64/lib -lnvutility -lgdal -lxml2 -lpoppler -lz -lpthread -lm -liconv
 DEFINES += NVWIN3X
 CONFIG += console
 CONFIG -= qt
@@ -14,5 +14,5 @@ DEPENDPATH += .
 INCLUDEPATH += .
 
 # Input
-HEADERS += version.h
-SOURCES += main.c
+HEADERS += arena.h bit_writer.h build_swbd.h ccl_cache.h ccl_distance.h ccl_reader.h cell_store.h cell_writer.h convert.h manifest.h metrics.h read_ahead.h shp_map.h thread_pool.h version.h zip_reader.h
+SOURCES += arena.c bit_writer.c ccl_cache.c ccl_decode.c ccl_distance.c ccl_reader.c cell_store.c cell_writer.c convert.c discover.c encode.c ingest.c main.c manifest.c merge.c metrics.c query.c read_ahead.c shp_map.c simplify.c stitch.c thread_pool.c zip_reader.c
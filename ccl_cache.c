@@ -0,0 +1,426 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvutility.h"
+
+#include "ccl_cache.h"
+
+
+/*
+
+    A cache of decoded cells for programs that ask for the same cells over and over.  The cells are spread over a
+    number of shards (by cell index, row * 360 + col, modulo the number of shards), each with its own mutex, LRU list,
+    and share of the byte budget, so threads looking up different cells rarely wait on each other.  The lock is only
+    held to look up, link, and unlink cells, a miss decodes the cell with no lock held.  If two threads miss on the
+    same cell at the same time the second one to finish just throws its copy away.  ccl_cache_get pins the cell until
+    ccl_cache_release is called so a cell that gets evicted while someone is using it isn't freed until they're done
+    with it.  The most recently added cell in a shard is never evicted so a shard can go over its share of the budget
+    by one cell.  Cells with no data are remembered too (as empty_cell, which takes no memory and is never on an LRU
+    list or evicted) so that looking them up again is a hit.  Corrupt cells aren't cached, they're counted separately
+    every time they're looked up.
+
+*/
+
+
+static CCL_CACHED_CELL empty_cell;
+
+
+/*  Unlink a cell from its shard's LRU list.  */
+
+static void unlink_cell (CCL_CACHE_SHARD *shard, CCL_CACHED_CELL *cell)
+{
+  if (cell->prev != NULL)
+    {
+      cell->prev->next = cell->next;
+    }
+  else
+    {
+      shard->head = cell->next;
+    }
+
+  if (cell->next != NULL)
+    {
+      cell->next->prev = cell->prev;
+    }
+  else
+    {
+      shard->tail = cell->prev;
+    }
+
+  cell->prev = cell->next = NULL;
+}
+
+
+
+/*  Put a cell at the front of its shard's LRU list.  */
+
+static void link_cell (CCL_CACHE_SHARD *shard, CCL_CACHED_CELL *cell)
+{
+  cell->prev = NULL;
+  cell->next = shard->head;
+
+  if (shard->head != NULL) shard->head->prev = cell;
+  shard->head = cell;
+
+  if (shard->tail == NULL) shard->tail = cell;
+}
+
+
+
+/*  Decode a whole cell into one allocation.  Returns NULL with *status set to 0 if the cell is empty or -1 if it
+    doesn't agree with the index (or we ran out of memory).  */
+
+static CCL_CACHED_CELL *decode_cell (CCL_READER *reader, int32_t row, int32_t col, int32_t *status)
+{
+  CCL_CACHED_CELL   *cell;
+  CCL_CELL          entry;
+  CCL_QUERY         query;
+  CCL_SEGMENT       segment;
+  int32_t           i, result, offset;
+  int64_t           bytes;
+
+
+  *status = 0;
+
+  if (!ccl_cell (reader, row, col, &entry) || entry.num_vertices <= 0) return (NULL);
+
+  *status = -1;
+
+
+  /*  The cell structure, then the segment starts, then x and y.  */
+
+  bytes = sizeof (CCL_CACHED_CELL) + ((int64_t) entry.num_segments + 1 + 2 * (int64_t) entry.num_vertices) *
+    sizeof (int32_t);
+
+  if ((cell = (CCL_CACHED_CELL *) malloc (bytes)) == NULL) return (NULL);
+
+  memset (cell, 0, sizeof (CCL_CACHED_CELL));
+
+  cell->row = row;
+  cell->col = col;
+  cell->num_segments = entry.num_segments;
+  cell->num_vertices = entry.num_vertices;
+  cell->bytes = bytes;
+  cell->start = (int32_t *) (cell + 1);
+  cell->x = cell->start + entry.num_segments + 1;
+  cell->y = cell->x + entry.num_vertices;
+
+
+  ccl_query_cell (reader, &query, row, col);
+
+  i = offset = 0;
+  while ((result = ccl_query_next (&query, &segment)) == 1)
+    {
+      if (i >= cell->num_segments || segment.count > cell->num_vertices - offset) break;
+
+      cell->start[i++] = offset;
+
+      ccl_segment_decode (&segment, &cell->x[offset], &cell->y[offset]);
+
+      offset += segment.count;
+    }
+
+  if (result || i != cell->num_segments || offset != cell->num_vertices)
+    {
+      free (cell);
+      return (NULL);
+    }
+
+  cell->start[i] = offset;
+  *status = 0;
+
+  return (cell);
+}
+
+
+
+/*
+
+    Set up a cache of decoded cells from reader.  budget is the maximum number of bytes of decoded cells to keep (0 for
+    no limit) and num_shards is the number of independently locked pieces to split the cache into (0 for the default,
+    CCL_CACHE_SHARDS).  Returns 0 on success or -1 if we ran out of memory.
+
+*/
+
+int32_t ccl_cache_init (CCL_CACHE *cache, CCL_READER *reader, int64_t budget, int32_t num_shards)
+{
+  int32_t           i, slots;
+
+
+  memset (cache, 0, sizeof (CCL_CACHE));
+
+  if (num_shards <= 0) num_shards = CCL_CACHE_SHARDS;
+
+  cache->reader = reader;
+  cache->num_shards = num_shards;
+
+  if ((cache->shard = (CCL_CACHE_SHARD *) calloc (num_shards, sizeof (CCL_CACHE_SHARD))) == NULL) return (-1);
+
+  slots = (CCL_ROWS * CCL_COLS + num_shards - 1) / num_shards;
+
+  for (i = 0 ; i < num_shards ; i++)
+    {
+      pthread_mutex_init (&cache->shard[i].mutex, NULL);
+      cache->shard[i].budget = budget / num_shards;
+    }
+
+  for (i = 0 ; i < num_shards ; i++)
+    {
+      if ((cache->shard[i].slot = (CCL_CACHED_CELL **) calloc (slots, sizeof (CCL_CACHED_CELL *))) == NULL)
+        {
+          ccl_cache_free (cache);
+          return (-1);
+        }
+    }
+
+  return (0);
+}
+
+
+
+/*
+
+    Get a decoded cell (row 0 is -90 to -89, col 0 is -180 to -179).  Returns NULL if there is no data in the cell (or
+    it's corrupt).  Otherwise the cell stays valid until it's handed back with ccl_cache_release.
+
+*/
+
+const CCL_CACHED_CELL *ccl_cache_get (CCL_CACHE *cache, int32_t row, int32_t col)
+{
+  CCL_CACHE_SHARD   *shard;
+  CCL_CACHED_CELL   *cell, *victim, *prev;
+  int32_t           key, index, status;
+
+
+  if (row < 0 || row >= CCL_ROWS || col < 0 || col >= CCL_COLS) return (NULL);
+
+  key = row * CCL_COLS + col;
+  shard = &cache->shard[key % cache->num_shards];
+  index = key / cache->num_shards;
+
+
+  pthread_mutex_lock (&shard->mutex);
+
+  if ((cell = shard->slot[index]) != NULL)
+    {
+      shard->hits++;
+
+      if (cell == &empty_cell)
+        {
+          pthread_mutex_unlock (&shard->mutex);
+          return (NULL);
+        }
+
+      cell->refs++;
+
+      if (shard->head != cell)
+        {
+          unlink_cell (shard, cell);
+          link_cell (shard, cell);
+        }
+
+      pthread_mutex_unlock (&shard->mutex);
+
+      return (cell);
+    }
+
+  shard->misses++;
+
+  pthread_mutex_unlock (&shard->mutex);
+
+
+  /*  Decode it without holding the lock.  */
+
+  if ((cell = decode_cell (cache->reader, row, col, &status)) == NULL)
+    {
+      pthread_mutex_lock (&shard->mutex);
+
+      if (status)
+        {
+          shard->corrupt++;
+        }
+      else if (shard->slot[index] == NULL)
+        {
+          shard->slot[index] = &empty_cell;
+        }
+
+      pthread_mutex_unlock (&shard->mutex);
+
+      return (NULL);
+    }
+
+
+  pthread_mutex_lock (&shard->mutex);
+
+
+  /*  Somebody else beat us to it.  */
+
+  if (shard->slot[index] != NULL)
+    {
+      free (cell);
+
+      cell = shard->slot[index];
+      cell->refs++;
+
+      if (shard->head != cell)
+        {
+          unlink_cell (shard, cell);
+          link_cell (shard, cell);
+        }
+
+      pthread_mutex_unlock (&shard->mutex);
+
+      return (cell);
+    }
+
+
+  cell->refs = 1;
+  cell->cached = NVTrue;
+  shard->slot[index] = cell;
+  link_cell (shard, cell);
+  shard->bytes += cell->bytes;
+  shard->cells++;
+
+
+  /*  Evict from the tail until we're back under budget (never the cell we just added).  Cells that are in use are
+      freed when they're released.  */
+
+  if (shard->budget > 0)
+    {
+      for (victim = shard->tail ; victim != NULL && victim != cell && shard->bytes > shard->budget ; victim = prev)
+        {
+          prev = victim->prev;
+
+          unlink_cell (shard, victim);
+          shard->slot[(victim->row * CCL_COLS + victim->col) / cache->num_shards] = NULL;
+          shard->bytes -= victim->bytes;
+          shard->cells--;
+          shard->evictions++;
+          victim->cached = NVFalse;
+
+          if (!victim->refs) free (victim);
+        }
+    }
+
+  pthread_mutex_unlock (&shard->mutex);
+
+  return (cell);
+}
+
+
+
+/*  Hand back a cell from ccl_cache_get.  */
+
+void ccl_cache_release (CCL_CACHE *cache, const CCL_CACHED_CELL *cell)
+{
+  CCL_CACHE_SHARD   *shard;
+  CCL_CACHED_CELL   *ptr = (CCL_CACHED_CELL *) cell;
+
+
+  if (ptr == NULL) return;
+
+  shard = &cache->shard[(ptr->row * CCL_COLS + ptr->col) % cache->num_shards];
+
+  pthread_mutex_lock (&shard->mutex);
+
+  ptr->refs--;
+  if (!ptr->refs && !ptr->cached) free (ptr);
+
+  pthread_mutex_unlock (&shard->mutex);
+}
+
+
+
+/*  Add up the counters from all of the shards.  */
+
+void ccl_cache_stats (CCL_CACHE *cache, CCL_CACHE_STATS *stats)
+{
+  CCL_CACHE_SHARD   *shard;
+  int32_t           i;
+
+
+  memset (stats, 0, sizeof (CCL_CACHE_STATS));
+
+  for (i = 0 ; i < cache->num_shards ; i++)
+    {
+      shard = &cache->shard[i];
+
+      pthread_mutex_lock (&shard->mutex);
+
+      stats->hits += shard->hits;
+      stats->misses += shard->misses;
+      stats->evictions += shard->evictions;
+      stats->corrupt += shard->corrupt;
+      stats->bytes += shard->bytes;
+      stats->cells += shard->cells;
+
+      pthread_mutex_unlock (&shard->mutex);
+    }
+}
+
+
+
+/*  Free everything.  All of the cells must have been released.  */
+
+void ccl_cache_free (CCL_CACHE *cache)
+{
+  CCL_CACHED_CELL   *cell, *next;
+  int32_t           i;
+
+
+  if (cache->shard == NULL) return;
+
+  for (i = 0 ; i < cache->num_shards ; i++)
+    {
+      for (cell = cache->shard[i].head ; cell != NULL ; cell = next)
+        {
+          next = cell->next;
+          free (cell);
+        }
+
+      free (cache->shard[i].slot);
+      pthread_mutex_destroy (&cache->shard[i].mutex);
+    }
+
+  free (cache->shard);
+
+  memset (cache, 0, sizeof (CCL_CACHE));
+}
@@ -0,0 +1,124 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __CCL_CACHE_H__
+#define __CCL_CACHE_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ccl_reader.h"
+
+
+  /*  Default number of shards.  */
+
+#define CCL_CACHE_SHARDS     16
+
+
+  /*  One decoded cell.  Segment i is vertices start[i] through start[i + 1] - 1 of x and y (fixed point, see
+      CCL_SCALE).  Everything after the public part belongs to the cache.  */
+
+  typedef struct CCL_CACHED_CELL
+  {
+    int32_t           row;
+    int32_t           col;
+    int32_t           num_segments;
+    int32_t           num_vertices;
+    int32_t           *start;
+    int32_t           *x;
+    int32_t           *y;
+
+    int64_t           bytes;
+    int32_t           refs;                   /*  Number of ccl_cache_get calls that haven't been released  */
+    uint8_t           cached;                 /*  NVFalse once it has been evicted  */
+    struct CCL_CACHED_CELL *prev;             /*  LRU list, most recently used first  */
+    struct CCL_CACHED_CELL *next;
+  } CCL_CACHED_CELL;
+
+
+  typedef struct
+  {
+    pthread_mutex_t   mutex;
+    CCL_CACHED_CELL   **slot;                 /*  Indexed by key / num_shards  */
+    CCL_CACHED_CELL   *head;
+    CCL_CACHED_CELL   *tail;
+    int64_t           budget;
+    int64_t           bytes;
+    int32_t           cells;
+    int64_t           hits;
+    int64_t           misses;
+    int64_t           evictions;
+    int64_t           corrupt;                /*  Lookups of cells that couldn't be decoded  */
+  } CCL_CACHE_SHARD;
+
+
+  typedef struct
+  {
+    CCL_READER        *reader;
+    int32_t           num_shards;
+    CCL_CACHE_SHARD   *shard;
+  } CCL_CACHE;
+
+
+  typedef struct
+  {
+    int64_t           hits;
+    int64_t           misses;
+    int64_t           evictions;
+    int64_t           corrupt;
+    int64_t           bytes;
+    int32_t           cells;
+  } CCL_CACHE_STATS;
+
+
+  int32_t ccl_cache_init (CCL_CACHE *cache, CCL_READER *reader, int64_t budget, int32_t num_shards);
+  const CCL_CACHED_CELL *ccl_cache_get (CCL_CACHE *cache, int32_t row, int32_t col);
+  void ccl_cache_release (CCL_CACHE *cache, const CCL_CACHED_CELL *cell);
+  void ccl_cache_stats (CCL_CACHE *cache, CCL_CACHE_STATS *stats);
+  void ccl_cache_free (CCL_CACHE *cache);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
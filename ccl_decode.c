@@ -0,0 +1,536 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__x86_64__) || defined (__i386__)
+  #define DECODE_X86
+  #include <immintrin.h>
+#endif
+
+#include "nvutility.h"
+
+#include "ccl_reader.h"
+
+
+/*
+
+    Segment decoding.  Each vertex after the first is a lon offset (lon_offset_bits) followed by a lat offset
+    (lat_offset_bits) with the bias added.  Decoding is unpack, subtract the bias, and prefix sum from the start
+    lon/lat.  The scalar kernel does one field at a time.  The AVX2 kernel does 8 vertices at a time, gathering the
+    32 bit words that hold 8 lon (or lat) fields, shifting each one into place, and doing the prefix sum in registers.
+    Conversion to degrees is (x / 100000) - 180 (and - 90) in both kernels (no FMA) so the results are identical.
+    The AVX2 kernel handles fields of up to 25 bits (anything bigger would be a bogus file anyway) and leaves the last
+    few vertices of each segment to the scalar code so that it never reads past the end of the segment.  Rice coded
+    segments have variable length fields so they always go through decode_rice, one field at a time.  In a columnar
+    cell the lon offsets and the lat offsets are in separate streams, so the same kernels just step through two
+    streams (lon_offset_bits and lat_offset_bits at a time) instead of one (lon_offset_bits + lat_offset_bits).
+    Columnar blocks end with CCL_COLUMN_PAD bytes so the AVX2 kernel doesn't have to stop short.
+
+*/
+
+
+/*  Segments with fewer vertices than this are too short to fill one AVX2 pass so they go straight to the scalar
+    kernel instead of through the function pointer.  */
+
+#define DECODE_SHORT         9
+
+
+static CCL_DECODE_FUNC decode_func = NULL;
+
+
+
+/*  Decode vertices first through count - 1.  cx and cy are the values of vertex first - 1.  This has to be inlined
+    into the AVX2 kernel.  If it's called instead, it runs as SSE code with the upper halves of the AVX registers still
+    dirty and the transition costs more than decoding the whole segment.  */
+
+__attribute__ ((always_inline))
+static inline void decode_tail (const CCL_SEGMENT *segment, int32_t first, int32_t cx, int32_t cy, int32_t *x,
+                                int32_t *y, double *lon, double *lat)
+{
+  int32_t           k, lob, lab, lon_step, lat_step;
+  int64_t           lon_pos, lat_pos;
+  const uint8_t     *lat_data;
+
+
+  lob = segment->lon_offset_bits;
+  lab = segment->lat_offset_bits;
+
+  if (segment->lat_data != NULL)
+    {
+      lat_data = segment->lat_data;
+      lon_step = lob;
+      lat_step = lab;
+      lat_pos = segment->lat_pos;
+    }
+  else
+    {
+      lat_data = segment->data;
+      lon_step = lat_step = lob + lab;
+      lat_pos = segment->offset_pos + lob;
+    }
+
+  lon_pos = segment->offset_pos + (int64_t) (first - 1) * lon_step;
+  lat_pos += (int64_t) (first - 1) * lat_step;
+
+  for (k = first ; k < segment->count ; k++)
+    {
+      cx += (int32_t) ccl_get_bits (segment->data, lon_pos, lob) - segment->bias_x; lon_pos += lon_step;
+      cy += (int32_t) ccl_get_bits (lat_data, lat_pos, lab) - segment->bias_y; lat_pos += lat_step;
+
+      if (x != NULL)
+        {
+          x[k] = cx;
+          y[k] = cy;
+        }
+      else
+        {
+          lon[k] = (double) cx / CCL_SCALE - 180.0;
+          lat[k] = (double) cy / CCL_SCALE - 90.0;
+        }
+    }
+}
+
+
+
+/*  Reference version.  */
+
+static void decode_scalar (const CCL_SEGMENT *segment, int32_t *x, int32_t *y, double *lon, double *lat)
+{
+  if (x != NULL)
+    {
+      x[0] = segment->start_x;
+      y[0] = segment->start_y;
+    }
+  else
+    {
+      lon[0] = (double) segment->start_x / CCL_SCALE - 180.0;
+      lat[0] = (double) segment->start_y / CCL_SCALE - 90.0;
+    }
+
+  decode_tail (segment, 1, segment->start_x, segment->start_y, x, y, lon, lat);
+}
+
+
+
+/*  The 64 bits starting at bit pos of a segment, zero filled past the end of the segment so a corrupt segment can't
+    make us read outside of it.  */
+
+static inline uint64_t peek_bits (const CCL_SEGMENT *segment, int64_t pos)
+{
+  const uint8_t     *ptr;
+  int32_t           i, n;
+  uint64_t          value;
+
+
+  ptr = segment->data + (pos >> 3);
+  n = (int32_t) MAX (0, MIN (8, segment->size - (pos >> 3)));
+
+  if (n == 8)
+    {
+      for (i = 0, value = 0 ; i < 8 ; i++) value = (value << 8) | ptr[i];
+    }
+  else
+    {
+      for (i = 0, value = 0 ; i < 8 ; i++) value = (value << 8) | (i < n ? ptr[i] : 0);
+    }
+
+  return (value << (pos & 7));
+}
+
+
+
+/*  Rice coded segments (see CCL_RICE_ESCAPE in ccl_reader.h).  The residuals are the change from the previous vertex
+    (order 1) or the change in that change (order 2).  window holds the next left bits of the segment (at least 57
+    after a refill) so we only go back to memory when fewer than the 40 bits a field can use (other than an escape)
+    are left.  */
+
+static void decode_rice (const CCL_SEGMENT *segment, int32_t *x, int32_t *y, double *lon, double *lat)
+{
+  int32_t           i, k, c[2], d[2], param[2], q, n, left;
+  int64_t           pos;
+  uint64_t          window;
+  uint32_t          value;
+
+
+  c[0] = segment->start_x;
+  c[1] = segment->start_y;
+  d[0] = d[1] = 0;
+  param[0] = segment->lon_offset_bits;
+  param[1] = segment->lat_offset_bits;
+  pos = segment->offset_pos;
+  window = peek_bits (segment, pos);
+  left = 64 - (pos & 7);
+
+  for (k = 0 ; k < segment->count ; k++)
+    {
+      if (k)
+        {
+          for (i = 0 ; i < 2 ; i++)
+            {
+              if (left < CCL_RICE_ESCAPE + CCL_RICE_MAX_PARAM)
+                {
+                  window = peek_bits (segment, pos);
+                  left = 64 - (pos & 7);
+                }
+
+              q = (~window) ? __builtin_clzll (~window) : 64;
+
+              if (q >= CCL_RICE_ESCAPE)
+                {
+                  pos += CCL_RICE_ESCAPE;
+                  value = (uint32_t) (peek_bits (segment, pos) >> 32);
+                  pos += 32;
+
+                  window = peek_bits (segment, pos);
+                  left = 64 - (pos & 7);
+                }
+              else
+                {
+                  n = q + 1 + param[i];
+                  value = ((uint32_t) q << param[i]) | (param[i] ? (uint32_t) ((window << (q + 1)) >> (64 - param[i])) :
+                                                        0);
+                  window <<= n;
+                  left -= n;
+                  pos += n;
+                }
+
+
+              /*  Undo the zigzag.  */
+
+              value = (value >> 1) ^ (0 - (value & 1));
+
+              if (segment->order == 2)
+                {
+                  d[i] += (int32_t) value;
+                }
+              else
+                {
+                  d[i] = (int32_t) value;
+                }
+
+              c[i] += d[i];
+            }
+        }
+
+      if (x != NULL)
+        {
+          x[k] = c[0];
+          y[k] = c[1];
+        }
+      else
+        {
+          lon[k] = (double) c[0] / CCL_SCALE - 180.0;
+          lat[k] = (double) c[1] / CCL_SCALE - 90.0;
+        }
+    }
+}
+
+
+
+#ifdef DECODE_X86
+
+/*  Pull 8 fields of numbits (1 to 25) bits starting at the bit positions in pos.  */
+
+__attribute__ ((target ("avx2")))
+static inline __m256i gather_fields (const uint8_t *data, __m256i pos, int32_t numbits, __m256i bswap)
+{
+  __m256i           v;
+
+
+  v = _mm256_i32gather_epi32 ((const int *) data, _mm256_srli_epi32 (pos, 3), 1);
+  v = _mm256_shuffle_epi8 (v, bswap);
+  v = _mm256_sllv_epi32 (v, _mm256_and_si256 (pos, _mm256_set1_epi32 (7)));
+
+  return (_mm256_srl_epi32 (v, _mm_cvtsi32_si128 (32 - numbits)));
+}
+
+
+
+/*  Inclusive prefix sum of 8 lanes plus carry (which has the previous total in every lane).  */
+
+__attribute__ ((target ("avx2")))
+static inline __m256i prefix_sum (__m256i v, __m256i carry)
+{
+  __m256i           low;
+
+
+  v = _mm256_add_epi32 (v, _mm256_slli_si256 (v, 4));
+  v = _mm256_add_epi32 (v, _mm256_slli_si256 (v, 8));
+
+
+  /*  Add the total of the low 128 bits to the high 128 bits.  */
+
+  low = _mm256_shuffle_epi32 (v, 0xff);
+  v = _mm256_add_epi32 (v, _mm256_permute2x128_si256 (low, low, 0x08));
+
+  return (_mm256_add_epi32 (v, carry));
+}
+
+
+
+__attribute__ ((target ("avx2")))
+static inline void store_degrees (double *out, __m256i v, __m256d scale, __m256d offset)
+{
+  _mm256_storeu_pd (out, _mm256_sub_pd (_mm256_div_pd (_mm256_cvtepi32_pd (_mm256_castsi256_si128 (v)), scale), offset));
+  _mm256_storeu_pd (out + 4, _mm256_sub_pd (_mm256_div_pd (_mm256_cvtepi32_pd (_mm256_extracti128_si256 (v, 1)),
+                                                           scale), offset));
+}
+
+
+
+/*  Eight vertices at a time.  */
+
+__attribute__ ((target ("avx2")))
+static void decode_avx2 (const CCL_SEGMENT *segment, int32_t *x, int32_t *y, double *lon, double *lat)
+{
+  int32_t           i, n, lob, lab, lon_step, lat_step, lon_base, lat_base;
+  __m256i           bswap, lon_lanes, lat_lanes, bias_x, bias_y, cx, cy, dx, dy, last;
+  __m256d           scale, c180, c90;
+  const uint8_t     *lat_data;
+
+
+  lob = segment->lon_offset_bits;
+  lab = segment->lat_offset_bits;
+
+  if (lob > 25 || lab > 25 || segment->count < 9)
+    {
+      decode_scalar (segment, x, y, lon, lat);
+      return;
+    }
+
+  if (x != NULL)
+    {
+      x[0] = segment->start_x;
+      y[0] = segment->start_y;
+    }
+  else
+    {
+      lon[0] = (double) segment->start_x / CCL_SCALE - 180.0;
+      lat[0] = (double) segment->start_y / CCL_SCALE - 90.0;
+    }
+
+
+  if (segment->lat_data != NULL)
+    {
+      lat_data = segment->lat_data;
+      lon_step = lob;
+      lat_step = lab;
+    }
+  else
+    {
+      lat_data = segment->data;
+      lon_step = lat_step = lob + lab;
+    }
+
+  n = segment->count - 1;
+
+  bswap = _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  lon_lanes = _mm256_mullo_epi32 (_mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32 (lon_step));
+  lat_lanes = _mm256_mullo_epi32 (_mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32 (lat_step));
+  bias_x = _mm256_set1_epi32 (segment->bias_x);
+  bias_y = _mm256_set1_epi32 (segment->bias_y);
+  cx = _mm256_set1_epi32 (segment->start_x);
+  cy = _mm256_set1_epi32 (segment->start_y);
+  last = _mm256_set1_epi32 (7);
+  scale = _mm256_set1_pd (CCL_SCALE);
+  c180 = _mm256_set1_pd (180.0);
+  c90 = _mm256_set1_pd (90.0);
+
+
+  for (i = 0 ; i + 8 <= n ; i += 8)
+    {
+      lon_base = segment->offset_pos + i * lon_step;
+
+
+      /*  The gathers read 4 bytes from the byte holding the start of each field so stop while the last one is still
+          inside the segment (columnar blocks are padded so they never run off the end).  */
+
+      if (segment->lat_data != NULL)
+        {
+          lat_base = segment->lat_pos + i * lat_step;
+        }
+      else
+        {
+          lat_base = lon_base + lob;
+
+          if (((lat_base + 7 * lat_step) >> 3) + 4 > segment->size) break;
+        }
+
+      dx = gather_fields (segment->data, _mm256_add_epi32 (_mm256_set1_epi32 (lon_base), lon_lanes), lob, bswap);
+      dy = gather_fields (lat_data, _mm256_add_epi32 (_mm256_set1_epi32 (lat_base), lat_lanes), lab, bswap);
+
+      dx = _mm256_sub_epi32 (dx, bias_x);
+      dy = _mm256_sub_epi32 (dy, bias_y);
+
+      dx = prefix_sum (dx, cx);
+      dy = prefix_sum (dy, cy);
+
+      if (x != NULL)
+        {
+          _mm256_storeu_si256 ((__m256i *) &x[i + 1], dx);
+          _mm256_storeu_si256 ((__m256i *) &y[i + 1], dy);
+        }
+      else
+        {
+          store_degrees (&lon[i + 1], dx, scale, c180);
+          store_degrees (&lat[i + 1], dy, scale, c90);
+        }
+
+      cx = _mm256_permutevar8x32_epi32 (dx, last);
+      cy = _mm256_permutevar8x32_epi32 (dy, last);
+    }
+
+
+  /*  Leftovers.  */
+
+  if (i < n) decode_tail (segment, i + 1, _mm_cvtsi128_si32 (_mm256_castsi256_si128 (cx)),
+                          _mm_cvtsi128_si32 (_mm256_castsi256_si128 (cy)), x, y, lon, lat);
+}
+
+#endif
+
+
+
+/*  Returns NVTrue if the kernel can be run on this processor.  */
+
+static uint8_t decode_available (int32_t kernel)
+{
+  switch (kernel)
+    {
+    case CCL_DECODE_SCALAR:
+      return (NVTrue);
+
+#ifdef DECODE_X86
+    case CCL_DECODE_AVX2:
+      __builtin_cpu_init ();
+      return (__builtin_cpu_supports ("avx2") != 0);
+#endif
+    }
+
+  return (NVFalse);
+}
+
+
+
+const char *ccl_decode_name (int32_t kernel)
+{
+  if (kernel == CCL_DECODE_AVX2) return ("avx2");
+
+  return ("scalar");
+}
+
+
+
+/*  Pick the segment decoder.  CCL_DECODE_AUTO picks the best one the processor supports.  Returns the kernel that will
+    be used or -1 if the requested kernel isn't supported here.  This isn't thread safe, call it before starting any
+    threads that decode (ccl_open picks the best one if nothing has been selected yet).  */
+
+int32_t ccl_decode_select (int32_t kernel)
+{
+  if (kernel == CCL_DECODE_AUTO)
+    {
+      kernel = CCL_DECODE_SCALAR;
+      if (decode_available (CCL_DECODE_AVX2)) kernel = CCL_DECODE_AVX2;
+    }
+
+  if (!decode_available (kernel)) return (-1);
+
+#ifdef DECODE_X86
+  decode_func = (kernel == CCL_DECODE_AVX2) ? decode_avx2 : decode_scalar;
+#else
+  decode_func = decode_scalar;
+#endif
+
+  return (kernel);
+}
+
+
+
+void ccl_decode_init ()
+{
+  if (decode_func == NULL) ccl_decode_select (CCL_DECODE_AUTO);
+}
+
+
+
+/*  Unpack a segment into fixed point positions (see CCL_SCALE).  x and y must hold segment->count values.  */
+
+void ccl_segment_decode (const CCL_SEGMENT *segment, int32_t *x, int32_t *y)
+{
+  ccl_decode_init ();
+
+  if (segment->order)
+    {
+      decode_rice (segment, x, y, NULL, NULL);
+      return;
+    }
+
+  if (segment->count < DECODE_SHORT)
+    {
+      decode_scalar (segment, x, y, NULL, NULL);
+      return;
+    }
+
+  (*decode_func) (segment, x, y, NULL, NULL);
+}
+
+
+
+/*  Unpack a segment into degrees (-180 to 180 and -90 to 90).  lon and lat must hold segment->count values.  */
+
+void ccl_segment_degrees (const CCL_SEGMENT *segment, double *lon, double *lat)
+{
+  ccl_decode_init ();
+
+  if (segment->order)
+    {
+      decode_rice (segment, NULL, NULL, lon, lat);
+      return;
+    }
+
+  if (segment->count < DECODE_SHORT)
+    {
+      decode_scalar (segment, NULL, NULL, lon, lat);
+      return;
+    }
+
+  (*decode_func) (segment, NULL, NULL, lon, lat);
+}
@@ -0,0 +1,545 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nvutility.h"
+
+#include "ccl_distance.h"
+#include "thread_pool.h"
+
+
+/*
+
+    Distance to the coastline and land/water checks for large batches of points (e.g. every sounding in a PFM file).
+    Cells are loaded the first time a point needs them and kept until ccl_distance_free.  Loading a cell decodes all
+    of its segments and bins its edges in a CCL_DISTANCE_BINS X CCL_DISTANCE_BINS grid.  The nearest edge to a point
+    is found by searching the bins in rings around the point's bin, crossing into the neighbouring cells (and across
+    the date line) as needed, and stopping when the next ring can't be any closer than the best edge so far or is past
+    the maximum distance.  The cells are spread over CCL_DISTANCE_LOCKS locks (by cell index) and a cell is loaded
+    while holding its lock so it's only ever loaded once.
+
+    Land or water comes from the side of the nearest edge that the point is on.  The SWBD polygons are water bodies
+    stored the shapefile way (outer rings clockwise, holes counterclockwise) so water is always on the right side of
+    a segment.  If the nearest point is a vertex the two edges that meet there are used.  This only works for files
+    built from SWBD water body polygons (which is all we build).
+
+*/
+
+
+#define DEG_TO_RAD           0.017453292519943295
+#define DISTANCE_CHUNK       1024
+
+
+/*  Everything the batch threads need.  */
+
+typedef struct
+{
+  CCL_DISTANCE      *engine;
+  const double      *point;
+  double            *distance;
+  int8_t            *land;
+  int64_t           *order;                   /*  Point numbers sorted by cell  */
+  int64_t           num_points;
+} DISTANCE_JOB;
+
+
+
+/*  Which bin of a cell a position (relative to the cell corner) falls in.  */
+
+static inline int32_t bin_of (int32_t value)
+{
+  return (MAX (0, MIN (CCL_DISTANCE_BINS - 1, value / (CCL_CELL_UNITS / CCL_DISTANCE_BINS))));
+}
+
+
+
+/*  Decode a cell and bin its edges.  Returns NULL if the cell is empty, corrupt, or we ran out of memory.  */
+
+static CCL_DISTANCE_CELL *load_cell (CCL_READER *reader, int32_t row, int32_t col)
+{
+  CCL_DISTANCE_CELL *cell;
+  CCL_CELL          entry;
+  CCL_QUERY         query;
+  CCL_SEGMENT       segment;
+  int32_t           i, j, k, v, n, status, *fill, x0, y0, num_edges;
+  int64_t           bytes;
+
+
+  if (!ccl_cell (reader, row, col, &entry) || entry.num_vertices <= 0) return (NULL);
+
+  n = entry.num_vertices;
+
+
+  /*  The cell structure, then the bin starts, x, y, and last in one allocation.  The edge lists come later.  */
+
+  bytes = sizeof (CCL_DISTANCE_CELL) + (CCL_DISTANCE_BINS * CCL_DISTANCE_BINS + 1 + 2 * (int64_t) n) * sizeof (int32_t) +
+    n;
+
+  if ((cell = (CCL_DISTANCE_CELL *) calloc (bytes, 1)) == NULL) return (NULL);
+
+  cell->num_vertices = n;
+  cell->bytes = bytes;
+  cell->bin_start = (int32_t *) (cell + 1);
+  cell->x = cell->bin_start + CCL_DISTANCE_BINS * CCL_DISTANCE_BINS + 1;
+  cell->y = cell->x + n;
+  cell->last = (uint8_t *) (cell->y + n);
+
+
+  ccl_query_cell (reader, &query, row, col);
+
+  v = 0;
+  while ((status = ccl_query_next (&query, &segment)) == 1)
+    {
+      if (v + segment.count > n) break;
+
+      ccl_segment_decode (&segment, &cell->x[v], &cell->y[v]);
+
+      v += segment.count;
+      cell->last[v - 1] = NVTrue;
+    }
+
+  if (status || v != n)
+    {
+      free (cell);
+      return (NULL);
+    }
+
+
+  /*  Count the edges in each bin (an edge goes in every bin that its bounding box touches), turn the counts into
+      starts, and fill in the lists.  */
+
+  x0 = col * CCL_CELL_UNITS;
+  y0 = row * CCL_CELL_UNITS;
+
+  for (v = 0 ; v < n - 1 ; v++)
+    {
+      if (cell->last[v]) continue;
+
+      for (j = bin_of (MIN (cell->y[v], cell->y[v + 1]) - y0) ; j <= bin_of (MAX (cell->y[v], cell->y[v + 1]) - y0) ; j++)
+        {
+          for (i = bin_of (MIN (cell->x[v], cell->x[v + 1]) - x0) ; i <= bin_of (MAX (cell->x[v], cell->x[v + 1]) - x0) ;
+               i++) cell->bin_start[j * CCL_DISTANCE_BINS + i + 1]++;
+        }
+    }
+
+  for (k = 0 ; k < CCL_DISTANCE_BINS * CCL_DISTANCE_BINS ; k++) cell->bin_start[k + 1] += cell->bin_start[k];
+
+  num_edges = cell->bin_start[CCL_DISTANCE_BINS * CCL_DISTANCE_BINS];
+
+  cell->bin_edge = (int32_t *) malloc (MAX (1, num_edges) * sizeof (int32_t));
+  fill = (int32_t *) malloc (CCL_DISTANCE_BINS * CCL_DISTANCE_BINS * sizeof (int32_t));
+
+  if (cell->bin_edge == NULL || fill == NULL)
+    {
+      free (cell->bin_edge);
+      free (fill);
+      free (cell);
+      return (NULL);
+    }
+
+  memcpy (fill, cell->bin_start, CCL_DISTANCE_BINS * CCL_DISTANCE_BINS * sizeof (int32_t));
+
+  for (v = 0 ; v < n - 1 ; v++)
+    {
+      if (cell->last[v]) continue;
+
+      for (j = bin_of (MIN (cell->y[v], cell->y[v + 1]) - y0) ; j <= bin_of (MAX (cell->y[v], cell->y[v + 1]) - y0) ; j++)
+        {
+          for (i = bin_of (MIN (cell->x[v], cell->x[v + 1]) - x0) ; i <= bin_of (MAX (cell->x[v], cell->x[v + 1]) - x0) ;
+               i++) cell->bin_edge[fill[j * CCL_DISTANCE_BINS + i]++] = v;
+        }
+    }
+
+  free (fill);
+
+  cell->bytes += MAX (1, num_edges) * sizeof (int32_t);
+
+  return (cell);
+}
+
+
+
+/*  Get a cell, loading it if this is the first time anyone has asked for it.  Returns NULL for empty cells.  */
+
+static CCL_DISTANCE_CELL *get_cell (CCL_DISTANCE *engine, int32_t index)
+{
+  CCL_DISTANCE_CELL *cell;
+  pthread_mutex_t   *lock;
+
+
+  lock = &engine->lock[index % CCL_DISTANCE_LOCKS];
+
+  pthread_mutex_lock (lock);
+
+  if (!engine->loaded[index])
+    {
+      engine->cell[index] = load_cell (engine->reader, index / CCL_COLS, index % CCL_COLS);
+      engine->loaded[index] = NVTrue;
+
+      if (engine->cell[index] != NULL)
+        {
+          pthread_mutex_lock (&engine->stats_lock);
+          engine->cells++;
+          engine->bytes += engine->cell[index]->bytes;
+          pthread_mutex_unlock (&engine->stats_lock);
+        }
+    }
+
+  cell = engine->cell[index];
+
+  pthread_mutex_unlock (lock);
+
+  return (cell);
+}
+
+
+
+/*  Which side of edge v point (px, py) is on (negative is the right side).  shift moves the cell across the date
+    line.  */
+
+static inline double edge_cross (const CCL_DISTANCE_CELL *cell, int32_t v, double shift, double px, double py)
+{
+  return (((double) cell->x[v + 1] - cell->x[v]) * (py - cell->y[v]) -
+          ((double) cell->y[v + 1] - cell->y[v]) * (px - (cell->x[v] + shift)));
+}
+
+
+
+/*  Land or water from the nearest edge v (t is where the nearest point is along the edge, 0 to 1).  */
+
+static int8_t edge_side (const CCL_DISTANCE_CELL *cell, int32_t v, double t, double shift, double px, double py)
+{
+  int32_t           e1, e2;
+  uint8_t           right1, right2, inside;
+  double            turn;
+
+
+  /*  If the nearest point is a vertex that's shared by two edges, the point is inside (on the right) if it's right
+      of both of them at a right turn (a convex corner) or right of either of them at a left turn.  */
+
+  e1 = e2 = -1;
+
+  if (t <= 0.0 && v > 0 && !cell->last[v - 1])
+    {
+      e1 = v - 1;
+      e2 = v;
+    }
+  else if (t >= 1.0 && !cell->last[v + 1])
+    {
+      e1 = v;
+      e2 = v + 1;
+    }
+
+  if (e1 < 0)
+    {
+      inside = (edge_cross (cell, v, shift, px, py) < 0.0);
+    }
+  else
+    {
+      turn = ((double) cell->x[e1 + 1] - cell->x[e1]) * ((double) cell->y[e2 + 1] - cell->y[e2]) -
+        ((double) cell->y[e1 + 1] - cell->y[e1]) * ((double) cell->x[e2 + 1] - cell->x[e2]);
+
+      right1 = (edge_cross (cell, e1, shift, px, py) < 0.0);
+      right2 = (edge_cross (cell, e2, shift, px, py) < 0.0);
+
+      inside = (turn < 0.0) ? (right1 && right2) : (right1 || right2);
+    }
+
+  return (inside ? CCL_WATER : CCL_LAND);
+}
+
+
+
+/*  Set up a distance engine for an open .ccl file.  max_distance (meters) is how far we look for the coastline.
+    Returns 0 or -1 if we ran out of memory.  */
+
+int32_t ccl_distance_init (CCL_DISTANCE *engine, CCL_READER *reader, double max_distance)
+{
+  int32_t           i;
+
+
+  memset (engine, 0, sizeof (CCL_DISTANCE));
+
+  engine->reader = reader;
+  engine->max_distance = max_distance;
+
+  engine->cell = (CCL_DISTANCE_CELL **) calloc (CCL_ROWS * CCL_COLS, sizeof (CCL_DISTANCE_CELL *));
+  engine->loaded = (uint8_t *) calloc (CCL_ROWS * CCL_COLS, sizeof (uint8_t));
+
+  if (engine->cell == NULL || engine->loaded == NULL)
+    {
+      free (engine->cell);
+      free (engine->loaded);
+      return (-1);
+    }
+
+  for (i = 0 ; i < CCL_DISTANCE_LOCKS ; i++) pthread_mutex_init (&engine->lock[i], NULL);
+  pthread_mutex_init (&engine->stats_lock, NULL);
+
+  return (0);
+}
+
+
+
+/*
+
+    Find the distance (meters) from a point to the nearest coastline and whether it's on land or in the water.  If
+    there's no coastline within the maximum distance (or the point is off the earth) distance is set to -1 and land
+    to CCL_UNKNOWN.
+
+*/
+
+void ccl_distance_point (CCL_DISTANCE *engine, double lon, double lat, double *distance, int8_t *land)
+{
+  CCL_DISTANCE_CELL *cell, *best_cell;
+  int32_t           r, i, j, k, v, b, wrapped, index, cell_index, gx, gy, num_x, num_y, max_ring, best_edge;
+  double            px, py, scale_x, scale_y, step, bound, best, shift, best_shift, best_t, ax, ay, dx, dy, length, t, qx,
+                    qy, d;
+
+
+  *distance = -1.0;
+  *land = CCL_UNKNOWN;
+
+  if (!(lon >= -180.0 && lon <= 180.0 && lat >= -90.0 && lat <= 90.0)) return;
+
+
+  /*  Everything is done in fixed point positions scaled to meters at the point's latitude.  */
+
+  px = (lon + 180.0) * CCL_SCALE;
+  py = (lat + 90.0) * CCL_SCALE;
+
+  scale_y = CCL_METERS_PER_DEGREE / CCL_SCALE;
+  scale_x = scale_y * MAX (cos (lat * DEG_TO_RAD), 0.01);
+
+  num_x = CCL_COLS * CCL_DISTANCE_BINS;
+  num_y = CCL_ROWS * CCL_DISTANCE_BINS;
+
+  gx = MIN (num_x - 1, (int32_t) (px / (CCL_CELL_UNITS / CCL_DISTANCE_BINS)));
+  gy = MIN (num_y - 1, (int32_t) (py / (CCL_CELL_UNITS / CCL_DISTANCE_BINS)));
+
+  step = (CCL_CELL_UNITS / CCL_DISTANCE_BINS) * MIN (scale_x, scale_y);
+  max_ring = MIN (num_x / 2, (int32_t) (engine->max_distance / step) + 2);
+
+  best = engine->max_distance * engine->max_distance;
+  best_cell = cell = NULL;
+  best_edge = -1;
+  best_t = best_shift = 0.0;
+  cell_index = -1;
+
+
+  for (r = 0 ; r <= max_ring ; r++)
+    {
+      /*  Every bin in ring r is at least r - 1 bins away.  */
+
+      bound = (r - 1) * step;
+      if (r > 1 && bound * bound >= best) break;
+
+      for (j = gy - r ; j <= gy + r ; j++)
+        {
+          if (j < 0 || j >= num_y) continue;
+
+          for (i = gx - r ; i <= gx + r ; i += (r == 0 || j == gy - r || j == gy + r) ? 1 : 2 * r)
+            {
+              wrapped = ((i % num_x) + num_x) % num_x;
+              shift = (double) (i - wrapped) * (CCL_CELL_UNITS / CCL_DISTANCE_BINS);
+
+              index = (j / CCL_DISTANCE_BINS) * CCL_COLS + wrapped / CCL_DISTANCE_BINS;
+
+              if (index != cell_index)
+                {
+                  cell = get_cell (engine, index);
+                  cell_index = index;
+                }
+
+              if (cell == NULL) continue;
+
+              b = (j % CCL_DISTANCE_BINS) * CCL_DISTANCE_BINS + wrapped % CCL_DISTANCE_BINS;
+
+              for (k = cell->bin_start[b] ; k < cell->bin_start[b + 1] ; k++)
+                {
+                  v = cell->bin_edge[k];
+
+                  ax = (cell->x[v] + shift - px) * scale_x;
+                  ay = (cell->y[v] - py) * scale_y;
+                  dx = (cell->x[v + 1] + shift - px) * scale_x - ax;
+                  dy = (cell->y[v + 1] - py) * scale_y - ay;
+
+                  length = dx * dx + dy * dy;
+                  t = (length > 0.0) ? MAX (0.0, MIN (1.0, -(ax * dx + ay * dy) / length)) : 0.0;
+
+                  qx = ax + t * dx;
+                  qy = ay + t * dy;
+                  d = qx * qx + qy * qy;
+
+                  if (d < best)
+                    {
+                      best = d;
+                      best_cell = cell;
+                      best_edge = v;
+                      best_t = t;
+                      best_shift = shift;
+                    }
+                }
+            }
+        }
+    }
+
+
+  if (best_cell == NULL) return;
+
+  *distance = sqrt (best);
+  *land = edge_side (best_cell, best_edge, best_t, best_shift, px, py);
+}
+
+
+
+/*  Run a chunk of the sorted points.  */
+
+static void distance_task (int32_t task, int32_t thread, void *data)
+{
+  DISTANCE_JOB      *job = (DISTANCE_JOB *) data;
+  int64_t           i, p, end;
+
+
+  (void) thread;
+
+  end = MIN (job->num_points, ((int64_t) task + 1) * DISTANCE_CHUNK);
+
+  for (i = (int64_t) task * DISTANCE_CHUNK ; i < end ; i++)
+    {
+      p = job->order[i];
+
+      ccl_distance_point (job->engine, job->point[2 * p], job->point[2 * p + 1], &job->distance[p], &job->land[p]);
+    }
+}
+
+
+
+/*
+
+    Run a batch of points (lon/lat pairs in degrees) with num_threads threads.  The points are sorted by cell (a
+    counting sort, the input order doesn't matter) and handed out in chunks so that each thread mostly works in the
+    same few cells.  distance and land (num_points values each) are filled in the input order.  Returns 0 or -1 if we
+    ran out of memory.
+
+*/
+
+int32_t ccl_distance_batch (CCL_DISTANCE *engine, int32_t num_threads, int64_t num_points, const double *point,
+                            double *distance, int8_t *land)
+{
+  DISTANCE_JOB      job;
+  int64_t           i, *count;
+  int32_t           *key;
+
+
+  job.order = (int64_t *) malloc (MAX (1, num_points) * sizeof (int64_t));
+  key = (int32_t *) malloc (MAX (1, num_points) * sizeof (int32_t));
+  count = (int64_t *) calloc (CCL_ROWS * CCL_COLS + 2, sizeof (int64_t));
+
+  if (job.order == NULL || key == NULL || count == NULL)
+    {
+      free (job.order);
+      free (key);
+      free (count);
+      return (-1);
+    }
+
+
+  /*  Off the earth points get their own bucket at the end.  */
+
+  for (i = 0 ; i < num_points ; i++)
+    {
+      if (point[2 * i] >= -180.0 && point[2 * i] <= 180.0 && point[2 * i + 1] >= -90.0 && point[2 * i + 1] <= 90.0)
+        {
+          key[i] = MIN (CCL_ROWS - 1, (int32_t) (point[2 * i + 1] + 90.0)) * CCL_COLS +
+            MIN (CCL_COLS - 1, (int32_t) (point[2 * i] + 180.0));
+        }
+      else
+        {
+          key[i] = CCL_ROWS * CCL_COLS;
+        }
+
+      count[key[i] + 1]++;
+    }
+
+  for (i = 0 ; i < CCL_ROWS * CCL_COLS + 1 ; i++) count[i + 1] += count[i];
+
+  for (i = 0 ; i < num_points ; i++) job.order[count[key[i]]++] = i;
+
+  free (key);
+  free (count);
+
+
+  job.engine = engine;
+  job.point = point;
+  job.distance = distance;
+  job.land = land;
+  job.num_points = num_points;
+
+  pool_run (num_threads, (int32_t) ((num_points + DISTANCE_CHUNK - 1) / DISTANCE_CHUNK), distance_task, &job);
+
+  free (job.order);
+
+  return (0);
+}
+
+
+
+void ccl_distance_free (CCL_DISTANCE *engine)
+{
+  int32_t           i;
+
+
+  for (i = 0 ; i < CCL_ROWS * CCL_COLS ; i++)
+    {
+      if (engine->cell[i] != NULL)
+        {
+          free (engine->cell[i]->bin_edge);
+          free (engine->cell[i]);
+        }
+    }
+
+  for (i = 0 ; i < CCL_DISTANCE_LOCKS ; i++) pthread_mutex_destroy (&engine->lock[i]);
+  pthread_mutex_destroy (&engine->stats_lock);
+
+  free (engine->cell);
+  free (engine->loaded);
+}
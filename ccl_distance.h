@@ -0,0 +1,111 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __CCL_DISTANCE_H__
+#define __CCL_DISTANCE_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ccl_reader.h"
+
+
+  /*  Each cell's edges are binned in a CCL_DISTANCE_BINS X CCL_DISTANCE_BINS grid (about 3.5km bins at the equator).  */
+
+#define CCL_DISTANCE_BINS    32
+#define CCL_DISTANCE_LOCKS   64
+
+
+  /*  Distances are in meters on a sphere with the WGS84 equatorial radius, measured in a local equirectangular
+      projection centered on each query point (plenty good for distances up to a few hundred kilometers).  */
+
+#define CCL_METERS_PER_DEGREE 111319.49079327357
+
+
+  /*  Land/water results.  CCL_UNKNOWN means that there was no coastline within the maximum distance.  */
+
+#define CCL_WATER            0
+#define CCL_LAND             1
+#define CCL_UNKNOWN          -1
+
+
+  /*  One loaded cell.  The segments' vertices are in x and y (fixed point) one after another, last is set for the last
+      vertex of each segment.  Edge v goes from vertex v to vertex v + 1.  The edges that touch bin b are
+      bin_edge[bin_start[b]] through bin_edge[bin_start[b + 1] - 1].  */
+
+  typedef struct
+  {
+    int32_t           num_vertices;
+    int32_t           *x;
+    int32_t           *y;
+    uint8_t           *last;
+    int32_t           *bin_start;
+    int32_t           *bin_edge;
+    int64_t           bytes;
+  } CCL_DISTANCE_CELL;
+
+
+  typedef struct
+  {
+    CCL_READER        *reader;
+    double            max_distance;           /*  Meters  */
+    CCL_DISTANCE_CELL **cell;                 /*  CCL_ROWS * CCL_COLS cells, NULL until they're loaded  */
+    uint8_t           *loaded;
+    pthread_mutex_t   lock[CCL_DISTANCE_LOCKS];
+    pthread_mutex_t   stats_lock;
+    int32_t           cells;                  /*  Number of cells loaded  */
+    int64_t           bytes;                  /*  Memory used by the loaded cells  */
+  } CCL_DISTANCE;
+
+
+  int32_t ccl_distance_init (CCL_DISTANCE *engine, CCL_READER *reader, double max_distance);
+  void ccl_distance_point (CCL_DISTANCE *engine, double lon, double lat, double *distance, int8_t *land);
+  int32_t ccl_distance_batch (CCL_DISTANCE *engine, int32_t num_threads, int64_t num_points, const double *point,
+                              double *distance, int8_t *land);
+  void ccl_distance_free (CCL_DISTANCE *engine);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
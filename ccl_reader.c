@@ -0,0 +1,1004 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include <zlib.h>
+
+#include "nvutility.h"
+
+#include "ccl_reader.h"
+
+
+/*
+
+    A reader for the compressed coastline (.ccl) files built by build_swbd.  The file is memory mapped (with random
+    access advice) so that repeated queries for the same area are just page cache hits instead of fread calls.  The
+    cell index is never read as a whole, each entry is picked out of the mapped header as a cell is visited.  Files
+    with levels of detail have one more cell index per level (see ccl_cell_level and ccl_query_level).
+    Segments are handed back as pointers into the mapped file along with their header fields and are only unpacked
+    when the caller asks for the vertices (see ccl_decode.c).  In files with compressed cell blocks each block is
+    inflated the first time it's needed and kept until ccl_close so the segment pointers stay good for as long as the
+    file is open, same as they do for the mapped file.  This file, ccl_decode.c, and shp_map.c (for map_file) are
+    built into a library for other programs (see mk).
+
+*/
+
+
+#define MAX_BIAS             131071
+
+
+/*  Map a .ccl file.  Returns 0 on success or -1 on failure.  If the file isn't a compressed coastline file errno is
+    set to EINVAL.  */
+
+int32_t ccl_open (CCL_READER *reader, char *name)
+{
+  char              *ptr;
+  int32_t           i;
+  uint32_t          flags, index;
+  int64_t           directory, table_size, start, extra;
+
+
+  memset (reader, 0, sizeof (CCL_READER));
+
+  if (map_file (&reader->file, name, 0)) return (-1);
+
+  ccl_decode_init ();
+
+  if (reader->file.size < CCL_VERSION_SIZE)
+    {
+      unmap_file (&reader->file);
+      errno = EINVAL;
+      return (-1);
+    }
+
+  memcpy (reader->version, reader->file.data, CCL_VERSION_SIZE);
+  reader->version[CCL_VERSION_SIZE] = 0;
+
+
+  /*  The version string tells us which header layout we've got.  */
+
+  if (strstr (reader->version, "Compressed Coastline file V2.") != NULL)
+    {
+      reader->format = CCL_FORMAT_2;
+    }
+  else if (strstr (reader->version, "Compressed Coastline file V1.") != NULL)
+    {
+      reader->format = CCL_FORMAT_1;
+    }
+  else
+    {
+      unmap_file (&reader->file);
+      errno = EINVAL;
+      return (-1);
+    }
+
+  reader->header_size = CCL_HEADER_SIZE (reader->format);
+
+  reader->alignment = 1;
+  if ((ptr = strstr (reader->version, "aligned to ")) != NULL) sscanf (ptr + 11, "%d", &reader->alignment);
+
+  reader->stitch = -1;
+  if ((ptr = strstr (reader->version, "stitched within ")) != NULL) sscanf (ptr + 16, "%d", &reader->stitch);
+
+  if (reader->file.size < reader->header_size)
+    {
+      unmap_file (&reader->file);
+      errno = EINVAL;
+      return (-1);
+    }
+
+
+  /*  Level 0 is the full resolution coastline.  The simplified levels and the segment index are found through the
+      directory that follows the last cell block.  It has the number of levels, the flags (segment index, stitched,
+      compressed, Rice coded, and columnar), the level tolerances, the stitching gap, the compression level, the Rice
+      prediction order, and then the cell indexes for each level and for the segment index.  */
+
+  reader->table[0] = CCL_VERSION_SIZE;
+
+  if ((ptr = strstr (reader->version, "Directory at ")) != NULL)
+    {
+      table_size = (int64_t) CCL_ROWS * CCL_COLS * CCL_ENTRY_SIZE (reader->format);
+
+      if (reader->format != CCL_FORMAT_2 || sscanf (ptr + 13, "%"SCNd64, &directory) != 1 ||
+          directory < reader->header_size || directory + 8 > reader->file.size)
+        {
+          unmap_file (&reader->file);
+          errno = EINVAL;
+          return (-1);
+        }
+
+      reader->num_levels = (int32_t) ccl_get_bits (reader->file.data + directory, 0, 32);
+      flags = ccl_get_bits (reader->file.data + directory, 32, 32);
+      index = flags & 1;
+
+      extra = directory + 8 + reader->num_levels * 4;
+      start = extra + ((flags & 2) ? 4 : 0) + ((flags & 4) ? 4 : 0) + ((flags & 8) ? 4 : 0);
+
+      if (reader->num_levels < 0 || reader->num_levels > CCL_MAX_LEVELS || flags > 31 || (flags & 24) == 24 ||
+          start + reader->num_levels * table_size + index * table_size > reader->file.size)
+        {
+          unmap_file (&reader->file);
+          errno = EINVAL;
+          return (-1);
+        }
+
+      for (i = 1 ; i <= reader->num_levels ; i++)
+        {
+          reader->tolerance[i] = (int32_t) ccl_get_bits (reader->file.data + directory + 8, (i - 1) * 32, 32);
+          reader->table[i] = start + (i - 1) * table_size;
+        }
+
+      if (flags & 2)
+        {
+          reader->stitch = (int32_t) ccl_get_bits (reader->file.data + extra, 0, 32);
+          extra += 4;
+        }
+
+      if (flags & 4)
+        {
+          reader->compression = MAX (1, (int32_t) ccl_get_bits (reader->file.data + extra, 0, 32));
+          extra += 4;
+        }
+
+      if (flags & 8) reader->coding = MAX (1, (int32_t) ccl_get_bits (reader->file.data + extra, 0, 32));
+
+      reader->columnar = (flags & 16) ? NVTrue : NVFalse;
+
+      if (index) reader->index_table = start + reader->num_levels * table_size;
+    }
+
+
+  /*  A slot for each cell's inflated block on each level.  */
+
+  if (reader->compression)
+    {
+      pthread_mutex_init (&reader->mutex, NULL);
+
+      for (i = 0 ; i <= reader->num_levels ; i++)
+        {
+          if ((reader->inflated[i] = (CCL_BLOCK *) calloc (CCL_ROWS * CCL_COLS, sizeof (CCL_BLOCK))) == NULL)
+            {
+              ccl_close (reader);
+              return (-1);
+            }
+        }
+    }
+
+  return (0);
+}
+
+
+
+void ccl_close (CCL_READER *reader)
+{
+  int32_t           i, j;
+
+
+  for (i = 0 ; i <= reader->num_levels ; i++)
+    {
+      if (reader->inflated[i] == NULL) continue;
+
+      for (j = 0 ; j < CCL_ROWS * CCL_COLS ; j++) free (reader->inflated[i][j].data);
+
+      free (reader->inflated[i]);
+      reader->inflated[i] = NULL;
+    }
+
+  if (reader->compression) pthread_mutex_destroy (&reader->mutex);
+
+  unmap_file (&reader->file);
+}
+
+
+
+/*  Get the raw address from a cell's index entry.  This is 0 for cells that had no input at all.  Cells that had an
+    input file but no segments still have an address (which may be the end of the file).  */
+
+int64_t ccl_cell_address (CCL_READER *reader, int32_t row, int32_t col)
+{
+  const uint8_t     *entry;
+
+
+  if (row < 0 || row >= CCL_ROWS || col < 0 || col >= CCL_COLS) return (0);
+
+  entry = reader->file.data + CCL_VERSION_SIZE + ((int64_t) row * CCL_COLS + col) * CCL_ENTRY_SIZE (reader->format);
+
+  if (reader->format == CCL_FORMAT_2) return (((int64_t) ccl_get_bits (entry, 0, 32) << 32) | ccl_get_bits (entry, 32, 32));
+
+  return (ccl_get_bits (entry, 0, 32));
+}
+
+
+
+/*  Get the index entry for a cell (row 0 is -90 to -89, col 0 is -180 to -179) at a level of detail (0 for full
+    resolution, up to num_levels).  Returns the number of segments in the cell.  Cells that point outside of the file
+    are treated as empty.  */
+
+int32_t ccl_cell_level (CCL_READER *reader, int32_t level, int32_t row, int32_t col, CCL_CELL *cell)
+{
+  const uint8_t     *entry;
+  int32_t           pos;
+
+
+  memset (cell, 0, sizeof (CCL_CELL));
+
+  if (row < 0 || row >= CCL_ROWS || col < 0 || col >= CCL_COLS || level < 0 || level > reader->num_levels) return (0);
+
+  entry = reader->file.data + reader->table[level] + ((int64_t) row * CCL_COLS + col) * CCL_ENTRY_SIZE (reader->format);
+  pos = (CCL_ENTRY_SIZE (reader->format) - 8) * 8;
+
+  if (reader->format == CCL_FORMAT_2)
+    {
+      cell->address = ((int64_t) ccl_get_bits (entry, 0, 32) << 32) | ccl_get_bits (entry, 32, 32);
+    }
+  else
+    {
+      cell->address = ccl_get_bits (entry, 0, 32);
+    }
+
+  cell->num_segments = (int32_t) ccl_get_bits (entry, pos, 32);
+  cell->num_vertices = (int32_t) ccl_get_bits (entry, pos + 32, 32);
+
+  if (cell->address < reader->header_size || cell->address >= reader->file.size || cell->num_segments < 0)
+    {
+      memset (cell, 0, sizeof (CCL_CELL));
+      return (0);
+    }
+
+  return (cell->num_segments);
+}
+
+
+
+/*  Get the full resolution index entry for a cell.  */
+
+int32_t ccl_cell (CCL_READER *reader, int32_t row, int32_t col, CCL_CELL *cell)
+{
+  return (ccl_cell_level (reader, 0, row, col, cell));
+}
+
+
+
+/*
+
+    Start a query for all of the segments in the cells that touch a lon/lat box (in degrees, -180 to 180 and -90 to
+    90).  If west is greater than east the box crosses the date line.  Segments are then returned by ccl_query_next
+    in cell order (south to north, west to east).
+
+*/
+
+void ccl_query_start (CCL_READER *reader, CCL_QUERY *query, double west, double east, double south, double north)
+{
+  int32_t           col_end;
+
+
+  memset (query, 0, sizeof (CCL_QUERY));
+
+  query->reader = reader;
+
+
+  query->row = MAX (0, (int32_t) floor (south + 90.0));
+  query->row_end = MIN (CCL_ROWS - 1, (int32_t) ceil (north + 90.0) - 1);
+  if (query->row_end < query->row) query->row_end = MIN (CCL_ROWS - 1, query->row);
+
+
+  query->col_start = MAX (0, MIN (CCL_COLS - 1, (int32_t) floor (west + 180.0)));
+  col_end = MAX (0, MIN (CCL_COLS - 1, (int32_t) ceil (east + 180.0) - 1));
+
+  if (west > east)
+    {
+      query->num_cols = MIN (CCL_COLS, (CCL_COLS - query->col_start) + col_end + 1);
+    }
+  else
+    {
+      query->num_cols = MAX (1, col_end - query->col_start + 1);
+    }
+
+
+  /*  The box in fixed point for clipping with the segment index.  */
+
+  query->box_x[0] = NINT ((MAX (-180.0, MIN (180.0, west)) + 180.0) * CCL_SCALE);
+  query->box_x[1] = NINT ((MAX (-180.0, MIN (180.0, east)) + 180.0) * CCL_SCALE);
+  query->box_y[0] = NINT ((MAX (-90.0, MIN (90.0, south)) + 90.0) * CCL_SCALE);
+  query->box_y[1] = NINT ((MAX (-90.0, MIN (90.0, north)) + 90.0) * CCL_SCALE);
+
+
+  /*  Nothing to do if the box is completely off the earth.  */
+
+  if (south > 90.0 || north < -90.0) query->row = query->row_end + 1;
+}
+
+
+
+/*  Start a query for the segments in a single cell.  */
+
+void ccl_query_cell (CCL_READER *reader, CCL_QUERY *query, int32_t row, int32_t col)
+{
+  memset (query, 0, sizeof (CCL_QUERY));
+
+  query->reader = reader;
+  query->row = query->row_end = row;
+  query->col_start = col;
+  query->num_cols = 1;
+
+  query->box_x[0] = col * CCL_CELL_UNITS;
+  query->box_x[1] = (col + 1) * CCL_CELL_UNITS;
+  query->box_y[0] = row * CCL_CELL_UNITS;
+  query->box_y[1] = (row + 1) * CCL_CELL_UNITS;
+
+  if (row < 0 || row >= CCL_ROWS || col < 0 || col >= CCL_COLS) query->row = row + 1;
+}
+
+
+
+/*  Switch a query (before the first ccl_query_next call) to one of the simplified levels of detail.  Returns 0 or -1
+    if the file doesn't have that level.  */
+
+int32_t ccl_query_level (CCL_QUERY *query, int32_t level)
+{
+  if (level < 0 || level > query->reader->num_levels || (level && query->clip)) return (-1);
+
+  query->level = level;
+
+  return (0);
+}
+
+
+
+/*
+
+    Switch a query (before the first ccl_query_next call) to only return the segments whose bounding boxes touch the
+    query box.  The segment index is used to find them so the others are never looked at.  Returns 0 or -1 if the
+    file doesn't have a segment index (it only covers the full resolution level).
+
+*/
+
+int32_t ccl_query_clip (CCL_QUERY *query)
+{
+  if (!query->reader->index_table || query->level) return (-1);
+
+  query->clip = NVTrue;
+  query->grid_row = 1;
+  query->grid_row_end = 0;
+
+  return (0);
+}
+
+
+
+/*  Parse the header of a Rice coded segment (see CCL_RICE_ESCAPE).  */
+
+static int32_t read_rice_segment (const uint8_t *data, const uint8_t *end, CCL_SEGMENT *segment)
+{
+  int32_t           count_bits, size_bits, pos;
+
+
+  count_bits = ccl_get_bits (segment->data, 0, 5);
+
+  if (end - data < (5 + count_bits + 5 + 7) / 8) return (-1);
+
+  pos = 5;
+  segment->count = ccl_get_bits (segment->data, pos, count_bits); pos += count_bits;
+  size_bits = ccl_get_bits (segment->data, pos, 5); pos += 5;
+
+  if (end - data < (pos + size_bits + 62 + 7) / 8) return (-1);
+
+  segment->size = ccl_get_bits (segment->data, pos, size_bits); pos += size_bits;
+  segment->start_x = ccl_get_bits (segment->data, pos, 26); pos += 26;
+  segment->start_y = ccl_get_bits (segment->data, pos, 25); pos += 25;
+  segment->order = ccl_get_bits (segment->data, pos, 1) + 1; pos += 1;
+  segment->lon_offset_bits = ccl_get_bits (segment->data, pos, 5); pos += 5;
+  segment->lat_offset_bits = ccl_get_bits (segment->data, pos, 5); pos += 5;
+  segment->offset_pos = pos;
+  segment->bias_x = segment->bias_y = 0;
+
+  if (segment->count < 1 || segment->size < (pos + 7) / 8 || segment->size > end - data) return (-1);
+
+  return (1);
+}
+
+
+
+/*  Parse the segment header at data.  coding is reader->coding (0 for fixed width offsets, otherwise the segments are
+    Rice coded).  Returns 1, or -1 if the segment runs off the end of the file.  */
+
+static int32_t read_segment (const uint8_t *data, const uint8_t *end, int32_t coding, int32_t row, int32_t col,
+                             CCL_SEGMENT *segment)
+{
+  int32_t           count_bits, pos;
+  int64_t           bits;
+
+
+  /*  Make sure the whole segment header is in the file before we read it.  */
+
+  if (end - data < 2) return (-1);
+
+  segment->row = row;
+  segment->col = col;
+  segment->data = data;
+  segment->order = 0;
+  segment->lat_data = NULL;
+  segment->lat_pos = 0;
+
+  if (coding) return (read_rice_segment (data, end, segment));
+
+  count_bits = ccl_get_bits (segment->data, 0, 5);
+  segment->lon_offset_bits = ccl_get_bits (segment->data, 5, 5);
+  segment->lat_offset_bits = ccl_get_bits (segment->data, 10, 5);
+
+  if (end - data < (15 + count_bits + 87 + 7) / 8) return (-1);
+
+  pos = 15;
+  segment->count = ccl_get_bits (segment->data, pos, count_bits); pos += count_bits;
+  segment->bias_x = (int32_t) ccl_get_bits (segment->data, pos, 18) - MAX_BIAS; pos += 18;
+  segment->bias_y = (int32_t) ccl_get_bits (segment->data, pos, 18) - MAX_BIAS; pos += 18;
+  segment->start_x = ccl_get_bits (segment->data, pos, 26); pos += 26;
+  segment->start_y = ccl_get_bits (segment->data, pos, 25); pos += 25;
+  segment->offset_pos = pos;
+
+
+  /*  Same size computation as the writer (it includes one extra offset pair and an extra byte).  */
+
+  bits = 15 + count_bits + segment->lon_offset_bits + segment->lat_offset_bits + 87 + 
+    ((int64_t) segment->count - 1) * (segment->lon_offset_bits + segment->lat_offset_bits);
+
+  if (segment->count < 1 || bits / 8 + 1 > end - data) return (-1);
+
+  segment->size = bits / 8 + 1;
+
+  return (1);
+}
+
+
+
+/*  Check the header of a columnar cell block (see CCL_COLUMN_HEADER).  Returns the size of the block, or -1 if it
+    doesn't fit between block and end.  */
+
+static int64_t column_block (const uint8_t *block, const uint8_t *end, int32_t *count_bits, int32_t *pos_bits,
+                             int64_t *lon, int64_t *lat)
+{
+  int64_t           size;
+
+
+  if (end - block < (CCL_COLUMN_HEADER + 7) / 8) return (-1);
+
+  *count_bits = ccl_get_bits (block, 0, 5);
+  *pos_bits = ccl_get_bits (block, 5, 5);
+  *lon = ccl_get_bits (block, 10, 32);
+  *lat = ccl_get_bits (block, 42, 32);
+  size = ccl_get_bits (block, 74, 32);
+
+  if (size > end - block || *lon < (CCL_COLUMN_HEADER + 7) / 8 || *lat < *lon || *lat + CCL_COLUMN_PAD > size)
+    return (-1);
+
+  return (size);
+}
+
+
+
+/*  Get segment i (of num_segments) out of a columnar cell block.  Returns 1, or -1 if the segment's record or offsets
+    aren't in the block.  */
+
+static int32_t read_column_segment (const uint8_t *block, const uint8_t *end, int32_t i, int32_t num_segments,
+                                    int32_t row, int32_t col, CCL_SEGMENT *segment)
+{
+  int32_t           count_bits, pos_bits, record, lon_pos;
+  int64_t           size, lon, lat, pos;
+
+
+  if ((size = column_block (block, end, &count_bits, &pos_bits, &lon, &lat)) < 0 || i < 0 || i >= num_segments)
+    return (-1);
+
+  record = CCL_COLUMN_RECORD (count_bits, pos_bits);
+
+  if ((CCL_COLUMN_HEADER + (int64_t) num_segments * record + 7) / 8 > lon) return (-1);
+
+  pos = CCL_COLUMN_HEADER + (int64_t) i * record;
+
+  segment->row = row;
+  segment->col = col;
+  segment->order = 0;
+  segment->count = ccl_get_bits (block, pos, count_bits); pos += count_bits;
+  segment->lon_offset_bits = ccl_get_bits (block, pos, 5); pos += 5;
+  segment->lat_offset_bits = ccl_get_bits (block, pos, 5); pos += 5;
+  segment->bias_x = (int32_t) ccl_get_bits (block, pos, 18) - MAX_BIAS; pos += 18;
+  segment->bias_y = (int32_t) ccl_get_bits (block, pos, 18) - MAX_BIAS; pos += 18;
+  segment->start_x = ccl_get_bits (block, pos, 26); pos += 26;
+  segment->start_y = ccl_get_bits (block, pos, 25); pos += 25;
+  lon_pos = ccl_get_bits (block, pos, pos_bits); pos += pos_bits;
+  segment->lat_pos = ccl_get_bits (block, pos, pos_bits);
+
+  segment->data = block + lon;
+  segment->offset_pos = lon_pos;
+  segment->lat_data = block + lat;
+  segment->size = (record + (segment->count - 1) * (segment->lon_offset_bits + segment->lat_offset_bits) + 7) / 8;
+
+  if (segment->count < 1 ||
+      lon_pos + (int64_t) (segment->count - 1) * segment->lon_offset_bits > (lat - lon) * 8 ||
+      segment->lat_pos + (int64_t) (segment->count - 1) * segment->lat_offset_bits > (size - CCL_COLUMN_PAD - lat) * 8)
+    return (-1);
+
+  return (1);
+}
+
+
+
+/*  Find a cell's segment index block.  Fills in everything in index but the cell's segments (block and end) and
+    returns the number of segments in the cell (0 if the file doesn't have a segment index, the cell is empty, or the
+    index block doesn't fit in the file).  */
+
+static int32_t index_entry (CCL_READER *reader, int32_t row, int32_t col, CCL_INDEX *index)
+{
+  const uint8_t     *entry;
+  CCL_CELL          cell;
+  int64_t           address, size;
+
+
+  memset (index, 0, sizeof (CCL_INDEX));
+
+  if (!reader->index_table || !ccl_cell (reader, row, col, &cell)) return (0);
+
+
+  /*  The index entries are address, number of segments, and the size of the index block.  */
+
+  entry = reader->file.data + reader->index_table + ((int64_t) row * CCL_COLS + col) * CCL_ENTRY_SIZE (reader->format);
+
+  address = ((int64_t) ccl_get_bits (entry, 0, 32) << 32) | ccl_get_bits (entry, 32, 32);
+  size = ccl_get_bits (entry, 96, 32);
+
+  if ((int32_t) ccl_get_bits (entry, 64, 32) != cell.num_segments || address < reader->header_size ||
+      address + CCL_GRID_SIZE + (int64_t) cell.num_segments * CCL_INDEX_RECORD > reader->file.size ||
+      address + size > reader->file.size)
+    return (0);
+
+  index->row = row;
+  index->col = col;
+  index->num_segments = cell.num_segments;
+  index->grid = reader->file.data + address;
+  index->record = index->grid + CCL_GRID_SIZE;
+  index->list = index->record + (int64_t) cell.num_segments * CCL_INDEX_RECORD;
+  index->list_size = (int32_t) ccl_get_bits (index->grid, CCL_GRID * CCL_GRID * 32, 32);
+  index->coding = reader->coding;
+  index->columnar = reader->columnar;
+
+  if (index->list + (int64_t) index->list_size * 4 > index->grid + size)
+    {
+      memset (index, 0, sizeof (CCL_INDEX));
+      return (0);
+    }
+
+  return (index->num_segments);
+}
+
+
+
+/*
+
+    Get the segment index block for a cell.  Returns the number of segments in the cell (0 if the file doesn't have
+    a segment index, the cell is empty, or the index block doesn't fit in the file).
+
+*/
+
+int32_t ccl_cell_index (CCL_READER *reader, int32_t row, int32_t col, CCL_INDEX *index)
+{
+  if (!index_entry (reader, row, col, index)) return (0);
+
+  if ((index->block = ccl_cell_data (reader, 0, row, col, &index->end)) == NULL)
+    {
+      memset (index, 0, sizeof (CCL_INDEX));
+      return (0);
+    }
+
+  return (index->num_segments);
+}
+
+
+
+/*
+
+    Get a cell's block as it's stored in the file (for copying it to another file without decoding it).  level is the
+    level of detail or CCL_INDEX_LEVEL for the segment index block.  data is set to the start of the block.  Returns
+    the size of the block, 0 if the cell is empty, or -1 if the block runs off the end of the file.  In an
+    uncompressed file we have to walk the segment headers to find the size (unless it's columnar).
+
+*/
+
+int64_t ccl_cell_raw (CCL_READER *reader, int32_t level, int32_t row, int32_t col, const uint8_t **data)
+{
+  CCL_CELL          cell;
+  CCL_INDEX         index;
+  CCL_SEGMENT       segment;
+  const uint8_t     *end;
+  int32_t           i, count_bits, pos_bits;
+  int64_t           size, lon, lat;
+
+
+  *data = NULL;
+
+  if (level == CCL_INDEX_LEVEL)
+    {
+      if (!index_entry (reader, row, col, &index)) return (0);
+
+      *data = index.grid;
+
+      return ((index.list + (int64_t) index.list_size * 4) - index.grid);
+    }
+
+  if (!ccl_cell_level (reader, level, row, col, &cell)) return (0);
+
+  *data = reader->file.data + cell.address;
+  end = reader->file.data + reader->file.size;
+
+  if (reader->compression)
+    {
+      if (end - *data < CCL_BLOCK_HEADER) return (-1);
+
+      size = CCL_BLOCK_HEADER + (int64_t) ccl_get_bits (*data, 32, 32);
+
+      return (size > end - *data ? -1 : size);
+    }
+
+  if (reader->columnar) return (column_block (*data, end, &count_bits, &pos_bits, &lon, &lat));
+
+  for (i = 0, size = 0 ; i < cell.num_segments ; i++)
+    {
+      if (read_segment (*data + size, end, reader->coding, row, col, &segment) < 0) return (-1);
+
+      size += segment.size;
+    }
+
+  return (size);
+}
+
+
+
+/*
+
+    Get the segments for a cell at a level of detail.  Returns a pointer to the first segment and sets end to the end
+    of the data that the segments may be read from, or returns NULL if the cell is empty or its block is corrupt.  In
+    an uncompressed file this is just a pointer into the mapped file.  In a compressed file the block is inflated the
+    first time it's asked for and kept until ccl_close.  The inflating is done outside of the lock so two threads may
+    both inflate the same block, in which case the second one throws its copy away.
+
+*/
+
+const uint8_t *ccl_cell_data (CCL_READER *reader, int32_t level, int32_t row, int32_t col, const uint8_t **end)
+{
+  CCL_CELL          cell;
+  CCL_BLOCK         *slot;
+  const uint8_t     *raw;
+  uint8_t           *data;
+  int64_t           raw_size, size;
+  uLongf            length;
+
+
+  if (!ccl_cell_level (reader, level, row, col, &cell)) return (NULL);
+
+  if (!reader->compression)
+    {
+      *end = reader->file.data + reader->file.size;
+      return (reader->file.data + cell.address);
+    }
+
+
+  slot = &reader->inflated[level][row * CCL_COLS + col];
+
+  pthread_mutex_lock (&reader->mutex);
+  data = slot->data;
+  size = slot->size;
+  pthread_mutex_unlock (&reader->mutex);
+
+  if (data == NULL)
+    {
+      if ((raw_size = ccl_cell_raw (reader, level, row, col, &raw)) <= CCL_BLOCK_HEADER) return (NULL);
+
+      size = ccl_get_bits (raw, 0, 32);
+      length = size;
+
+      if ((data = (uint8_t *) malloc (MAX (size, 1))) == NULL) return (NULL);
+
+      if (uncompress (data, &length, raw + CCL_BLOCK_HEADER, raw_size - CCL_BLOCK_HEADER) != Z_OK ||
+          (int64_t) length != size)
+        {
+          free (data);
+          return (NULL);
+        }
+
+      pthread_mutex_lock (&reader->mutex);
+
+      if (slot->data == NULL)
+        {
+          slot->data = data;
+          slot->size = size;
+        }
+      else
+        {
+          free (data);
+          data = slot->data;
+          size = slot->size;
+        }
+
+      pthread_mutex_unlock (&reader->mutex);
+    }
+
+  *end = data + size;
+
+  return (data);
+}
+
+
+
+/*  Get the bounding box (min x, min y, max x, max y in fixed point) of segment i in a cell's segment index.  */
+
+void ccl_index_box (const CCL_INDEX *index, int32_t i, int32_t *box)
+{
+  const uint8_t     *record;
+
+
+  record = index->record + (int64_t) i * CCL_INDEX_RECORD;
+
+  box[0] = index->col * CCL_CELL_UNITS + (int32_t) ccl_get_bits (record, 0, 17);
+  box[1] = index->row * CCL_CELL_UNITS + (int32_t) ccl_get_bits (record, 17, 17);
+  box[2] = index->col * CCL_CELL_UNITS + (int32_t) ccl_get_bits (record, 34, 17);
+  box[3] = index->row * CCL_CELL_UNITS + (int32_t) ccl_get_bits (record, 51, 17);
+}
+
+
+
+/*  Get segment i of a cell straight from its offset in the segment index (or its record in a columnar cell).  Returns
+    1, or -1 if it doesn't fit in the file.  */
+
+int32_t ccl_index_segment (const CCL_INDEX *index, int32_t i, CCL_SEGMENT *segment)
+{
+  uint32_t          offset;
+
+
+  if (i < 0 || i >= index->num_segments) return (-1);
+
+  if (index->columnar)
+    return (read_column_segment (index->block, index->end, i, index->num_segments, index->row, index->col, segment));
+
+  offset = ccl_get_bits (index->record + (int64_t) i * CCL_INDEX_RECORD, 68, 32);
+
+  if (offset >= index->end - index->block) return (-1);
+
+  return (read_segment (index->block + offset, index->end, index->coding, index->row, index->col, segment));
+}
+
+
+
+/*  Which sub-cell a value (relative to the cell corner) falls in.  */
+
+static inline int32_t grid_cell (int32_t value)
+{
+  return (MAX (0, MIN (CCL_GRID - 1, value / (CCL_CELL_UNITS / CCL_GRID))));
+}
+
+
+
+/*
+
+    ccl_query_next for clipped queries.  For each cell we work out which sub-cells the box covers and go through
+    their segment lists, checking each segment's bounding box against the box.  A segment that is in more than one of
+    the sub-cells is only returned from the first one (south to north, west to east) that it shares with the box.
+
+*/
+
+static int32_t query_next_clipped (CCL_QUERY *query, CCL_SEGMENT *segment)
+{
+  CCL_READER        *reader = query->reader;
+  CCL_INDEX         *index = &query->index;
+  int32_t           col, i, g, x0, x1, west, east, box[4];
+
+
+  while (NVTrue)
+    {
+      /*  The next segment in the current sub-cell list.  */
+
+      if (query->candidate < query->candidate_end)
+        {
+          i = (int32_t) ccl_get_bits (index->list, (int64_t) query->candidate * 32, 32);
+          query->candidate++;
+
+          if (i < 0 || i >= index->num_segments) return (-1);
+
+          ccl_index_box (index, i, box);
+
+          box[0] -= index->col * CCL_CELL_UNITS;
+          box[2] -= index->col * CCL_CELL_UNITS;
+          box[1] -= index->row * CCL_CELL_UNITS;
+          box[3] -= index->row * CCL_CELL_UNITS;
+
+          if (box[2] < query->local_x[0] || box[0] > query->local_x[1] || box[3] < query->local_y[0] ||
+              box[1] > query->local_y[1]) continue;
+
+          if (MAX (grid_cell (box[1]), grid_cell (query->local_y[0])) != query->grid_row ||
+              MAX (grid_cell (box[0]), query->grid_col_start) != query->list_col) continue;
+
+          return (ccl_index_segment (index, i, segment));
+        }
+
+
+      /*  The next sub-cell.  */
+
+      if (query->grid_row <= query->grid_row_end)
+        {
+          if (query->grid_col > query->grid_col_end)
+            {
+              query->grid_row++;
+              query->grid_col = query->grid_col_start;
+              continue;
+            }
+
+          g = query->grid_row * CCL_GRID + query->grid_col;
+
+          query->list_col = query->grid_col;
+          query->grid_col++;
+
+          query->candidate = (int32_t) ccl_get_bits (index->grid, g * 32, 32);
+          query->candidate_end = MIN ((int32_t) ccl_get_bits (index->grid, (g + 1) * 32, 32), index->list_size);
+          continue;
+        }
+
+
+      /*  The next cell.  */
+
+      if (query->row > query->row_end) return (0);
+
+      if (query->col_index >= query->num_cols)
+        {
+          query->row++;
+          query->col_index = 0;
+          continue;
+        }
+
+      col = (query->col_start + query->col_index) % CCL_COLS;
+      query->col_index++;
+
+      if (!ccl_cell_index (reader, query->row, col, index)) continue;
+
+
+      /*  The part of the box that's in this cell.  If the box crosses the date line it's the east or west piece (or
+          the whole cell if both pieces are in it).  */
+
+      x0 = col * CCL_CELL_UNITS;
+      x1 = x0 + CCL_CELL_UNITS;
+
+      if (query->box_x[0] > query->box_x[1])
+        {
+          west = (x1 >= query->box_x[0]);
+          east = (x0 <= query->box_x[1]);
+
+          query->local_x[0] = (west && !east) ? query->box_x[0] - x0 : 0;
+          query->local_x[1] = (east && !west) ? query->box_x[1] - x0 : CCL_CELL_UNITS;
+        }
+      else
+        {
+          query->local_x[0] = query->box_x[0] - x0;
+          query->local_x[1] = query->box_x[1] - x0;
+        }
+
+      query->local_y[0] = query->box_y[0] - query->row * CCL_CELL_UNITS;
+      query->local_y[1] = query->box_y[1] - query->row * CCL_CELL_UNITS;
+
+      query->local_x[0] = MAX (0, query->local_x[0]);
+      query->local_x[1] = MIN (CCL_CELL_UNITS, query->local_x[1]);
+      query->local_y[0] = MAX (0, query->local_y[0]);
+      query->local_y[1] = MIN (CCL_CELL_UNITS, query->local_y[1]);
+
+      if (query->local_x[0] > query->local_x[1] || query->local_y[0] > query->local_y[1]) continue;
+
+      query->grid_row = grid_cell (query->local_y[0]);
+      query->grid_row_end = grid_cell (query->local_y[1]);
+      query->grid_col_start = query->grid_col = grid_cell (query->local_x[0]);
+      query->grid_col_end = grid_cell (query->local_x[1]);
+      query->candidate = query->candidate_end = 0;
+    }
+}
+
+
+
+/*
+
+    Get the next segment from a query.  Returns 1 if segment was filled in, 0 if there are no more segments, or -1 if
+    a segment runs off the end of the file (i.e. the file is truncated or corrupt).
+
+*/
+
+int32_t ccl_query_next (CCL_QUERY *query, CCL_SEGMENT *segment)
+{
+  CCL_READER        *reader = query->reader;
+  CCL_CELL          cell;
+  int32_t           col;
+
+
+  if (query->clip) return (query_next_clipped (query, segment));
+
+
+  /*  Move to the next cell that has segments.  */
+
+  while (query->segment >= query->num_segments)
+    {
+      if (query->row > query->row_end) return (0);
+
+      if (query->col_index >= query->num_cols)
+        {
+          query->row++;
+          query->col_index = 0;
+          continue;
+        }
+
+      col = (query->col_start + query->col_index) % CCL_COLS;
+      query->col_index++;
+
+      if (ccl_cell_level (reader, query->level, query->row, col, &cell))
+        {
+          query->cell_row = query->row;
+          query->cell_col = col;
+          query->segment = 0;
+          query->num_segments = cell.num_segments;
+
+          if ((query->next = ccl_cell_data (reader, query->level, query->row, col, &query->end)) == NULL) return (-1);
+        }
+    }
+
+
+  /*  The segments in a columnar cell are found through the cell's table so query->next stays at the start of the
+      block.  */
+
+  if (reader->columnar)
+    {
+      if (read_column_segment (query->next, query->end, query->segment, query->num_segments, query->cell_row,
+                               query->cell_col, segment) < 0) return (-1);
+    }
+  else
+    {
+      if (read_segment (query->next, query->end, reader->coding, query->cell_row, query->cell_col, segment) < 0)
+        return (-1);
+
+      query->next += segment->size;
+    }
+
+  query->segment++;
+
+  return (1);
+}
@@ -0,0 +1,306 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __CCL_READER_H__
+#define __CCL_READER_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "shp_map.h"
+
+
+  /*  The layout of a compressed coastline (.ccl) file, a 128 byte ASCII version string followed by 180 X 360 header
+      entries.  In format 1 (V1.01) each entry is three 32 bit values (address, number of segments, number of
+      vertices).  In format 2 (V2.00) the address is 64 bits so the entries are 16 bytes.  Format 2 files may also have
+      their cell blocks aligned to CCL_PAGE_SIZE, may carry up to CCL_MAX_LEVELS simplified copies of the coastline
+      (levels of detail), each with its own cell index, may have a segment index, may have Rice coded segments or
+      columnar cell blocks, and may have their cell blocks compressed (zlib).  See the build_swbd main.c header for the
+      details.  */
+
+#define CCL_ROWS             180
+#define CCL_COLS             360
+#define CCL_VERSION_SIZE     128
+#define CCL_FORMAT_1         1
+#define CCL_FORMAT_2         2
+#define CCL_ENTRY_SIZE(f)    ((f) == CCL_FORMAT_2 ? 16 : 12)
+#define CCL_HEADER_SIZE(f)   (CCL_VERSION_SIZE + CCL_ROWS * CCL_COLS * CCL_ENTRY_SIZE (f))
+#define CCL_PAGE_SIZE        4096
+#define CCL_MAX_LEVELS       8
+
+
+  /*  Positions are stored as (lon + 180) * 100000 and (lat + 90) * 100000.  */
+
+#define CCL_SCALE            100000.0
+#define CCL_CELL_UNITS       100000
+
+
+  /*  The segment index.  Each cell's index block starts with a CCL_GRID X CCL_GRID grid of sub-cells stored as
+      CCL_GRID * CCL_GRID + 1 32 bit list starts.  Then there is a CCL_INDEX_RECORD byte record for each segment (the
+      four 17 bit bounding box values min x, min y, max x, and max y relative to the cell's southwest corner, and the 32
+      bit byte offset of the segment in the cell block).  Last are the lists of segment numbers (32 bits each) whose
+      bounding boxes touch each sub-cell.  */
+
+#define CCL_GRID             8
+#define CCL_INDEX_RECORD     13
+#define CCL_GRID_SIZE        ((CCL_GRID * CCL_GRID + 1) * 4)
+
+
+  /*  Compressed cell blocks (level 0 and the levels of detail, not the segment index) start with the size of the
+      block before compression and the size of the zlib stream that follows (32 bits each).  Empty cells are still
+      empty.  Pass CCL_INDEX_LEVEL to ccl_cell_raw to get a segment index block.  */
+
+#define CCL_BLOCK_HEADER     8
+#define CCL_INDEX_LEVEL      -1
+
+
+  /*  Rice coded segments.  Instead of the fixed width offsets each segment is the count bits (5 bits), the count,
+      the size bits (5 bits), the size of the segment in bytes, the start lon (26 bits) and lat (25 bits), the
+      prediction order (1 bit, 0 for deltas and 1 for delta of deltas), and the Rice parameters for lon and lat (5
+      bits each).  Then for each vertex after the first the lon and then the lat residual (the delta, or the change
+      in the delta, from the previous vertex) is zigzag coded (0, -1, 1, -2, ... become 0, 1, 2, 3, ...) and written
+      as the quotient in unary (ones ended by a zero) followed by the low Rice parameter bits.  A quotient of
+      CCL_RICE_ESCAPE or more is written as CCL_RICE_ESCAPE ones followed by the whole zigzag value in 32 bits.  The
+      Rice parameters are never more than CCL_RICE_MAX_PARAM.  */
+
+#define CCL_RICE_ESCAPE      16
+#define CCL_RICE_MAX_PARAM   24
+
+
+  /*  Columnar cell blocks.  Instead of one segment after another, a cell block starts with the count bits (5 bits,
+      the most any segment in the cell needs), the position bits (5 bits), the byte offsets of the lon and lat offset
+      streams from the start of the block, and the size of the block (32 bits each).  That's CCL_COLUMN_HEADER bits.
+      Then there's a table with a record for each segment (the count, lon and lat offset bits, lon and lat biases plus
+      2**17, start lon and lat, and the bit positions of the segment's first lon and first lat offset in their streams)
+      so segment N can be found without reading segments 0 through N - 1.  Then come the lon offsets of all of the
+      segments, the lat offsets of all of the segments (each stream starts on a byte boundary), and CCL_COLUMN_PAD zero
+      bytes so that a vector decoder can always read 4 bytes from the byte holding any field.  In the segment index
+      the offset of each segment is its segment number.  */
+
+#define CCL_COLUMN_HEADER    106
+#define CCL_COLUMN_PAD       4
+#define CCL_COLUMN_RECORD(c, p)  ((c) + 5 + 5 + 18 + 18 + 26 + 25 + 2 * (p))
+
+
+  /*  A cell block inflated out of a compressed file.  */
+
+  typedef struct
+  {
+    uint8_t           *data;
+    int64_t           size;
+  } CCL_BLOCK;
+
+
+  /*  An open, memory mapped .ccl file.  */
+
+  typedef struct
+  {
+    MAPPED_FILE       file;
+    char              version[CCL_VERSION_SIZE + 1];
+    int32_t           format;                 /*  CCL_FORMAT_1 or CCL_FORMAT_2  */
+    int32_t           alignment;              /*  Cell block alignment (1 if they aren't aligned)  */
+    int32_t           stitch;                 /*  Gap segments were stitched across (fixed point, -1 if not)  */
+    int64_t           header_size;
+    int32_t           num_levels;             /*  Number of simplified levels (level 0 is full resolution)  */
+    int32_t           tolerance[CCL_MAX_LEVELS + 1];  /*  Simplification tolerance of each level (fixed point)  */
+    int64_t           table[CCL_MAX_LEVELS + 1];      /*  File offset of each level's cell index  */
+    int64_t           index_table;            /*  File offset of the segment index's cell index (0 if none)  */
+    int32_t           compression;            /*  zlib level of the compressed cell blocks (0 if not compressed)  */
+    int32_t           coding;                 /*  Highest Rice prediction order (0 for fixed width offsets)  */
+    uint8_t           columnar;               /*  Set if the cell blocks are columnar  */
+    CCL_BLOCK         *inflated[CCL_MAX_LEVELS + 1];  /*  Inflated blocks for each level (compressed files only)  */
+    pthread_mutex_t   mutex;                  /*  Protects inflated  */
+  } CCL_READER;
+
+
+  /*  One entry from the cell index.  address is 0 if there is no data for the cell.  */
+
+  typedef struct
+  {
+    int64_t           address;
+    int32_t           num_segments;
+    int32_t           num_vertices;
+  } CCL_CELL;
+
+
+  /*  One packed segment.  data points into the mapped file (or the inflated cell block), nothing is decoded until you
+      call ccl_segment_decode or ccl_segment_degrees.  If order isn't 0 the segment is Rice coded, lon_offset_bits and
+      lat_offset_bits are the Rice parameters, and there are no biases.  If lat_data isn't NULL the segment is from a
+      columnar cell, data and offset_pos are where its lon offsets start, lat_data and lat_pos are where its lat offsets
+      start, and size is just its share of the block (its record and offsets).  */
+
+  typedef struct
+  {
+    int32_t           row;
+    int32_t           col;
+    int32_t           count;
+    int32_t           lon_offset_bits;
+    int32_t           lat_offset_bits;
+    int32_t           bias_x;
+    int32_t           bias_y;
+    int32_t           start_x;
+    int32_t           start_y;
+    int32_t           offset_pos;
+    int32_t           size;
+    int32_t           order;                  /*  Rice prediction order (1 or 2), 0 for fixed width offsets  */
+    const uint8_t     *data;
+    const uint8_t     *lat_data;              /*  Columnar cells only, otherwise NULL  */
+    int32_t           lat_pos;
+  } CCL_SEGMENT;
+
+
+  /*  A cell's segment index block.  */
+
+  typedef struct
+  {
+    int32_t           row;
+    int32_t           col;
+    int32_t           num_segments;
+    int32_t           list_size;              /*  Number of entries in the sub-cell lists  */
+    const uint8_t     *grid;
+    const uint8_t     *record;
+    const uint8_t     *list;
+    const uint8_t     *block;                 /*  The cell's segments  */
+    const uint8_t     *end;                   /*  End of the mapped file (or the inflated cell block)  */
+    int32_t           coding;                 /*  reader->coding  */
+    uint8_t           columnar;               /*  reader->columnar  */
+  } CCL_INDEX;
+
+
+  /*  Iterator state for a bounding box query.  If clip is set the segment index is used to only return the segments
+      whose bounding boxes touch the box.  */
+
+  typedef struct
+  {
+    CCL_READER        *reader;
+    int32_t           level;
+    uint8_t           clip;
+    int32_t           box_x[2];               /*  The box in fixed point  */
+    int32_t           box_y[2];
+    CCL_INDEX         index;                  /*  Segment index for the current cell (when clipping)  */
+    int32_t           local_x[2];             /*  The part of the box in the current cell (relative to its corner)  */
+    int32_t           local_y[2];
+    int32_t           grid_row;
+    int32_t           grid_row_end;
+    int32_t           grid_col;
+    int32_t           grid_col_start;
+    int32_t           grid_col_end;
+    int32_t           list_col;               /*  Sub-cell column of the current list  */
+    int32_t           candidate;
+    int32_t           candidate_end;
+    int32_t           row;
+    int32_t           row_end;
+    int32_t           col_start;
+    int32_t           col_index;
+    int32_t           num_cols;
+    int32_t           cell_row;
+    int32_t           cell_col;
+    int32_t           segment;
+    int32_t           num_segments;
+    const uint8_t     *next;
+    const uint8_t     *end;                   /*  End of the current cell's data  */
+  } CCL_QUERY;
+
+
+  /*  Segment decoders.  */
+
+#define CCL_DECODE_AUTO      -1
+#define CCL_DECODE_SCALAR    0
+#define CCL_DECODE_AVX2      1
+
+
+  /*  Unpack a segment.  If x is not NULL the positions go in x and y as fixed point values, otherwise they go in lon
+      and lat as degrees.  The arrays must hold segment->count values.  */
+
+  typedef void (*CCL_DECODE_FUNC) (const CCL_SEGMENT *segment, int32_t *x, int32_t *y, double *lon, double *lat);
+
+
+  int32_t ccl_open (CCL_READER *reader, char *name);
+  void ccl_close (CCL_READER *reader);
+  int32_t ccl_cell (CCL_READER *reader, int32_t row, int32_t col, CCL_CELL *cell);
+  int32_t ccl_cell_level (CCL_READER *reader, int32_t level, int32_t row, int32_t col, CCL_CELL *cell);
+  int64_t ccl_cell_address (CCL_READER *reader, int32_t row, int32_t col);
+  const uint8_t *ccl_cell_data (CCL_READER *reader, int32_t level, int32_t row, int32_t col, const uint8_t **end);
+  int64_t ccl_cell_raw (CCL_READER *reader, int32_t level, int32_t row, int32_t col, const uint8_t **data);
+  void ccl_query_start (CCL_READER *reader, CCL_QUERY *query, double west, double east, double south, double north);
+  void ccl_query_cell (CCL_READER *reader, CCL_QUERY *query, int32_t row, int32_t col);
+  int32_t ccl_query_level (CCL_QUERY *query, int32_t level);
+  int32_t ccl_query_clip (CCL_QUERY *query);
+  int32_t ccl_cell_index (CCL_READER *reader, int32_t row, int32_t col, CCL_INDEX *index);
+  void ccl_index_box (const CCL_INDEX *index, int32_t i, int32_t *box);
+  int32_t ccl_index_segment (const CCL_INDEX *index, int32_t i, CCL_SEGMENT *segment);
+  int32_t ccl_query_next (CCL_QUERY *query, CCL_SEGMENT *segment);
+  void ccl_segment_decode (const CCL_SEGMENT *segment, int32_t *x, int32_t *y);
+  void ccl_segment_degrees (const CCL_SEGMENT *segment, double *lon, double *lat);
+  int32_t ccl_decode_select (int32_t kernel);
+  void ccl_decode_init ();
+  const char *ccl_decode_name (int32_t kernel);
+
+
+  /*  Get numbits (0 to 32) bits, MSB first, starting at bit pos.  This only touches the bytes that actually hold the
+      bits so it never reads past the end of a segment.  */
+
+  static inline uint32_t ccl_get_bits (const uint8_t *buffer, int64_t pos, int32_t numbits)
+  {
+    const uint8_t     *ptr;
+    int32_t           i, shift, nbytes;
+    uint64_t          value;
+
+
+    if (!numbits) return (0);
+
+    ptr = buffer + (pos >> 3);
+    shift = pos & 7;
+    nbytes = (shift + numbits + 7) >> 3;
+
+    value = 0;
+    for (i = 0 ; i < nbytes ; i++) value = (value << 8) | ptr[i];
+
+    return ((uint32_t) ((value >> (nbytes * 8 - shift - numbits)) & ((1ULL << numbits) - 1)));
+  }
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,322 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "build_swbd.h"
+
+
+/*  Number of int32_t values (1MB) that a cell has to accumulate before we spill it in the middle of reading it.  */
+
+#define SPILL_CHUNK          262144
+
+
+/*
+
+    In-memory storage for the pass 1 output.  This replaces the 64,800 cell_XXX_YYY temporary files that we used to
+    write, read back, and remove.  Each cell is only ever written by the thread that is reading its shape file so we
+    don't need to lock the cell itself, just the memory total and the spill file.
+
+*/
+
+
+/*  Initialize the cell store.  budget is the number of bytes of segment records that we'll keep in memory before we
+    start moving cells to the spill file (0 means no limit).  The spill file isn't created unless we need it.  */
+
+void cell_store_init (CELL_STORE *store, int64_t budget, char *spill_name)
+{
+  memset (store, 0, sizeof (CELL_STORE));
+
+  store->cell = (CELL *) calloc (CELL_ROWS * CELL_COLS, sizeof (CELL));
+  if (store->cell == NULL)
+    {
+      perror ("Allocating cell store memory");
+      exit (-1);
+    }
+
+  store->budget = budget;
+  strcpy (store->spill_name, spill_name);
+
+  pthread_mutex_init (&store->mutex, NULL);
+}
+
+
+
+/*  Mark a cell as having been read.  The old temporary file was created even if no segments made it through the
+    boundary filter and pass 2 gave those cells an address so we need to keep track of them.  */
+
+void cell_store_touch (CELL_STORE *store, int32_t x, int32_t y)
+{
+  store->cell[y * CELL_COLS + x].present = NVTrue;
+}
+
+
+
+/*  Move the records for a cell out to the spill file and free the memory.  */
+
+static void cell_store_spill (CELL_STORE *store, CELL *cell)
+{
+  int64_t           alloc;
+
+
+  pthread_mutex_lock (&store->mutex);
+
+  if (store->spill_fp == NULL)
+    {
+      if ((store->spill_fp = fopen (store->spill_name, "w+b")) == NULL)
+        {
+          perror (store->spill_name);
+          exit (-1);
+        }
+
+
+      /*  Unlink it right away so that it goes away no matter how we exit (Windows can't remove an open file so there
+          it's removed by cell_store_close).  */
+
+#ifndef NVWIN3X
+      remove (store->spill_name);
+#endif
+    }
+
+  alloc = cell->spill_alloc;
+  cell->spill_offset = (int64_t *) grow_buffer (cell->spill_offset, &alloc, cell->spill_count + 1, sizeof (int64_t));
+  cell->spill_size = (int64_t *) grow_buffer (cell->spill_size, &cell->spill_alloc, cell->spill_count + 1, sizeof (int64_t));
+
+  cell->spill_offset[cell->spill_count] = store->spilled;
+  cell->spill_size[cell->spill_count] = cell->size;
+  cell->spill_count++;
+
+  FSEEKO (store->spill_fp, store->spilled, SEEK_SET);
+  if (fwrite (cell->data, sizeof (int32_t), cell->size, store->spill_fp) != (size_t) cell->size)
+    {
+      perror (store->spill_name);
+      exit (-1);
+    }
+
+  store->spilled += cell->size * sizeof (int32_t);
+  store->in_memory -= cell->alloc * sizeof (int32_t);
+
+  pthread_mutex_unlock (&store->mutex);
+
+
+  free (cell->data);
+  arena_count (0, 1, 0);
+
+  cell->data = NULL;
+  cell->size = cell->alloc = 0;
+}
+
+
+
+/*  Append a segment to a cell.  */
+
+void cell_store_add_segment (CELL_STORE *store, int32_t x, int32_t y, int32_t count, int32_t *segx, int32_t *segy)
+{
+  CELL              *cell = &store->cell[y * CELL_COLS + x];
+  int64_t           need, old_alloc, i;
+  int32_t           *rec;
+
+
+  need = cell->size + 1 + 2 * (int64_t) count;
+
+
+  /*  Grow the record buffer geometrically.  */
+
+  if (need > cell->alloc)
+    {
+      old_alloc = cell->alloc;
+      cell->data = (int32_t *) grow_buffer (cell->data, &cell->alloc, need, sizeof (int32_t));
+
+      pthread_mutex_lock (&store->mutex);
+      store->in_memory += (cell->alloc - old_alloc) * sizeof (int32_t);
+      pthread_mutex_unlock (&store->mutex);
+    }
+
+
+  rec = &cell->data[cell->size];
+
+  rec[0] = count;
+  for (i = 0 ; i < count ; i++)
+    {
+      rec[1 + 2 * i] = segx[i];
+      rec[2 + 2 * i] = segy[i];
+    }
+
+  cell->size = need;
+
+
+  /*  If we're over budget and this cell has built up a decent sized chunk, get rid of it.  Whatever is left over gets
+      spilled by cell_store_finish.  */
+
+  if (store->budget && store->in_memory > store->budget && cell->size >= SPILL_CHUNK) cell_store_spill (store, cell);
+}
+
+
+
+/*  Called when we're done reading a cell.  If we're over budget the records go to the spill file.  */
+
+void cell_store_finish (CELL_STORE *store, int32_t x, int32_t y)
+{
+  CELL              *cell = &store->cell[y * CELL_COLS + x];
+
+
+  if (store->budget && store->in_memory > store->budget && cell->size) cell_store_spill (store, cell);
+}
+
+
+
+/*  Get all of the segment records for a cell.  Returns the number of int32_t values in *data (0 if there are none).
+    If the cell was never spilled this is just the in-memory buffer, otherwise we read the extents back from the spill
+    file into a new buffer.  Call cell_store_release when you're done with it.  */
+
+int64_t cell_store_get (CELL_STORE *store, int32_t x, int32_t y, int32_t **data)
+{
+  CELL              *cell = &store->cell[y * CELL_COLS + x];
+  int64_t           total, pos;
+  int32_t           i;
+
+
+  if (!cell->spill_count)
+    {
+      *data = cell->data;
+      return (cell->size);
+    }
+
+
+  total = cell->size;
+  for (i = 0 ; i < cell->spill_count ; i++) total += cell->spill_size[i];
+
+  if ((*data = (int32_t *) malloc (total * sizeof (int32_t))) == NULL)
+    {
+      perror ("Allocating spill read memory");
+      exit (-1);
+    }
+
+  arena_count (1, 0, total * sizeof (int32_t));
+
+
+  /*  Extents first (they were written in order) followed by whatever is still in memory.  */
+
+  pos = 0;
+
+  pthread_mutex_lock (&store->mutex);
+
+  for (i = 0 ; i < cell->spill_count ; i++)
+    {
+      FSEEKO (store->spill_fp, cell->spill_offset[i], SEEK_SET);
+      if (fread (&(*data)[pos], sizeof (int32_t), cell->spill_size[i], store->spill_fp) != (size_t) cell->spill_size[i])
+        {
+          perror (store->spill_name);
+          exit (-1);
+        }
+
+      pos += cell->spill_size[i];
+    }
+
+  pthread_mutex_unlock (&store->mutex);
+
+  if (cell->size) memcpy (&(*data)[pos], cell->data, cell->size * sizeof (int32_t));
+
+  return (total);
+}
+
+
+
+/*  Free the records for a cell once it has been packed.  data is the pointer we got from cell_store_get.  */
+
+void cell_store_release (CELL_STORE *store, int32_t x, int32_t y, int32_t *data)
+{
+  CELL              *cell = &store->cell[y * CELL_COLS + x];
+
+
+  if (data != NULL && data != cell->data)
+    {
+      free (data);
+      arena_count (0, 1, 0);
+    }
+
+  if (cell->data != NULL)
+    {
+      pthread_mutex_lock (&store->mutex);
+      store->in_memory -= cell->alloc * sizeof (int32_t);
+      pthread_mutex_unlock (&store->mutex);
+
+      free (cell->data);
+      arena_count (0, 1, 0);
+    }
+
+  if (cell->spill_offset != NULL)
+    {
+      free (cell->spill_offset);
+      free (cell->spill_size);
+      arena_count (0, 2, 0);
+    }
+
+  cell->data = NULL;
+  cell->spill_offset = NULL;
+  cell->spill_size = NULL;
+  cell->size = cell->alloc = 0;
+  cell->spill_count = 0;
+  cell->spill_alloc = 0;
+}
+
+
+
+/*  Free everything and get rid of the spill file.  */
+
+void cell_store_close (CELL_STORE *store)
+{
+  int32_t           i;
+
+
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++) cell_store_release (store, i % CELL_COLS, i / CELL_COLS, NULL);
+
+  free (store->cell);
+  store->cell = NULL;
+
+  if (store->spill_fp != NULL)
+    {
+      fclose (store->spill_fp);
+#ifdef NVWIN3X
+      remove (store->spill_name);
+#endif
+      store->spill_fp = NULL;
+    }
+
+  pthread_mutex_destroy (&store->mutex);
+}
@@ -0,0 +1,102 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __CELL_STORE_H__
+#define __CELL_STORE_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+
+#ifdef NVWIN3X
+  #define FSEEKO _fseeki64
+  #define FTELLO _ftelli64
+#else
+  #define FSEEKO fseeko
+  #define FTELLO ftello
+#endif
+
+
+  /*  The segments for one cell.  They're stored exactly the way the old cell_XXX_YYY temporary files were, the
+      vertex count followed by count pairs of lon/lat, so that pass 2 didn't have to change.  If we go over the memory
+      budget the records are moved to the spill file and their location is saved in the extent list.  */
+
+  typedef struct
+  {
+    int32_t           *data;                  /*  Segment records in memory  */
+    int64_t           size;                   /*  Number of int32_t values in data  */
+    int64_t           alloc;                  /*  Number of int32_t values allocated  */
+    int64_t           *spill_offset;          /*  Spill file offsets of the extents for this cell  */
+    int64_t           *spill_size;            /*  Number of int32_t values in each extent  */
+    int32_t           spill_count;
+    int64_t           spill_alloc;            /*  Number of extents allocated  */
+    uint8_t           present;                /*  Set if a shape file was read for this cell (even if it had no segments)  */
+  } CELL;
+
+
+  typedef struct
+  {
+    CELL              *cell;                  /*  CELL_ROWS * CELL_COLS cells, row (latitude) major  */
+    int64_t           budget;                 /*  Memory budget in bytes (0 for no limit)  */
+    int64_t           in_memory;              /*  Bytes currently allocated for cell records  */
+    int64_t           spilled;                /*  Bytes written to the spill file  */
+    char              spill_name[512];
+    FILE              *spill_fp;
+    pthread_mutex_t   mutex;
+  } CELL_STORE;
+
+
+  void cell_store_init (CELL_STORE *store, int64_t budget, char *spill_name);
+  void cell_store_touch (CELL_STORE *store, int32_t x, int32_t y);
+  void cell_store_add_segment (CELL_STORE *store, int32_t x, int32_t y, int32_t count, int32_t *segx, int32_t *segy);
+  void cell_store_finish (CELL_STORE *store, int32_t x, int32_t y);
+  int64_t cell_store_get (CELL_STORE *store, int32_t x, int32_t y, int32_t **data);
+  void cell_store_release (CELL_STORE *store, int32_t x, int32_t y, int32_t *data);
+  void cell_store_close (CELL_STORE *store);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,565 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "build_swbd.h"
+
+
+static uint8_t          zeros[CCL_PAGE_SIZE];
+
+
+/*  Write zeros to pad address out to the next multiple of alignment.  */
+
+static void write_padding (FILE *fp, int64_t *address, int32_t alignment)
+{
+  int32_t           pad, size;
+
+
+  pad = (int32_t) ((alignment - *address % alignment) % alignment);
+  *address += pad;
+
+  for ( ; pad > 0 ; pad -= size)
+    {
+      size = MIN (pad, CCL_PAGE_SIZE);
+
+      if (fwrite (zeros, size, 1, fp) != 1)
+        {
+          perror ("Writing cell block");
+          exit (-1);
+        }
+    }
+}
+
+
+
+/*  Pack the address, number of segments, and number of vertices for a cell into a cell index.  */
+
+static void pack_entry (CELL_WRITER *writer, uint8_t *table, int32_t cell, int64_t address, int32_t num_segments,
+                        int32_t num_vertices)
+{
+  int32_t           pos;
+
+
+  pos = cell * CCL_ENTRY_SIZE (writer->format) * 8;
+
+  if (writer->format == CCL_FORMAT_2)
+    {
+      bit_pack (table, pos, 32, (int32_t) (address >> 32)); pos += 32;
+      bit_pack (table, pos, 32, (int32_t) (address & 0xffffffff)); pos += 32;
+    }
+  else
+    {
+      /*  The old format can't address anything past 2GB.  */
+
+      if (address > INT32_MAX)
+        {
+          fprintf (stderr, "\n\nThe output file is too big for the %s format, use -F 2, terminating!\n\n",
+                   FILE_VERSION);
+          exit (-1);
+        }
+
+      bit_pack (table, pos, 32, (int32_t) address); pos += 32;
+    }
+
+  bit_pack (table, pos, 32, num_segments); pos += 32;
+  bit_pack (table, pos, 32, num_vertices);
+}
+
+
+
+/*  The writer thread.  Waits for each block in turn, writes it, and records its header values.  */
+
+static void *cell_writer_thread (void *arg)
+{
+  CELL_WRITER       *writer = (CELL_WRITER *) arg;
+  CELL_BLOCK        *block, *extra;
+  METRICS_TIME      start, end;
+  int32_t           i, j, cell, percent, old_percent;
+
+
+  old_percent = -1;
+
+  for (i = 0 ; i < writer->num_cells ; i++)
+    {
+      pthread_mutex_lock (&writer->mutex);
+
+      while (!writer->ready[i]) pthread_cond_wait (&writer->cond, &writer->mutex);
+
+      pthread_mutex_unlock (&writer->mutex);
+
+      metrics_thread_clock (&start);
+
+
+      block = &writer->block[i % writer->window];
+      cell = writer->cell[i];
+
+
+      /*  Pad out to the next page if we're aligning cell blocks (empty cells don't need it).  */
+
+      if (block->size && writer->alignment > 1) write_padding (writer->ofp, &writer->address, writer->alignment);
+
+
+      pack_entry (writer, &writer->header[CCL_VERSION_SIZE], cell, writer->address, block->num_segments,
+                  block->num_vertices);
+
+      if (block->size && fwrite (block->buffer, block->size, 1, writer->ofp) != 1)
+        {
+          perror ("Writing cell block");
+          exit (-1);
+        }
+
+      writer->address += block->size;
+      writer->total += block->num_vertices;
+
+
+      /*  The simplified and segment index blocks go to their own stream files.  The levels start on a page boundary
+          in the output file so aligning the relative addresses keeps their blocks aligned.  The segment index entries
+          hold the size of the index block instead of the number of vertices.  */
+
+      for (j = 1 ; j <= writer->num_streams ; j++)
+        {
+          extra = (j <= writer->num_levels) ? &block->lod[j - 1] : block->index;
+
+          if (extra->size && writer->alignment > 1 && j <= writer->num_levels)
+            write_padding (writer->stream_fp[j], &writer->stream_address[j], writer->alignment);
+
+          pack_entry (writer, writer->stream_header[j], cell, writer->stream_address[j], extra->num_segments,
+                      (j <= writer->num_levels) ? extra->num_vertices : (int32_t) extra->size);
+
+          if (extra->size && fwrite (extra->buffer, extra->size, 1, writer->stream_fp[j]) != 1)
+            {
+              perror ("Writing level of detail or segment index block");
+              exit (-1);
+            }
+
+          writer->stream_address[j] += extra->size;
+        }
+
+
+      /*  We hang on to the block buffer, it will be reused window cells from now.  */
+
+      metrics_thread_clock (&end);
+      metrics_add (&writer->write, &start, &end);
+
+
+      /*  Let any encoders that were waiting for the window to move get going.  */
+
+      pthread_mutex_lock (&writer->mutex);
+
+      writer->written = i + 1;
+      pthread_cond_broadcast (&writer->cond);
+
+      pthread_mutex_unlock (&writer->mutex);
+
+
+      percent = (int32_t) (((float) (cell / CELL_COLS) / 181.0) * 100.0);
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "%03d%% packed\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+  return (NULL);
+}
+
+
+
+/*  Build the version string (the first CCL_VERSION_SIZE bytes of the file) for an output format.  */
+
+void cell_writer_version (int32_t format, int32_t alignment, int32_t stitch, char *version)
+{
+  if (format == CCL_FORMAT_2)
+    {
+      sprintf (version, "%s\n", FILE_VERSION_2);
+      if (alignment > 1) sprintf (&version[strlen (version)], "Cell blocks aligned to %d bytes\n", alignment);
+    }
+  else
+    {
+      sprintf (version, "%s\n", FILE_VERSION);
+
+
+      /*  There's no room left for this in a format 2 version string, it goes in the directory.  */
+
+      if (stitch >= 0) sprintf (&version[strlen (version)], "Segments stitched within %d\n", stitch);
+    }
+}
+
+
+
+/*  Check that an existing file has the layout we're about to write (format, alignment, stitching, segment coding,
+    columnar blocks, compression, levels of detail, and segment index) so that its cell blocks can be copied straight
+    into the new file.  */
+
+uint8_t cell_writer_matches (CCL_READER *reader, int32_t format, int32_t alignment, int32_t stitch, int32_t coding,
+                             uint8_t columnar, int32_t compression, int32_t num_levels, int32_t *tolerance,
+                             uint8_t index)
+{
+  char              version[CCL_VERSION_SIZE];
+  int32_t           i;
+
+
+  cell_writer_version (format, alignment, stitch, version);
+
+  if (strncmp (reader->version, version, strlen (version)) || reader->stitch != stitch ||
+      reader->coding != coding || reader->columnar != columnar || reader->compression != compression ||
+      reader->num_levels != num_levels ||
+      (reader->index_table != 0) != (index != 0)) return (NVFalse);
+
+  for (i = 1 ; i <= num_levels ; i++) if (reader->tolerance[i] != tolerance[i]) return (NVFalse);
+
+  return (NVTrue);
+}
+
+
+
+/*
+
+    Start the writer thread.  cell is the list of cells to be written in the order that they'll appear in the file.
+    format is CCL_FORMAT_1 or CCL_FORMAT_2 and, for format 2, alignment is the boundary that cell blocks start on (1
+    for none).  stitch is the gap that segments were stitched across (fixed point, -1 if they weren't), it's recorded
+    in the version string and passed on to the encoders.  coding is the Rice prediction order (1 or 2, format 2 only)
+    for Rice coded segments (0 for the fixed width offsets).  If columnar is set (format 2 only) the encoders write
+    columnar cell blocks.  compression is the zlib level (1 to 9, format 2 only) that
+    the encoders compress the cell blocks with (0 for none), it's recorded in the directory.  num_levels is the number
+    of simplified levels of detail (0 for none, format 2 only) and tolerance[1] through tolerance[num_levels] are their
+    tolerances (the caller fills in the blocks' lod arrays).  If index is set (format 2 only) we also write a segment
+    index (the caller fills in the blocks' index blocks).  The version string goes in the header buffer and the file
+    is positioned for the first block.  The caller writes the header (header_size bytes) at the start of the file when
+    we're done.
+
+*/
+
+void cell_writer_start (CELL_WRITER *writer, FILE *ofp, int32_t num_cells, int32_t *cell, int32_t window,
+                        int32_t format, int32_t alignment, int32_t stitch, int32_t coding, uint8_t columnar,
+                        int32_t compression, int32_t num_levels, int32_t *tolerance, uint8_t index)
+{
+  int32_t           i, j;
+
+
+  memset (writer, 0, sizeof (CELL_WRITER));
+
+  writer->ofp = ofp;
+  writer->num_cells = num_cells;
+  writer->cell = cell;
+  writer->window = window;
+  writer->format = format;
+  writer->alignment = (format == CCL_FORMAT_2 && alignment > 1) ? alignment : 1;
+  writer->stitch = stitch;
+  writer->coding = (format == CCL_FORMAT_2) ? coding : 0;
+  writer->columnar = (format == CCL_FORMAT_2) ? columnar : NVFalse;
+  writer->compression = (format == CCL_FORMAT_2) ? compression : 0;
+  writer->header_size = CCL_HEADER_SIZE (format);
+  writer->address = writer->header_size;
+
+  writer->block = (CELL_BLOCK *) calloc (window, sizeof (CELL_BLOCK));
+  writer->ready = (uint8_t *) calloc (num_cells + 1, sizeof (uint8_t));
+  writer->header = (uint8_t *) calloc (writer->header_size, sizeof (uint8_t));
+
+  if (writer->block == NULL || writer->ready == NULL || writer->header == NULL)
+    {
+      perror ("Allocating cell writer memory");
+      exit (-1);
+    }
+
+  cell_writer_version (format, writer->alignment, stitch, (char *) writer->header);
+
+
+  /*  Each ring block gets a block per level (and one for the segment index) and each stream gets a temporary file
+      and a cell index.  */
+
+  writer->num_levels = (format == CCL_FORMAT_2) ? num_levels : 0;
+  writer->index = (format == CCL_FORMAT_2) ? index : NVFalse;
+  writer->num_streams = writer->num_levels + (writer->index ? 1 : 0);
+
+  for (j = 1 ; j <= writer->num_levels ; j++) writer->tolerance[j] = tolerance[j];
+
+  for (j = 1 ; j <= writer->num_streams ; j++)
+    {
+      writer->stream_header[j] = (uint8_t *) calloc (CCL_ROWS * CCL_COLS, CCL_ENTRY_SIZE (format));
+
+      if (writer->stream_header[j] == NULL)
+        {
+          perror ("Allocating stream header memory");
+          exit (-1);
+        }
+
+      if ((writer->stream_fp[j] = tmpfile ()) == NULL)
+        {
+          perror ("Creating stream temporary file");
+          exit (-1);
+        }
+    }
+
+  for (i = 0 ; i < window ; i++)
+    {
+      if (writer->num_levels &&
+          (writer->block[i].lod = (CELL_BLOCK *) calloc (writer->num_levels, sizeof (CELL_BLOCK))) == NULL)
+        {
+          perror ("Allocating level of detail block memory");
+          exit (-1);
+        }
+
+      if (writer->index && (writer->block[i].index = (CELL_BLOCK *) calloc (1, sizeof (CELL_BLOCK))) == NULL)
+        {
+          perror ("Allocating segment index block memory");
+          exit (-1);
+        }
+    }
+
+  FSEEKO (ofp, writer->address, SEEK_SET);
+
+  pthread_mutex_init (&writer->mutex, NULL);
+  pthread_cond_init (&writer->cond, NULL);
+
+  if (pthread_create (&writer->thread, NULL, cell_writer_thread, writer))
+    {
+      perror ("Creating writer thread");
+      exit (-1);
+    }
+}
+
+
+
+/*  Get the block for output position index.  If the encoders have gotten too far ahead of the writer this waits for
+    the writer to catch up so that we don't end up holding the whole output file in memory.  */
+
+CELL_BLOCK *cell_writer_acquire (CELL_WRITER *writer, int32_t index)
+{
+  pthread_mutex_lock (&writer->mutex);
+
+  while (index - writer->written >= writer->window) pthread_cond_wait (&writer->cond, &writer->mutex);
+
+  pthread_mutex_unlock (&writer->mutex);
+
+  return (&writer->block[index % writer->window]);
+}
+
+
+
+/*  Hand an encoded block to the writer.  */
+
+void cell_writer_submit (CELL_WRITER *writer, int32_t index)
+{
+  pthread_mutex_lock (&writer->mutex);
+
+  writer->ready[index] = NVTrue;
+  pthread_cond_broadcast (&writer->cond);
+
+  pthread_mutex_unlock (&writer->mutex);
+}
+
+
+
+/*
+
+    Wait for the writer to finish writing all of the blocks.  If there are extra streams, copy each stream's blocks to
+    the end of the output file (levels start on an alignment boundary), turn its relative addresses into file
+    addresses, and write the directory.  The directory is the number of levels, a segment index flag, the level
+    tolerances, and then each stream's cell index.  The directory address goes in the version string.
+
+*/
+
+void cell_writer_finish (CELL_WRITER *writer)
+{
+  static uint8_t    buffer[1024 * 1024];
+  CCL_CELL          entry;
+  METRICS_TIME      start, end;
+  int32_t           i, j, pos;
+  int64_t           base, directory;
+  size_t            size;
+
+
+  pthread_join (writer->thread, NULL);
+
+  pthread_mutex_destroy (&writer->mutex);
+  pthread_cond_destroy (&writer->cond);
+
+  if (!writer->num_streams &&
+      (writer->format != CCL_FORMAT_2 ||
+       (writer->stitch < 0 && !writer->compression && !writer->coding && !writer->columnar))) return;
+
+  metrics_thread_clock (&start);
+
+
+  for (j = 1 ; j <= writer->num_streams ; j++)
+    {
+      if (writer->alignment > 1 && j <= writer->num_levels)
+        write_padding (writer->ofp, &writer->address, writer->alignment);
+
+      base = writer->address;
+
+      rewind (writer->stream_fp[j]);
+
+      while ((size = fread (buffer, 1, sizeof (buffer), writer->stream_fp[j])) > 0)
+        {
+          if (fwrite (buffer, size, 1, writer->ofp) != 1)
+            {
+              perror ("Writing stream blocks");
+              exit (-1);
+            }
+        }
+
+      if (ferror (writer->stream_fp[j]))
+        {
+          perror ("Reading stream temporary file");
+          exit (-1);
+        }
+
+      fclose (writer->stream_fp[j]);
+      writer->stream_fp[j] = NULL;
+
+
+      for (i = 0 ; i < writer->num_cells ; i++)
+        {
+          pos = writer->cell[i] * CCL_ENTRY_SIZE (writer->format) * 8;
+
+          entry.address = ((int64_t) bit_unpack (writer->stream_header[j], pos, 32) << 32) |
+            (uint32_t) bit_unpack (writer->stream_header[j], pos + 32, 32);
+          entry.num_segments = bit_unpack (writer->stream_header[j], pos + 64, 32);
+          entry.num_vertices = bit_unpack (writer->stream_header[j], pos + 96, 32);
+
+          pack_entry (writer, writer->stream_header[j], writer->cell[i], base + entry.address, entry.num_segments,
+                      entry.num_vertices);
+        }
+
+      writer->address = base + writer->stream_address[j];
+    }
+
+
+  /*  The directory.  */
+
+  directory = writer->address;
+
+  bit_pack (buffer, 0, 32, writer->num_levels);
+  bit_pack (buffer, 32, 32, (writer->index ? 1 : 0) | (writer->stitch >= 0 ? 2 : 0) | (writer->compression ? 4 : 0) |
+            (writer->coding ? 8 : 0) | (writer->columnar ? 16 : 0));
+
+  for (j = 1 ; j <= writer->num_levels ; j++) bit_pack (buffer, (j + 1) * 32, 32, writer->tolerance[j]);
+
+  size = 8 + writer->num_levels * 4;
+
+  if (writer->stitch >= 0)
+    {
+      bit_pack (buffer, size * 8, 32, writer->stitch);
+      size += 4;
+    }
+
+  if (writer->compression)
+    {
+      bit_pack (buffer, size * 8, 32, writer->compression);
+      size += 4;
+    }
+
+  if (writer->coding)
+    {
+      bit_pack (buffer, size * 8, 32, writer->coding);
+      size += 4;
+    }
+
+  if (fwrite (buffer, size, 1, writer->ofp) != 1)
+    {
+      perror ("Writing directory");
+      exit (-1);
+    }
+
+  for (j = 1 ; j <= writer->num_streams ; j++)
+    {
+      if (fwrite (writer->stream_header[j], CCL_ROWS * CCL_COLS * CCL_ENTRY_SIZE (writer->format), 1, writer->ofp) != 1)
+        {
+          perror ("Writing directory");
+          exit (-1);
+        }
+    }
+
+  writer->address = directory + size + writer->num_streams * (int64_t) CCL_ROWS * CCL_COLS *
+    CCL_ENTRY_SIZE (writer->format);
+
+  sprintf ((char *) &writer->header[strlen ((char *) writer->header)], "Directory at %"PRId64"\n", directory);
+
+  metrics_thread_clock (&end);
+  metrics_add (&writer->write, &start, &end);
+}
+
+
+
+void cell_writer_free (CELL_WRITER *writer)
+{
+  int32_t           i, j;
+
+
+  for (i = 0 ; i < writer->window ; i++)
+    {
+      if (writer->block[i].buffer != NULL)
+        {
+          free (writer->block[i].buffer);
+          arena_count (0, 1, 0);
+        }
+
+      for (j = 0 ; j < writer->num_levels ; j++)
+        {
+          if (writer->block[i].lod[j].buffer != NULL)
+            {
+              free (writer->block[i].lod[j].buffer);
+              arena_count (0, 1, 0);
+            }
+        }
+
+      if (writer->block[i].lod != NULL) free (writer->block[i].lod);
+
+      if (writer->block[i].index != NULL)
+        {
+          if (writer->block[i].index->buffer != NULL)
+            {
+              free (writer->block[i].index->buffer);
+              arena_count (0, 1, 0);
+            }
+
+          free (writer->block[i].index);
+        }
+    }
+
+  for (j = 1 ; j <= writer->num_streams ; j++)
+    {
+      if (writer->stream_fp[j] != NULL) fclose (writer->stream_fp[j]);
+      free (writer->stream_header[j]);
+    }
+
+  free (writer->block);
+  free (writer->ready);
+  free (writer->header);
+}
@@ -0,0 +1,127 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __CELL_WRITER_H__
+#define __CELL_WRITER_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ccl_reader.h"
+#include "metrics.h"
+
+
+  /*  One encoded cell.  If the file has levels of detail, lod points to the cell's simplified blocks (lod[0] is
+      level 1).  If it has a segment index, index is the cell's index block (num_vertices isn't used).  */
+
+  typedef struct CELL_BLOCK
+  {
+    uint8_t           *buffer;
+    int64_t           size;                   /*  Bytes used in buffer  */
+    int64_t           alloc;                  /*  Bytes allocated  */
+    int32_t           num_segments;
+    int32_t           num_vertices;
+    struct CELL_BLOCK *lod;
+    struct CELL_BLOCK *index;
+  } CELL_BLOCK;
+
+
+  /*  The ordered output stage.  The encoders fill in the blocks (in any order) and the writer thread streams them to
+      the output file in cell order.  The address of each block is the running sum of the sizes of the blocks before it
+      so we never have to ask the file where we are.  The version string and header are built in memory as we go so
+      that they can be written in one piece at the end.  The simplified levels of detail and the segment index blocks
+      are extra streams.  Each one goes to a temporary file with addresses relative to the start of the stream (stream
+      1 to num_levels are the levels, the segment index is last).  cell_writer_finish appends them to the output
+      file, after the full resolution blocks, followed by the directory.  */
+
+  typedef struct
+  {
+    FILE              *ofp;
+    int32_t           num_cells;              /*  Number of cells to be written  */
+    int32_t           *cell;                  /*  Cell index (row * CELL_COLS + column) of each, in output order  */
+    CELL_BLOCK        *block;                 /*  Ring of window blocks, cell i uses block[i % window]  */
+    uint8_t           *ready;                 /*  Set when the block for cell i has been encoded  */
+    int32_t           written;                /*  Number of blocks written so far  */
+    int32_t           window;                 /*  Max number of blocks encoded ahead of the writer  */
+    int64_t           address;                /*  Current end of file  */
+    int64_t           total;                  /*  Total points written  */
+    int32_t           format;                 /*  CCL_FORMAT_1 or CCL_FORMAT_2  */
+    int32_t           alignment;              /*  Cell blocks start on multiples of this (1 for no alignment)  */
+    int32_t           stitch;                 /*  Stitching gap (fixed point, -1 for no stitching)  */
+    int32_t           compression;            /*  zlib level for the cell blocks (0 for no compression)  */
+    int32_t           coding;                 /*  Rice prediction order (0 for fixed width offsets)  */
+    uint8_t           columnar;               /*  Set if the cell blocks are columnar  */
+    int64_t           header_size;
+    uint8_t           *header;                /*  Version string and cell header (header_size bytes)  */
+    int32_t           num_levels;             /*  Number of simplified levels of detail  */
+    int32_t           tolerance[CCL_MAX_LEVELS + 1];  /*  Tolerance of each level (fixed point, level 1 up)  */
+    uint8_t           index;                  /*  Set if we're writing a segment index  */
+    int32_t           num_streams;            /*  num_levels plus one for the segment index  */
+    FILE              *stream_fp[CCL_MAX_LEVELS + 2];  /*  Temporary block file for each stream  */
+    int64_t           stream_address[CCL_MAX_LEVELS + 2];  /*  Current end of each stream's blocks  */
+    uint8_t           *stream_header[CCL_MAX_LEVELS + 2];  /*  Cell index for each stream (relative addresses)  */
+    METRICS_TIME      write;                  /*  Time spent writing (not waiting for blocks)  */
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+    pthread_t         thread;
+  } CELL_WRITER;
+
+
+  void cell_writer_version (int32_t format, int32_t alignment, int32_t stitch, char *version);
+  uint8_t cell_writer_matches (CCL_READER *reader, int32_t format, int32_t alignment, int32_t stitch, int32_t coding,
+                               uint8_t columnar, int32_t compression, int32_t num_levels, int32_t *tolerance,
+                               uint8_t index);
+  void cell_writer_start (CELL_WRITER *writer, FILE *ofp, int32_t num_cells, int32_t *cell, int32_t window,
+                          int32_t format, int32_t alignment, int32_t stitch, int32_t coding, uint8_t columnar,
+                          int32_t compression, int32_t num_levels, int32_t *tolerance, uint8_t index);
+  CELL_BLOCK *cell_writer_acquire (CELL_WRITER *writer, int32_t index);
+  void cell_writer_submit (CELL_WRITER *writer, int32_t index);
+  void cell_writer_finish (CELL_WRITER *writer);
+  void cell_writer_free (CELL_WRITER *writer);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,549 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined (__x86_64__) || defined (__i386__)
+  #define CONVERT_X86
+  #include <immintrin.h>
+#endif
+
+#include "nvutility.h"
+
+#include "convert.h"
+
+
+/*
+
+    Vertex conversion.  This is the per vertex arithmetic from the old pass 1 loop pulled out so that it can be done
+    for a whole shape at a time, either one point at a time (the reference scalar version) or 2 (SSE4.1) or 4 (AVX2)
+    points at a time.  The vector versions do exactly the same IEEE double operations in exactly the same order as the
+    scalar version so the results are bit for bit identical.  Note that the vector versions are only compiled for AVX2
+    or SSE4.1, NOT FMA, so the compiler can't fuse the multiplies and adds (that would change the rounding).
+
+*/
+
+
+/*  The boundary tolerances from the original code.  */
+
+#define LON_TOLERANCE        1.00000000000000015
+#define LAT_TOLERANCE        1.0
+
+
+static CONVERT_FUNC     convert_func = NULL;
+
+
+
+/*  Unaligned load.  */
+
+static inline double load_double (const uint8_t *ptr)
+{
+  double            value;
+
+  memcpy (&value, ptr, sizeof (double));
+
+  return (value);
+}
+
+
+
+/*  Reference version.  */
+
+static void convert_scalar (const uint8_t *px, const uint8_t *py, int32_t stride, int32_t n, const double *cornerx,
+                            const double *cornery, int32_t *ix, int32_t *iy, uint8_t *bad)
+{
+  int32_t           j;
+  double            x, y, lon, lat, slon, slat;
+
+
+  for (j = 0 ; j < n ; j++)
+    {
+      x = load_double (&px[(int64_t) j * stride]);
+      y = load_double (&py[(int64_t) j * stride]);
+
+
+      /*  Bias lat and lon by 90 and 180 so that all points are positive  */
+
+      lon = x + 180.0;
+      lat = y + 90.0;
+
+
+      /*  Position in seconds to be compared with the cell boundaries.  */
+
+      slon = lon * 3600.0;
+      slat = lat * 3600.0;
+
+      bad[j] = (fabs (slon - cornerx[0]) < LON_TOLERANCE || fabs (slon - cornerx[1]) < LON_TOLERANCE ||
+                fabs (slat - cornery[0]) < LAT_TOLERANCE || fabs (slat - cornery[1]) < LAT_TOLERANCE);
+
+
+      /*  Damn boundary conditions!  */
+
+      if (lon == 360.0) lon = 359.99999;
+
+      ix[j] = NINT (lon * 100000.0);
+      iy[j] = NINT (lat * 100000.0);
+    }
+}
+
+
+
+#ifdef CONVERT_X86
+
+/*  Two points at a time.  */
+
+__attribute__ ((target ("sse4.1")))
+static void convert_sse4 (const uint8_t *px, const uint8_t *py, int32_t stride, int32_t n, const double *cornerx,
+                          const double *cornery, int32_t *ix, int32_t *iy, uint8_t *bad)
+{
+  int32_t           j, mask;
+  __m128d           x, y, a, b, lon, lat, slon, slat, sign, half, mhalf, zero, c180, c90, c3600, c1e5, c360, cfix;
+  __m128d           lon_tol, lat_tol, cx0, cx1, cy0, cy1, bmask, v;
+  __m128i           ilon, ilat;
+  uint8_t           interleaved;
+
+
+  sign = _mm_set1_pd (-0.0);
+  half = _mm_set1_pd (0.5);
+  mhalf = _mm_set1_pd (-0.5);
+  zero = _mm_setzero_pd ();
+  c180 = _mm_set1_pd (180.0);
+  c90 = _mm_set1_pd (90.0);
+  c3600 = _mm_set1_pd (3600.0);
+  c1e5 = _mm_set1_pd (100000.0);
+  c360 = _mm_set1_pd (360.0);
+  cfix = _mm_set1_pd (359.99999);
+  lon_tol = _mm_set1_pd (LON_TOLERANCE);
+  lat_tol = _mm_set1_pd (LAT_TOLERANCE);
+  cx0 = _mm_set1_pd (cornerx[0]);
+  cx1 = _mm_set1_pd (cornerx[1]);
+  cy0 = _mm_set1_pd (cornery[0]);
+  cy1 = _mm_set1_pd (cornery[1]);
+
+  interleaved = (stride == 2 * sizeof (double) && py == px + sizeof (double));
+
+
+  for (j = 0 ; j + 2 <= n ; j += 2)
+    {
+      if (interleaved)
+        {
+          a = _mm_loadu_pd ((const double *) &px[(int64_t) j * stride]);
+          b = _mm_loadu_pd ((const double *) &px[(int64_t) (j + 1) * stride]);
+          x = _mm_unpacklo_pd (a, b);
+          y = _mm_unpackhi_pd (a, b);
+        }
+      else if (stride == sizeof (double))
+        {
+          x = _mm_loadu_pd ((const double *) &px[(int64_t) j * stride]);
+          y = _mm_loadu_pd ((const double *) &py[(int64_t) j * stride]);
+        }
+      else
+        {
+          x = _mm_set_pd (load_double (&px[(int64_t) (j + 1) * stride]), load_double (&px[(int64_t) j * stride]));
+          y = _mm_set_pd (load_double (&py[(int64_t) (j + 1) * stride]), load_double (&py[(int64_t) j * stride]));
+        }
+
+      lon = _mm_add_pd (x, c180);
+      lat = _mm_add_pd (y, c90);
+
+      slon = _mm_mul_pd (lon, c3600);
+      slat = _mm_mul_pd (lat, c3600);
+
+      bmask = _mm_cmplt_pd (_mm_andnot_pd (sign, _mm_sub_pd (slon, cx0)), lon_tol);
+      bmask = _mm_or_pd (bmask, _mm_cmplt_pd (_mm_andnot_pd (sign, _mm_sub_pd (slon, cx1)), lon_tol));
+      bmask = _mm_or_pd (bmask, _mm_cmplt_pd (_mm_andnot_pd (sign, _mm_sub_pd (slat, cy0)), lat_tol));
+      bmask = _mm_or_pd (bmask, _mm_cmplt_pd (_mm_andnot_pd (sign, _mm_sub_pd (slat, cy1)), lat_tol));
+
+      mask = _mm_movemask_pd (bmask);
+      bad[j] = mask & 1;
+      bad[j + 1] = (mask >> 1) & 1;
+
+      lon = _mm_blendv_pd (lon, cfix, _mm_cmpeq_pd (lon, c360));
+
+
+      /*  NINT  */
+
+      v = _mm_mul_pd (lon, c1e5);
+      v = _mm_add_pd (v, _mm_blendv_pd (half, mhalf, _mm_cmplt_pd (v, zero)));
+      ilon = _mm_cvttpd_epi32 (v);
+
+      v = _mm_mul_pd (lat, c1e5);
+      v = _mm_add_pd (v, _mm_blendv_pd (half, mhalf, _mm_cmplt_pd (v, zero)));
+      ilat = _mm_cvttpd_epi32 (v);
+
+      _mm_storel_epi64 ((__m128i *) &ix[j], ilon);
+      _mm_storel_epi64 ((__m128i *) &iy[j], ilat);
+    }
+
+
+  /*  Leftovers.  */
+
+  if (j < n) convert_scalar (&px[(int64_t) j * stride], &py[(int64_t) j * stride], stride, n - j, cornerx, cornery,
+                             &ix[j], &iy[j], &bad[j]);
+}
+
+
+
+/*  Four points at a time.  */
+
+__attribute__ ((target ("avx2")))
+static void convert_avx2 (const uint8_t *px, const uint8_t *py, int32_t stride, int32_t n, const double *cornerx,
+                          const double *cornery, int32_t *ix, int32_t *iy, uint8_t *bad)
+{
+  int32_t           j, mask;
+  __m256d           x, y, a, b, lon, lat, slon, slat, sign, half, mhalf, zero, c180, c90, c3600, c1e5, c360, cfix;
+  __m256d           lon_tol, lat_tol, cx0, cx1, cy0, cy1, bmask, v;
+  __m128i           ilon, ilat;
+  uint8_t           interleaved;
+
+
+  sign = _mm256_set1_pd (-0.0);
+  half = _mm256_set1_pd (0.5);
+  mhalf = _mm256_set1_pd (-0.5);
+  zero = _mm256_setzero_pd ();
+  c180 = _mm256_set1_pd (180.0);
+  c90 = _mm256_set1_pd (90.0);
+  c3600 = _mm256_set1_pd (3600.0);
+  c1e5 = _mm256_set1_pd (100000.0);
+  c360 = _mm256_set1_pd (360.0);
+  cfix = _mm256_set1_pd (359.99999);
+  lon_tol = _mm256_set1_pd (LON_TOLERANCE);
+  lat_tol = _mm256_set1_pd (LAT_TOLERANCE);
+  cx0 = _mm256_set1_pd (cornerx[0]);
+  cx1 = _mm256_set1_pd (cornerx[1]);
+  cy0 = _mm256_set1_pd (cornery[0]);
+  cy1 = _mm256_set1_pd (cornery[1]);
+
+  interleaved = (stride == 2 * sizeof (double) && py == px + sizeof (double));
+
+
+  for (j = 0 ; j + 4 <= n ; j += 4)
+    {
+      if (interleaved)
+        {
+          /*  x0 y0 x1 y1 and x2 y2 x3 y3 -> x0 x2 x1 x3 and y0 y2 y1 y3 -> x0 x1 x2 x3 and y0 y1 y2 y3  */
+
+          a = _mm256_loadu_pd ((const double *) &px[(int64_t) j * stride]);
+          b = _mm256_loadu_pd ((const double *) &px[(int64_t) (j + 2) * stride]);
+          x = _mm256_permute4x64_pd (_mm256_unpacklo_pd (a, b), 0xd8);
+          y = _mm256_permute4x64_pd (_mm256_unpackhi_pd (a, b), 0xd8);
+        }
+      else if (stride == sizeof (double))
+        {
+          x = _mm256_loadu_pd ((const double *) &px[(int64_t) j * stride]);
+          y = _mm256_loadu_pd ((const double *) &py[(int64_t) j * stride]);
+        }
+      else
+        {
+          x = _mm256_set_pd (load_double (&px[(int64_t) (j + 3) * stride]), load_double (&px[(int64_t) (j + 2) * stride]),
+                             load_double (&px[(int64_t) (j + 1) * stride]), load_double (&px[(int64_t) j * stride]));
+          y = _mm256_set_pd (load_double (&py[(int64_t) (j + 3) * stride]), load_double (&py[(int64_t) (j + 2) * stride]),
+                             load_double (&py[(int64_t) (j + 1) * stride]), load_double (&py[(int64_t) j * stride]));
+        }
+
+      lon = _mm256_add_pd (x, c180);
+      lat = _mm256_add_pd (y, c90);
+
+      slon = _mm256_mul_pd (lon, c3600);
+      slat = _mm256_mul_pd (lat, c3600);
+
+      bmask = _mm256_cmp_pd (_mm256_andnot_pd (sign, _mm256_sub_pd (slon, cx0)), lon_tol, _CMP_LT_OQ);
+      bmask = _mm256_or_pd (bmask, _mm256_cmp_pd (_mm256_andnot_pd (sign, _mm256_sub_pd (slon, cx1)), lon_tol, _CMP_LT_OQ));
+      bmask = _mm256_or_pd (bmask, _mm256_cmp_pd (_mm256_andnot_pd (sign, _mm256_sub_pd (slat, cy0)), lat_tol, _CMP_LT_OQ));
+      bmask = _mm256_or_pd (bmask, _mm256_cmp_pd (_mm256_andnot_pd (sign, _mm256_sub_pd (slat, cy1)), lat_tol, _CMP_LT_OQ));
+
+      mask = _mm256_movemask_pd (bmask);
+      bad[j] = mask & 1;
+      bad[j + 1] = (mask >> 1) & 1;
+      bad[j + 2] = (mask >> 2) & 1;
+      bad[j + 3] = (mask >> 3) & 1;
+
+      lon = _mm256_blendv_pd (lon, cfix, _mm256_cmp_pd (lon, c360, _CMP_EQ_OQ));
+
+
+      /*  NINT  */
+
+      v = _mm256_mul_pd (lon, c1e5);
+      v = _mm256_add_pd (v, _mm256_blendv_pd (half, mhalf, _mm256_cmp_pd (v, zero, _CMP_LT_OQ)));
+      ilon = _mm256_cvttpd_epi32 (v);
+
+      v = _mm256_mul_pd (lat, c1e5);
+      v = _mm256_add_pd (v, _mm256_blendv_pd (half, mhalf, _mm256_cmp_pd (v, zero, _CMP_LT_OQ)));
+      ilat = _mm256_cvttpd_epi32 (v);
+
+      _mm_storeu_si128 ((__m128i *) &ix[j], ilon);
+      _mm_storeu_si128 ((__m128i *) &iy[j], ilat);
+    }
+
+
+  /*  Leftovers.  */
+
+  if (j < n) convert_scalar (&px[(int64_t) j * stride], &py[(int64_t) j * stride], stride, n - j, cornerx, cornery,
+                             &ix[j], &iy[j], &bad[j]);
+}
+
+#endif
+
+
+
+/*  Returns NVTrue if the kernel can be run on this processor.  */
+
+static uint8_t convert_available (int32_t kernel)
+{
+  switch (kernel)
+    {
+    case KERNEL_SCALAR:
+      return (NVTrue);
+
+#ifdef CONVERT_X86
+    case KERNEL_SSE4:
+      __builtin_cpu_init ();
+      return (__builtin_cpu_supports ("sse4.1") != 0);
+
+    case KERNEL_AVX2:
+      __builtin_cpu_init ();
+      return (__builtin_cpu_supports ("avx2") != 0);
+#endif
+    }
+
+  return (NVFalse);
+}
+
+
+
+static CONVERT_FUNC convert_function (int32_t kernel)
+{
+  switch (kernel)
+    {
+#ifdef CONVERT_X86
+    case KERNEL_SSE4:
+      return (convert_sse4);
+
+    case KERNEL_AVX2:
+      return (convert_avx2);
+#endif
+    }
+
+  return (convert_scalar);
+}
+
+
+
+const char *convert_name (int32_t kernel)
+{
+  switch (kernel)
+    {
+    case KERNEL_SSE4:
+      return ("sse4");
+
+    case KERNEL_AVX2:
+      return ("avx2");
+    }
+
+  return ("scalar");
+}
+
+
+
+/*  Pick the conversion kernel.  KERNEL_AUTO picks the best one the processor supports.  Returns the kernel that will
+    be used or -1 if the requested kernel isn't supported here.  */
+
+int32_t convert_select (int32_t kernel)
+{
+  if (kernel == KERNEL_AUTO)
+    {
+      kernel = KERNEL_SCALAR;
+      if (convert_available (KERNEL_SSE4)) kernel = KERNEL_SSE4;
+      if (convert_available (KERNEL_AVX2)) kernel = KERNEL_AVX2;
+    }
+
+  if (!convert_available (kernel)) return (-1);
+
+  convert_func = convert_function (kernel);
+
+  return (kernel);
+}
+
+
+
+void convert_points (const uint8_t *px, const uint8_t *py, int32_t stride, int32_t n, const double *cornerx,
+                     const double *cornery, int32_t *ix, int32_t *iy, uint8_t *bad)
+{
+  if (convert_func == NULL) convert_select (KERNEL_AUTO);
+
+  (*convert_func) (px, py, stride, n, cornerx, cornery, ix, iy, bad);
+}
+
+
+
+/*
+
+    Check every available vector kernel against the scalar kernel.  The points are a mix of random positions, points
+    exactly on and within a hair of the cell boundaries, 180 degree longitude, and negative fixed point values so that
+    both sides of NINT get exercised.  Each set is run planar (separate X and Y arrays, like shapelib) and interleaved
+    (X/Y pairs, like the mapped reader), at odd lengths so that the scalar tail is used too.  Returns the number of
+    mismatches (0 is good).
+
+*/
+
+int32_t convert_self_test ()
+{
+  int32_t           i, j, k, n, kernel, errors, stride, *ix[2], *iy[2];
+  uint8_t           *bad[2], *px, *py;
+  double            *planar, *xy, cornerx[2], cornery[2], x0, y0, delta[7] = {0.0, 1.0e-12, -1.0e-12, 1.0 / 3600.0,
+                                                                                -1.0 / 3600.0, 0.5 / 3600.0, -0.5 / 3600.0};
+
+
+  n = 100003;
+  errors = 0;
+
+  planar = (double *) malloc (2 * n * sizeof (double));
+  xy = (double *) malloc (2 * n * sizeof (double));
+  for (k = 0 ; k < 2 ; k++)
+    {
+      ix[k] = (int32_t *) malloc (n * sizeof (int32_t));
+      iy[k] = (int32_t *) malloc (n * sizeof (int32_t));
+      bad[k] = (uint8_t *) malloc (n * sizeof (uint8_t));
+    }
+
+  if (planar == NULL || xy == NULL || ix[1] == NULL || iy[1] == NULL || bad[1] == NULL)
+    {
+      perror ("Allocating self test memory");
+      exit (-1);
+    }
+
+  srand (12345);
+
+  for (i = -1 ; i < 5 ; i++)
+    {
+      /*  A few different cells, including both ends of the world.  */
+
+      x0 = (i < 0) ? 179.0 : (double) (rand () % 360 - 180);
+      y0 = (i < 0) ? -90.0 : (double) (rand () % 180 - 90);
+
+      cornerx[0] = (x0 + 180.0) * 3600.0;
+      cornerx[1] = (x0 + 181.0) * 3600.0;
+      cornery[0] = (y0 + 90.0) * 3600.0;
+      cornery[1] = (y0 + 91.0) * 3600.0;
+
+      for (j = 0 ; j < n ; j++)
+        {
+          switch (j % 4)
+            {
+            case 0:
+              planar[j] = x0 + (double) rand () / RAND_MAX;
+              planar[n + j] = y0 + (double) rand () / RAND_MAX;
+              break;
+
+            case 1:
+              planar[j] = x0 + (rand () % 2) + delta[rand () % 7];
+              planar[n + j] = y0 + (double) rand () / RAND_MAX;
+              break;
+
+            case 2:
+              planar[j] = x0 + (double) rand () / RAND_MAX;
+              planar[n + j] = y0 + (rand () % 2) + delta[rand () % 7];
+              break;
+
+            case 3:
+              planar[j] = (rand () % 2) ? 180.0 : -180.0 - (double) rand () / RAND_MAX * 1.0e-4;
+              planar[n + j] = (rand () % 2) ? -90.0 - (double) rand () / RAND_MAX * 1.0e-4 : 90.0;
+              break;
+            }
+
+          xy[2 * j] = planar[j];
+          xy[2 * j + 1] = planar[n + j];
+        }
+
+
+      for (stride = 0 ; stride < 2 ; stride++)
+        {
+          if (stride)
+            {
+              px = (uint8_t *) xy;
+              py = (uint8_t *) &xy[1];
+            }
+          else
+            {
+              px = (uint8_t *) planar;
+              py = (uint8_t *) &planar[n];
+            }
+
+          convert_scalar (px, py, (stride + 1) * sizeof (double), n, cornerx, cornery, ix[0], iy[0], bad[0]);
+
+          for (kernel = KERNEL_SSE4 ; kernel <= KERNEL_AVX2 ; kernel++)
+            {
+              if (!convert_available (kernel)) continue;
+
+              (*convert_function (kernel)) (px, py, (stride + 1) * sizeof (double), n, cornerx, cornery, ix[1], iy[1], bad[1]);
+
+              for (j = 0 ; j < n ; j++)
+                {
+                  if (bad[0][j] != bad[1][j] || (!bad[0][j] && (ix[0][j] != ix[1][j] || iy[0][j] != iy[1][j])))
+                    {
+                      if (errors < 10) fprintf (stderr, "%s mismatch at point %d (%.17g %.17g): %d %d %d, %d %d %d\n",
+                                                convert_name (kernel), j, planar[j], planar[n + j], ix[0][j], iy[0][j],
+                                                bad[0][j], ix[1][j], iy[1][j], bad[1][j]);
+                      errors++;
+                    }
+                }
+            }
+        }
+    }
+
+
+  for (k = 0 ; k < 2 ; k++)
+    {
+      free (ix[k]);
+      free (iy[k]);
+      free (bad[k]);
+    }
+
+  free (planar);
+  free (xy);
+
+
+  for (kernel = KERNEL_SCALAR ; kernel <= KERNEL_AVX2 ; kernel++)
+    fprintf (stderr, "%-8s %s\n", convert_name (kernel), convert_available (kernel) ? "checked" : "not available");
+
+  fprintf (stderr, "%d mismatches\n", errors);
+
+  return (errors);
+}
@@ -0,0 +1,409 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <ctype.h>
+#include <dirent.h>
+
+#include "build_swbd.h"
+
+
+/*
+
+    Input discovery.  Instead of trying to fopen six possible names for each of the 64,800 cells (most of which
+    don't exist) we read the input directory once and parse the SWBD tile names.  The names look like this:
+
+        e012n45i.shp
+
+    where the first character is the longitude hemisphere (e or w), followed by the three digit longitude of the
+    southwest corner, the latitude hemisphere (n or s), the two digit latitude, and a single character that identifies
+    the source data set (a, e, f, i, n, or s).  If there is more than one tile for a cell we use the one whose data set
+    comes first in that list (that's the order in which the old code probed for them).
+
+*/
+
+
+static char dataset[6] = {'a', 'e', 'f', 'i', 'n', 's'};
+
+
+
+/*  Parse an SWBD tile name.  Returns NVTrue and sets the cell column, row, and data set rank if it's a valid name.  */
+
+static uint8_t parse_tile_name (char *name, int32_t *x, int32_t *y, int32_t *rank)
+{
+  char              lonhem, lathem, ds;
+  int32_t           ln, lt, i;
+
+
+  if (strlen (name) != 12) return (NVFalse);
+
+  if (!isdigit ((uint8_t) name[1]) || !isdigit ((uint8_t) name[2]) || !isdigit ((uint8_t) name[3]) ||
+      !isdigit ((uint8_t) name[5]) || !isdigit ((uint8_t) name[6])) return (NVFalse);
+
+  lonhem = tolower (name[0]);
+  lathem = tolower (name[4]);
+  ds = tolower (name[7]);
+
+  if (strcmp (&name[8], ".shp") && strcmp (&name[8], ".SHP")) return (NVFalse);
+
+  ln = (name[1] - '0') * 100 + (name[2] - '0') * 10 + (name[3] - '0');
+  lt = (name[5] - '0') * 10 + (name[6] - '0');
+
+
+  /*  Same ranges that the hemisphere loops used to cover.  */
+
+  if (lonhem == 'e')
+    {
+      if (ln > 179) return (NVFalse);
+      *x = ln + 180;
+    }
+  else if (lonhem == 'w')
+    {
+      if (ln < 1 || ln > 180) return (NVFalse);
+      *x = -ln + 180;
+    }
+  else
+    {
+      return (NVFalse);
+    }
+
+  if (lathem == 'n')
+    {
+      if (lt > 89) return (NVFalse);
+      *y = lt + 90;
+    }
+  else if (lathem == 's')
+    {
+      if (lt < 1 || lt > 90) return (NVFalse);
+      *y = -lt + 90;
+    }
+  else
+    {
+      return (NVFalse);
+    }
+
+  for (i = 0 ; i < 6 ; i++)
+    {
+      if (ds == dataset[i])
+        {
+          *rank = i;
+          return (NVTrue);
+        }
+    }
+
+  return (NVFalse);
+}
+
+
+
+/*  The tiles found so far.  For each cell we keep the name (relative to the input directory) and, if it's in a zip
+    archive, where to find it.  */
+
+typedef struct
+{
+  int8_t            *best;                    /*  Data set rank of the tile we're using for each cell (-1 for none)  */
+  char              **name;
+  ZIP_SOURCE        **zip;
+  int32_t           num_tiles;
+  int32_t           duplicates;
+} DISCOVERY;
+
+
+
+/*  Add a tile unless there's already a better one for the cell.  Lower data set ranks win.  For the same rank a plain
+    shape file beats one in an archive, then the first name in sort order wins so that the choice doesn't depend on
+    the order of the directory.  zip is NULL for a plain shape file.  */
+
+static void add_tile (DISCOVERY *found, int32_t x, int32_t y, int32_t rank, char *name, ZIP_SOURCE *zip)
+{
+  int32_t           i;
+  uint8_t           better;
+
+
+  i = y * CELL_COLS + x;
+
+  found->num_tiles++;
+
+  if (found->best[i] >= 0)
+    {
+      found->duplicates++;
+
+      if (rank != found->best[i])
+        {
+          better = (rank < found->best[i]);
+        }
+      else if ((zip == NULL) != (found->zip[i] == NULL))
+        {
+          better = (zip == NULL);
+        }
+      else
+        {
+          better = (strcmp (name, found->name[i]) < 0);
+        }
+
+      if (!better)
+        {
+          fprintf (stderr, "Duplicate tile %s ignored, using %s\n", name, found->name[i]);
+          return;
+        }
+
+      fprintf (stderr, "Duplicate tile %s ignored, using %s\n", found->name[i], name);
+      free (found->name[i]);
+      free (found->zip[i]);
+      found->zip[i] = NULL;
+    }
+
+  found->best[i] = rank;
+  found->name[i] = strdup (name);
+
+  if (zip != NULL)
+    {
+      if ((found->zip[i] = (ZIP_SOURCE *) malloc (sizeof (ZIP_SOURCE))) == NULL)
+        {
+          perror ("Allocating discovery memory");
+          exit (-1);
+        }
+
+      *found->zip[i] = *zip;
+    }
+}
+
+
+
+/*  Add the tiles in a zip archive.  Each .shp member (in any folder in the archive) with an SWBD tile name and a
+    matching .shx member is a tile.  */
+
+static void add_archive (DISCOVERY *found, char *dirname, char *zipname)
+{
+  ZIP_ENTRY         *entry;
+  ZIP_SOURCE        zip;
+  int32_t           i, j, x, y, rank, num_entries, len;
+  char              *base, shxname[256], name[1024];
+
+
+  snprintf (zip.zipname, sizeof (zip.zipname), "%s/%s", dirname, zipname);
+
+  if (zip_list (zip.zipname, &entry, &num_entries))
+    {
+      fprintf (stderr, "Unable to read zip archive %s : %s\n", zip.zipname, strerror (errno));
+      return;
+    }
+
+  for (i = 0 ; i < num_entries ; i++)
+    {
+      base = strrchr (entry[i].name, '/');
+      base = (base == NULL) ? entry[i].name : base + 1;
+
+      if (!parse_tile_name (base, &x, &y, &rank)) continue;
+
+
+      /*  Same name with a .shx (or .SHX) extension.  */
+
+      strcpy (shxname, entry[i].name);
+      len = strlen (shxname);
+      strcpy (&shxname[len - 3], (shxname[len - 3] == 'S') ? "SHX" : "shx");
+
+      for (j = 0 ; j < num_entries ; j++) if (!strcmp (entry[j].name, shxname)) break;
+
+      if (j == num_entries)
+        {
+          fprintf (stderr, "No index for %s in %s, skipped\n", entry[i].name, zip.zipname);
+          continue;
+        }
+
+      zip.shp = entry[i].member;
+      zip.shx = entry[j].member;
+
+      snprintf (name, sizeof (name), "%s:%s", zipname, entry[i].name);
+
+      add_tile (found, x, y, rank, name, &zip);
+    }
+
+  free (entry);
+}
+
+
+
+/*
+
+    Read the input directory and fill in the task list (one entry per cell that has a tile, in cell order).  The tiles
+    can be plain shape files or be in the zip archives (.zip) that SWBD is distributed in, so there's no need to
+    unpack them first.  The shpname for a tile in an archive is ARCHIVE:MEMBER.  Missing and duplicate tiles are
+    reported on stderr.  Returns the number of tasks.
+
+*/
+
+int32_t discover_cells (char *dirname, CELL_TASK *task)
+{
+  DIR               *dir;
+  struct dirent     *entry;
+  DISCOVERY         found;
+  int32_t           x, y, rank, i, len, num_tasks, missing, num_zipped;
+
+
+  if ((dir = opendir (dirname)) == NULL)
+    {
+      perror (dirname);
+      exit (-1);
+    }
+
+
+  found.best = (int8_t *) malloc (CELL_ROWS * CELL_COLS * sizeof (int8_t));
+  found.name = (char **) calloc (CELL_ROWS * CELL_COLS, sizeof (char *));
+  found.zip = (ZIP_SOURCE **) calloc (CELL_ROWS * CELL_COLS, sizeof (ZIP_SOURCE *));
+
+  if (found.best == NULL || found.name == NULL || found.zip == NULL)
+    {
+      perror ("Allocating discovery memory");
+      exit (-1);
+    }
+
+  memset (found.best, -1, CELL_ROWS * CELL_COLS * sizeof (int8_t));
+
+
+  found.num_tiles = 0;
+  found.duplicates = 0;
+
+  while ((entry = readdir (dir)) != NULL)
+    {
+      len = strlen (entry->d_name);
+
+      if (len > 4 && (!strcmp (&entry->d_name[len - 4], ".zip") || !strcmp (&entry->d_name[len - 4], ".ZIP")))
+        {
+          add_archive (&found, dirname, entry->d_name);
+        }
+      else if (parse_tile_name (entry->d_name, &x, &y, &rank))
+        {
+          add_tile (&found, x, y, rank, entry->d_name, NULL);
+        }
+    }
+
+  closedir (dir);
+
+
+  /*  Build the task list in cell order.  */
+
+  num_tasks = 0;
+  missing = 0;
+  num_zipped = 0;
+
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++)
+    {
+      if (found.name[i] == NULL)
+        {
+          /*  SWBD only covers 56S to 60N so we only count missing cells in that band.  */
+
+          if (i / CELL_COLS >= 34 && i / CELL_COLS < 150) missing++;
+          continue;
+        }
+
+      memset (&task[num_tasks], 0, sizeof (CELL_TASK));
+
+      snprintf (task[num_tasks].shpname, sizeof (task[num_tasks].shpname), "%s/%s", dirname, found.name[i]);
+      task[num_tasks].x = i % CELL_COLS;
+      task[num_tasks].y = i / CELL_COLS;
+
+      if (found.zip[i] != NULL)
+        {
+          task[num_tasks].zip = *found.zip[i];
+          num_zipped++;
+        }
+
+      num_tasks++;
+
+      free (found.name[i]);
+      free (found.zip[i]);
+    }
+
+  free (found.name);
+  free (found.zip);
+  free (found.best);
+
+
+  fprintf (stderr, "%d tiles found in %s, %d cells to process, %d duplicate tiles ignored, %d cells between 56S and 60N without a tile\n\n",
+           found.num_tiles, dirname, num_tasks, found.duplicates, missing);
+  if (num_zipped) fprintf (stderr, "%d of the tiles are read straight from zip archives\n\n", num_zipped);
+  fflush (stderr);
+
+  return (num_tasks);
+}
+
+
+
+/*
+
+    Cut the task list down to one piece of a sharded build.  If num_shards is more than 1 we keep the cells in every
+    num_shards'th row starting at row shard - 1 (interleaving the rows spreads the land out pretty evenly).  If band is
+    not NULL we also keep only the cells that overlap the lon/lat box west, east, south, north (if west is greater
+    than east the box crosses the date line).  Returns the new number of tasks.
+
+*/
+
+int32_t select_cells (CELL_TASK *task, int32_t num_tasks, int32_t shard, int32_t num_shards, double *band)
+{
+  int32_t           i, j;
+  double            west, east, south, north;
+  uint8_t           lon_ok;
+
+
+  for (i = 0, j = 0 ; i < num_tasks ; i++)
+    {
+      if (num_shards > 1 && task[i].y % num_shards != shard - 1) continue;
+
+      if (band != NULL)
+        {
+          west = (double) task[i].x - 180.0;
+          east = west + 1.0;
+          south = (double) task[i].y - 90.0;
+          north = south + 1.0;
+
+          if (band[0] > band[1])
+            {
+              lon_ok = (west < band[1] || east > band[0]);
+            }
+          else
+            {
+              lon_ok = (west < band[1] && east > band[0]);
+            }
+
+          if (!lon_ok || south >= band[3] || north <= band[2]) continue;
+        }
+
+      task[j++] = task[i];
+    }
+
+  return (j);
+}
@@ -0,0 +1,1060 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <zlib.h>
+
+#include "build_swbd.h"
+#include "bit_writer.h"
+
+
+/*  The per segment values that go in front of the offsets.  */
+
+typedef struct
+{
+  int32_t           count;
+  int32_t           count_bits;
+  int32_t           lon_offset_bits;
+  int32_t           lat_offset_bits;
+  int32_t           bias_x;
+  int32_t           bias_y;
+  int32_t           box[4];                   /*  Bounding box, min x, min y, max x, max y  */
+} SEGMENT_HEADER;
+
+
+
+/*  Compute the biases and bit widths for a segment.  Returns 0, or -1 if the lon bias is out of range, or -2 if the
+    lat bias is out of range.  */
+
+static int32_t segment_header (const int32_t *segx, const int32_t *segy, int32_t segCount, SEGMENT_HEADER *header)
+{
+  int32_t           k, diff_x[2], diff_y[2], range_x, range_y, max_bias;
+
+
+  /*  Compute the maximum delta value.  */
+
+  max_bias = (int32_t) (pow (2.0, 17.0) - 1.0);
+
+
+  /*  Compute the maximum difference between adjacent points in the segment (and the bounding box while we're
+      at it).  */
+
+  diff_x[0] = 99999999;
+  diff_x[1] = -99999999;
+  diff_y[0] = 99999999;
+  diff_y[1] = -99999999;
+
+  header->box[0] = header->box[2] = segx[0];
+  header->box[1] = header->box[3] = segy[0];
+
+  for (k = 1 ; k < segCount ; k++)
+    {
+      diff_x[0] = MIN (segx[k] - segx[k - 1], diff_x[0]);
+      diff_x[1] = MAX (segx[k] - segx[k - 1], diff_x[1]);
+      diff_y[0] = MIN (segy[k] - segy[k - 1], diff_y[0]);
+      diff_y[1] = MAX (segy[k] - segy[k - 1], diff_y[1]);
+
+      header->box[0] = MIN (segx[k], header->box[0]);
+      header->box[1] = MIN (segy[k], header->box[1]);
+      header->box[2] = MAX (segx[k], header->box[2]);
+      header->box[3] = MAX (segy[k], header->box[3]);
+    }
+
+
+  header->count = segCount;
+  header->bias_x = -diff_x[0];
+  header->bias_y = -diff_y[0];
+
+
+  if (header->bias_x > max_bias || header->bias_x < -max_bias) return (-1);
+  if (header->bias_y > max_bias || header->bias_y < -max_bias) return (-2);
+
+
+  range_x = diff_x[1] - diff_x[0];
+  range_y = diff_y[1] - diff_y[0];
+
+
+  if (!range_x) range_x = 1;
+  if (!range_y) range_y = 1;
+
+
+  /*  Compute the number of bits needed to store the data.  */
+
+  header->count_bits = int_log2 (segCount) + 1;
+  header->lon_offset_bits = int_log2 (range_x) + 1;
+  header->lat_offset_bits = int_log2 (range_y) + 1;
+
+  return (0);
+}
+
+
+
+/*  Compute the size, in bytes, of a packed segment.  Note that this is a bit more than the number of bits actually
+    used (it counts one extra offset pair and always adds a byte) but that's what the file format has always used so
+    it stays.  */
+
+static int32_t segment_size (SEGMENT_HEADER *header)
+{
+  int32_t           size;
+
+
+  size = 5 + 5 + 5 + header->count_bits + header->lon_offset_bits + header->lat_offset_bits + 18 + 18 + 26 + 25 + 
+    (header->count - 1) * (header->lon_offset_bits + header->lat_offset_bits);
+
+  return (size / 8 + 1);
+}
+
+
+
+/*  The original way of packing a segment with bit_pack.  This is only used by encode_benchmark now.  buffer must be
+    zeroed.  */
+
+static void pack_segment_bit_pack (uint8_t *buffer, const int32_t *segx, const int32_t *segy, SEGMENT_HEADER *header)
+{
+  int32_t           k, pos, xoff, yoff, max_bias;
+
+
+  max_bias = (int32_t) (pow (2.0, 17.0) - 1.0);
+
+  pos = 0;
+  bit_pack (buffer, pos, 5, header->count_bits); pos += 5;
+  bit_pack (buffer, pos, 5, header->lon_offset_bits); pos += 5;
+  bit_pack (buffer, pos, 5, header->lat_offset_bits); pos +=5;
+  bit_pack (buffer, pos, header->count_bits, header->count); pos += header->count_bits;
+  bit_pack (buffer, pos, 18, header->bias_x + max_bias); pos += 18;
+  bit_pack (buffer, pos, 18, header->bias_y + max_bias); pos += 18;
+  bit_pack (buffer, pos, 26, segx[0]); pos += 26;
+  bit_pack (buffer, pos, 25, segy[0]); pos += 25;
+
+
+  for (k = 1 ; k < header->count ; k++)
+    {
+      xoff = (segx[k] - segx[k - 1]) + header->bias_x;
+      yoff = (segy[k] - segy[k - 1]) + header->bias_y;
+
+      bit_pack (buffer, pos, header->lon_offset_bits, xoff); pos += header->lon_offset_bits;
+      bit_pack (buffer, pos, header->lat_offset_bits, yoff); pos += header->lat_offset_bits;
+    }
+}
+
+
+
+/*  Pack a segment with the streaming bit writer.  The result is byte for byte the same as pack_segment_bit_pack but
+    buffer doesn't have to be zeroed (we zero fill out to the end of the segment_size bytes).  */
+
+static void pack_segment (uint8_t *buffer, const int32_t *segx, const int32_t *segy, SEGMENT_HEADER *header, int32_t size)
+{
+  BIT_WRITER        writer;
+  int32_t           max_bias;
+  uint8_t           *end;
+
+
+  max_bias = (int32_t) (pow (2.0, 17.0) - 1.0);
+
+  bit_writer_init (&writer, buffer);
+
+  bit_writer_put (&writer, 15, (header->count_bits << 10) | (header->lon_offset_bits << 5) | header->lat_offset_bits);
+  bit_writer_put (&writer, header->count_bits, header->count);
+  bit_writer_put (&writer, 18, header->bias_x + max_bias);
+  bit_writer_put (&writer, 18, header->bias_y + max_bias);
+  bit_writer_put (&writer, 26, segx[0]);
+  bit_writer_put (&writer, 25, segy[0]);
+
+  (*pack_offsets_func (header->lon_offset_bits, header->lat_offset_bits)) (&writer, segx, segy, header->count,
+                                                                            header->bias_x, header->bias_y,
+                                                                            header->lon_offset_bits,
+                                                                            header->lat_offset_bits);
+
+  end = bit_writer_flush (&writer);
+
+  memset (end, 0, size - (end - buffer));
+}
+
+
+
+/*  Zigzag coded residual for vertex k of a Rice coded segment (the delta from vertex k - 1 for order 1, the change
+    in the delta for order 2).  */
+
+static inline uint32_t rice_residual (const int32_t *value, int32_t k, int32_t order)
+{
+  int32_t           delta;
+
+
+  delta = value[k] - value[k - 1];
+  if (order == 2 && k > 1) delta -= value[k - 1] - value[k - 2];
+
+  return (((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31));
+}
+
+
+
+/*  Number of bits needed to Rice code the residuals of value with parameter param.  */
+
+static int64_t rice_bits (const int32_t *value, int32_t count, int32_t order, int32_t param)
+{
+  int32_t           k;
+  int64_t           bits;
+  uint32_t          q;
+
+
+  for (k = 1, bits = 0 ; k < count ; k++)
+    {
+      q = rice_residual (value, k, order) >> param;
+      bits += (q < CCL_RICE_ESCAPE) ? q + 1 + param : CCL_RICE_ESCAPE + 32;
+    }
+
+  return (bits);
+}
+
+
+
+/*  Pick the Rice parameter for the residuals of value.  The best one is close to log2 of the mean residual so we only
+    try that and its neighbors.  The number of bits it needs goes in bits.  */
+
+static int32_t rice_param (const int32_t *value, int32_t count, int32_t order, int64_t *bits)
+{
+  int32_t           k, param, best;
+  int64_t           sum, mean, size;
+
+
+  for (k = 1, sum = 0 ; k < count ; k++) sum += rice_residual (value, k, order);
+
+  mean = sum / MAX (count - 1, 1);
+
+  for (param = 0 ; param < CCL_RICE_MAX_PARAM && ((int64_t) 2 << param) <= mean ; param++);
+
+  best = param;
+  *bits = rice_bits (value, count, order, param);
+
+  for (k = MAX (0, param - 1) ; k <= MIN (CCL_RICE_MAX_PARAM, param + 1) ; k++)
+    {
+      if (k == param) continue;
+
+      if ((size = rice_bits (value, count, order, k)) < *bits)
+        {
+          *bits = size;
+          best = k;
+        }
+    }
+
+  return (best);
+}
+
+
+
+/*  Write one Rice coded value.  */
+
+static inline void rice_put (BIT_WRITER *writer, uint32_t value, int32_t param)
+{
+  uint32_t          q;
+
+
+  q = value >> param;
+
+  if (q < CCL_RICE_ESCAPE)
+    {
+      bit_writer_put (writer, q + 1, ((1 << q) - 1) << 1);
+      if (param) bit_writer_put (writer, param, value);
+    }
+  else
+    {
+      bit_writer_put (writer, CCL_RICE_ESCAPE, (1 << CCL_RICE_ESCAPE) - 1);
+      bit_writer_put (writer, 32, value);
+    }
+}
+
+
+
+/*  Rice code one segment (see CCL_RICE_ESCAPE in ccl_reader.h) onto the end of block.  If coding is 2 each segment
+    uses whichever prediction order (deltas or delta of deltas) makes it smaller.  If metrics isn't NULL the count bits
+    and Rice parameters go in its histograms.  */
+
+static void encode_rice_segment (CELL_BLOCK *block, const int32_t *segx, const int32_t *segy, int32_t count,
+                                 int32_t coding, METRICS_CELL *metrics)
+{
+  BIT_WRITER        writer;
+  int32_t           k, order, param_x, param_y, px, py, count_bits, size_bits, size;
+  int64_t           bits, bits_x, bits_y, header_bits;
+  uint8_t           *end;
+
+
+  order = 1;
+  param_x = rice_param (segx, count, 1, &bits_x);
+  param_y = rice_param (segy, count, 1, &bits_y);
+  bits = bits_x + bits_y;
+
+  if (coding == 2)
+    {
+      px = rice_param (segx, count, 2, &bits_x);
+      py = rice_param (segy, count, 2, &bits_y);
+
+      if (bits_x + bits_y < bits)
+        {
+          order = 2;
+          param_x = px;
+          param_y = py;
+          bits = bits_x + bits_y;
+        }
+    }
+
+
+  /*  The size field is part of the segment so find a size that's big enough to hold itself.  */
+
+  count_bits = int_log2 (count) + 1;
+  header_bits = 5 + count_bits + 5 + 26 + 25 + 1 + 5 + 5;
+
+  size_bits = 1;
+  while (NVTrue)
+    {
+      size = (int32_t) ((header_bits + size_bits + bits + 7) / 8);
+
+      if (int_log2 (size) + 1 <= size_bits) break;
+
+      size_bits = int_log2 (size) + 1;
+    }
+
+
+  block->buffer = (uint8_t *) grow_buffer (block->buffer, &block->alloc, block->size + size, sizeof (uint8_t));
+
+  bit_writer_init (&writer, &block->buffer[block->size]);
+
+  bit_writer_put (&writer, 5, count_bits);
+  bit_writer_put (&writer, count_bits, count);
+  bit_writer_put (&writer, 5, size_bits);
+  bit_writer_put (&writer, size_bits, size);
+  bit_writer_put (&writer, 26, segx[0]);
+  bit_writer_put (&writer, 25, segy[0]);
+  bit_writer_put (&writer, 11, ((order - 1) << 10) | (param_x << 5) | param_y);
+
+  for (k = 1 ; k < count ; k++)
+    {
+      rice_put (&writer, rice_residual (segx, k, order), param_x);
+      rice_put (&writer, rice_residual (segy, k, order), param_y);
+    }
+
+  end = bit_writer_flush (&writer);
+
+  memset (end, 0, size - (end - &block->buffer[block->size]));
+
+  block->size += size;
+
+  if (metrics != NULL) metrics_segment (metrics, count_bits, param_x, param_y);
+}
+
+
+
+/*  Difference code and bit pack one segment onto the end of block (Rice coded if coding isn't 0).  If box isn't NULL
+    the segment's bounding box goes in it.  If metrics isn't NULL the segment's bit widths go in its histograms.  */
+
+static void encode_segment (CELL_BLOCK *block, int32_t *segx, int32_t *segy, int32_t count, int32_t x, int32_t y,
+                            int32_t coding, int32_t *box, METRICS_CELL *metrics)
+{
+  SEGMENT_HEADER    header;
+  int32_t           size, status;
+
+
+  /*  Rice coded segments don't have biases so we only need the bounding box from the header.  */
+
+  status = segment_header (segx, segy, count, &header);
+
+  if (coding)
+    {
+      encode_rice_segment (block, segx, segy, count, coding, metrics);
+    }
+  else
+    {
+      if (status)
+        {
+          fprintf (stderr, "\n\n%s bias out of range, terminating!\n\n", (status == -1) ? "lon" : "lat");
+          fprintf (stderr, "%d %d %d\n", y, x, (status == -1) ? header.bias_x : header.bias_y);
+          exit (-1);
+        }
+
+
+      /*  Make room in the block and pack the segment into it.  */
+
+      size = segment_size (&header);
+
+      block->buffer = (uint8_t *) grow_buffer (block->buffer, &block->alloc, block->size + size, sizeof (uint8_t));
+
+      pack_segment (&block->buffer[block->size], segx, segy, &header, size);
+
+      block->size += size;
+
+      if (metrics != NULL) metrics_segment (metrics, header.count_bits, header.lon_offset_bits, header.lat_offset_bits);
+    }
+
+  block->num_vertices += count;
+  block->num_segments++;
+
+  if (box != NULL) memcpy (box, header.box, sizeof (header.box));
+}
+
+
+
+/*  Which sub-cell of the segment index grid a position (relative to the cell corner) falls in.  */
+
+static int32_t grid_cell (int32_t value)
+{
+  return (MAX (0, MIN (CCL_GRID - 1, value / (CCL_CELL_UNITS / CCL_GRID))));
+}
+
+
+
+/*
+
+    Build the segment index block for a cell (see ccl_reader.h).  box has the bounding box of each segment (4 values
+    each, relative to the cell corner) and offset the byte offset of each segment in the cell block.  Each segment goes
+    in the list of every sub-cell its bounding box touches.
+
+*/
+
+static void build_index (CELL_BLOCK *index, int32_t *box, int32_t *offset, int32_t num_segments, ARENA *scratch)
+{
+  int32_t           i, j, k, g, *start, *fill, list_size, pos;
+  uint8_t           *record, *list;
+
+
+  index->size = 0;
+  index->num_segments = 0;
+  index->num_vertices = 0;
+
+  if (!num_segments) return;
+
+
+  start = (int32_t *) arena_calloc (scratch, (CCL_GRID * CCL_GRID + 1) * sizeof (int32_t));
+  fill = (int32_t *) arena_alloc (scratch, CCL_GRID * CCL_GRID * sizeof (int32_t));
+
+
+  /*  Count the segments in each sub-cell and turn the counts into list starts.  */
+
+  for (i = 0 ; i < num_segments ; i++)
+    {
+      for (j = grid_cell (box[i * 4 + 1]) ; j <= grid_cell (box[i * 4 + 3]) ; j++)
+        {
+          for (k = grid_cell (box[i * 4]) ; k <= grid_cell (box[i * 4 + 2]) ; k++) start[j * CCL_GRID + k + 1]++;
+        }
+    }
+
+  for (g = 0 ; g < CCL_GRID * CCL_GRID ; g++)
+    {
+      start[g + 1] += start[g];
+      fill[g] = start[g];
+    }
+
+  list_size = start[CCL_GRID * CCL_GRID];
+
+
+  index->size = CCL_GRID_SIZE + (int64_t) num_segments * CCL_INDEX_RECORD + (int64_t) list_size * 4;
+  index->num_segments = num_segments;
+
+  index->buffer = (uint8_t *) grow_buffer (index->buffer, &index->alloc, index->size, sizeof (uint8_t));
+  memset (index->buffer, 0, index->size);
+
+  record = index->buffer + CCL_GRID_SIZE;
+  list = record + (int64_t) num_segments * CCL_INDEX_RECORD;
+
+  for (g = 0 ; g <= CCL_GRID * CCL_GRID ; g++) bit_pack (index->buffer, g * 32, 32, start[g]);
+
+
+  for (i = 0 ; i < num_segments ; i++)
+    {
+      pos = i * CCL_INDEX_RECORD * 8;
+
+      for (k = 0 ; k < 4 ; k++)
+        {
+          bit_pack (record, pos, 17, box[i * 4 + k]);
+          pos += 17;
+        }
+
+      bit_pack (record, pos, 32, offset[i]);
+
+
+      for (j = grid_cell (box[i * 4 + 1]) ; j <= grid_cell (box[i * 4 + 3]) ; j++)
+        {
+          for (k = grid_cell (box[i * 4]) ; k <= grid_cell (box[i * 4 + 2]) ; k++)
+            {
+              bit_pack (list, fill[j * CCL_GRID + k] * 32, 32, i);
+              fill[j * CCL_GRID + k]++;
+            }
+        }
+    }
+}
+
+
+
+/*  Number of bits needed to hold value (at least 1).  */
+
+static inline int32_t column_bits (int64_t value)
+{
+  int32_t           bits;
+
+
+  for (bits = 1 ; bits < 31 && ((int64_t) 1 << bits) <= value ; bits++);
+
+  return (bits);
+}
+
+
+
+/*  Rearrange an encoded cell block (fixed width segments, one after another) into a columnar block (see
+    CCL_COLUMN_HEADER in ccl_reader.h).  The values don't change, only where they are, so we just read the segment
+    headers back, total up the offset streams, and copy the fields over.  Empty blocks stay empty.  */
+
+static void columnar_block (CELL_BLOCK *block, ARENA *scratch)
+{
+  BIT_WRITER        writer;
+  uint8_t           *copy;
+  int32_t           i, k, n, count_bits, pos_bits, record, cb, lob, lab, count;
+  int64_t           pos, lon_bits, lat_bits, lon_off, lat_off, size, *start;
+
+
+  if (!block->size) return;
+
+  n = block->num_segments;
+
+  copy = (uint8_t *) arena_alloc (scratch, block->size);
+  memcpy (copy, block->buffer, block->size);
+  start = (int64_t *) arena_alloc (scratch, n * sizeof (int64_t));
+
+
+  /*  Find the segments and the sizes of the streams.  */
+
+  count_bits = 1;
+  lon_bits = lat_bits = 0;
+
+  for (i = 0, pos = 0 ; i < n ; i++)
+    {
+      start[i] = pos;
+
+      cb = ccl_get_bits (copy + pos, 0, 5);
+      lob = ccl_get_bits (copy + pos, 5, 5);
+      lab = ccl_get_bits (copy + pos, 10, 5);
+      count = ccl_get_bits (copy + pos, 15, cb);
+
+      count_bits = MAX (count_bits, cb);
+      lon_bits += (int64_t) (count - 1) * lob;
+      lat_bits += (int64_t) (count - 1) * lab;
+
+      pos += (102 + cb + (int64_t) count * (lob + lab)) / 8 + 1;
+    }
+
+  pos_bits = column_bits (MAX (lon_bits, lat_bits));
+  record = CCL_COLUMN_RECORD (count_bits, pos_bits);
+
+  lon_off = (CCL_COLUMN_HEADER + (int64_t) n * record + 7) / 8;
+  lat_off = lon_off + (lon_bits + 7) / 8;
+  size = lat_off + (lat_bits + 7) / 8 + CCL_COLUMN_PAD;
+
+  block->buffer = (uint8_t *) grow_buffer (block->buffer, &block->alloc, size, sizeof (uint8_t));
+
+
+  /*  The header and the segment table.  */
+
+  bit_writer_init (&writer, block->buffer);
+
+  bit_writer_put (&writer, 10, (count_bits << 5) | pos_bits);
+  bit_writer_put (&writer, 32, (uint32_t) lon_off);
+  bit_writer_put (&writer, 32, (uint32_t) lat_off);
+  bit_writer_put (&writer, 32, (uint32_t) size);
+
+  lon_bits = lat_bits = 0;
+
+  for (i = 0 ; i < n ; i++)
+    {
+      cb = ccl_get_bits (copy + start[i], 0, 5);
+      lob = ccl_get_bits (copy + start[i], 5, 5);
+      lab = ccl_get_bits (copy + start[i], 10, 5);
+      count = ccl_get_bits (copy + start[i], 15, cb);
+
+      bit_writer_put (&writer, count_bits, count);
+      bit_writer_put (&writer, 10, (lob << 5) | lab);
+      bit_writer_put (&writer, 18, ccl_get_bits (copy + start[i], 15 + cb, 18));
+      bit_writer_put (&writer, 18, ccl_get_bits (copy + start[i], 33 + cb, 18));
+      bit_writer_put (&writer, 26, ccl_get_bits (copy + start[i], 51 + cb, 26));
+      bit_writer_put (&writer, 25, ccl_get_bits (copy + start[i], 77 + cb, 25));
+      bit_writer_put (&writer, pos_bits, (uint32_t) lon_bits);
+      bit_writer_put (&writer, pos_bits, (uint32_t) lat_bits);
+
+      lon_bits += (int64_t) (count - 1) * lob;
+      lat_bits += (int64_t) (count - 1) * lab;
+    }
+
+  bit_writer_flush (&writer);
+
+
+  /*  The lon offsets, then the lat offsets.  */
+
+  for (k = 0 ; k < 2 ; k++)
+    {
+      bit_writer_init (&writer, block->buffer + (k ? lat_off : lon_off));
+
+      for (i = 0 ; i < n ; i++)
+        {
+          cb = ccl_get_bits (copy + start[i], 0, 5);
+          lob = ccl_get_bits (copy + start[i], 5, 5);
+          lab = ccl_get_bits (copy + start[i], 10, 5);
+          count = ccl_get_bits (copy + start[i], 15, cb);
+
+          for (pos = 102 + cb + (k ? lob : 0) ; count > 1 ; count--, pos += lob + lab)
+            bit_writer_put (&writer, k ? lab : lob, ccl_get_bits (copy + start[i], pos, k ? lab : lob));
+        }
+
+      bit_writer_flush (&writer);
+    }
+
+  memset (block->buffer + size - CCL_COLUMN_PAD, 0, CCL_COLUMN_PAD);
+
+  block->size = size;
+}
+
+
+
+/*  Compress an encoded cell block in place with zlib at level.  The block's size before compression and the size of
+    the zlib stream go in front of the stream (see CCL_BLOCK_HEADER).  Empty blocks stay empty.  */
+
+static void compress_block (CELL_BLOCK *block, int32_t level, ARENA *scratch)
+{
+  uint8_t           *copy;
+  uLongf            length;
+
+
+  if (!block->size) return;
+
+  copy = (uint8_t *) arena_alloc (scratch, block->size);
+  memcpy (copy, block->buffer, block->size);
+
+  length = compressBound (block->size);
+  block->buffer = (uint8_t *) grow_buffer (block->buffer, &block->alloc, CCL_BLOCK_HEADER + length, sizeof (uint8_t));
+
+  if (compress2 (block->buffer + CCL_BLOCK_HEADER, &length, copy, block->size, level) != Z_OK)
+    {
+      fprintf (stderr, "\n\nUnable to compress a cell block, terminating!\n\n");
+      exit (-1);
+    }
+
+  bit_pack (block->buffer, 0, 32, (int32_t) block->size);
+  bit_pack (block->buffer, 32, 32, (int32_t) length);
+
+  block->size = CCL_BLOCK_HEADER + length;
+}
+
+
+
+/*
+
+    Difference code and bit pack all of the segments in one cell into block.  The result is exactly what the old
+    serial pass 2 wrote to the output file for the cell.  This only touches the cell's own records and the block so any
+    number of cells can be encoded at the same time.  All of the working memory comes from the calling thread's
+    scratch arena which is reset when we're done with the cell.  The segments are packed straight into the block.
+
+    If stitch isn't -1 the segments whose ends are within stitch of each other are joined first (see stitch_cell).
+    If coding isn't 0 the segments are Rice coded (with up to coding as the prediction order) instead.  If columnar is
+    set the blocks are rearranged into columnar blocks (see columnar_block) once all of the segments are packed.  If
+    metrics isn't NULL the bit widths of the full resolution segments are counted in its histograms.
+
+    If there are levels of detail each segment is also simplified to each level's tolerance (always starting from the
+    full resolution points) and packed into the level's block in block->lod.  Segments that fit inside a box the size
+    of the tolerance (small islands, mostly) are dropped from that level.  If block->index isn't NULL we also build
+    the cell's segment index from the segments' bounding boxes and offsets.  If compression isn't 0 the cell's block
+    and its levels of detail are then compressed with zlib at that level (the segment index isn't, its offsets are
+    into the uncompressed block).
+
+*/
+
+void encode_cell (CELL_STORE *store, int32_t x, int32_t y, CELL_BLOCK *block, ARENA *scratch, int32_t stitch,
+                  int32_t coding, uint8_t columnar, int32_t compression, int32_t num_levels, int32_t *tolerance,
+                  METRICS_CELL *metrics)
+{
+  int32_t           i, j, k, n, segCount, *segx, *segy, *rec, *stored, *lodx, *lody, *stack, *box, *offset;
+  int32_t           num_segments, seg_box[4];
+  int64_t           rec_size, r;
+  uint8_t           *keep;
+
+
+  block->size = 0;
+  block->num_segments = 0;
+  block->num_vertices = 0;
+
+  for (j = 0 ; j < num_levels ; j++)
+    {
+      block->lod[j].size = 0;
+      block->lod[j].num_segments = 0;
+      block->lod[j].num_vertices = 0;
+    }
+
+
+  /*  Get the segment records for the cell.  */
+
+  rec_size = cell_store_get (store, x, y, &stored);
+
+  rec = stored;
+  if (stitch >= 0) rec_size = stitch_cell (stored, rec_size, stitch, scratch, &rec);
+
+  box = offset = NULL;
+  if (block->index != NULL)
+    {
+      for (r = 0, num_segments = 0 ; r < rec_size ; r += 1 + 2 * (int64_t) rec[r]) num_segments++;
+
+      box = (int32_t *) arena_alloc (scratch, 4 * num_segments * sizeof (int32_t));
+      offset = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+    }
+
+  for (r = 0 ; r < rec_size ; r += 1 + 2 * (int64_t) segCount)
+    {
+      segCount = rec[r];
+
+
+      /*  Just in case we happened to write an empty (or single point) segment ;-)  */
+
+      if (segCount > 1)
+        {
+          /*  Get memory for the segment.  */
+
+          segx = (int32_t *) arena_alloc (scratch, segCount * sizeof (int32_t));
+          segy = (int32_t *) arena_alloc (scratch, segCount * sizeof (int32_t));
+
+          for (k = 0 ; k < segCount ; k++)
+            {
+              segx[k] = rec[r + 1 + 2 * k];
+              segy[k] = rec[r + 2 + 2 * k];
+            }
+
+          i = block->num_segments;
+
+          if (box != NULL) offset[i] = columnar ? i : (int32_t) block->size;
+
+          encode_segment (block, segx, segy, segCount, x, y, coding, seg_box, metrics);
+
+
+          /*  The index boxes are relative to the cell corner (points that are a hair outside of the cell get pulled
+              in to the edge).  */
+
+          if (box != NULL)
+            {
+              for (k = 0 ; k < 4 ; k++)
+                {
+                  box[i * 4 + k] = seg_box[k] - ((k & 1) ? y : x) * CCL_CELL_UNITS;
+                  box[i * 4 + k] = MAX (0, MIN (CCL_CELL_UNITS, box[i * 4 + k]));
+                }
+            }
+
+
+          if (num_levels)
+            {
+              lodx = (int32_t *) arena_alloc (scratch, segCount * sizeof (int32_t));
+              lody = (int32_t *) arena_alloc (scratch, segCount * sizeof (int32_t));
+              stack = (int32_t *) arena_alloc (scratch, 2 * segCount * sizeof (int32_t));
+              keep = (uint8_t *) arena_alloc (scratch, segCount * sizeof (uint8_t));
+
+              for (j = 1 ; j <= num_levels ; j++)
+                {
+                  if (seg_box[2] - seg_box[0] <= tolerance[j] && seg_box[3] - seg_box[1] <= tolerance[j]) continue;
+
+                  simplify_segment (segx, segy, segCount, tolerance[j], keep, stack);
+
+                  for (k = 0, n = 0 ; k < segCount ; k++)
+                    {
+                      if (keep[k])
+                        {
+                          lodx[n] = segx[k];
+                          lody[n] = segy[k];
+                          n++;
+                        }
+                    }
+
+                  encode_segment (&block->lod[j - 1], lodx, lody, n, x, y, coding, NULL, NULL);
+                }
+            }
+        }
+    }
+
+
+  if (block->index != NULL) build_index (block->index, box, offset, block->num_segments, scratch);
+
+
+  if (columnar)
+    {
+      columnar_block (block, scratch);
+
+      for (j = 0 ; j < num_levels ; j++) columnar_block (&block->lod[j], scratch);
+    }
+
+
+  if (compression)
+    {
+      compress_block (block, compression, scratch);
+
+      for (j = 0 ; j < num_levels ; j++) compress_block (&block->lod[j], compression, scratch);
+    }
+
+
+  /*  We don't need the records or the scratch memory for this cell anymore.  */
+
+  cell_store_release (store, x, y, stored);
+
+  arena_reset (scratch);
+}
+
+
+
+/*  Copy one level of a cell out of an existing file.  */
+
+static void copy_level (CCL_READER *reader, int32_t level, int32_t x, int32_t y, CELL_BLOCK *block)
+{
+  CCL_CELL          cell;
+  const uint8_t     *data;
+  int64_t           size;
+
+
+  block->size = 0;
+  block->num_segments = 0;
+  block->num_vertices = 0;
+
+  if (!ccl_cell_level (reader, level, y, x, &cell)) return;
+
+
+  if ((size = ccl_cell_raw (reader, level, y, x, &data)) < 0)
+    {
+      fprintf (stderr, "\n\nCell %d %d (level %d) in the file being copied is corrupt, terminating!\n\n", y, x,
+               level);
+      exit (-1);
+    }
+
+
+  block->buffer = (uint8_t *) grow_buffer (block->buffer, &block->alloc, size, sizeof (uint8_t));
+
+  memcpy (block->buffer, data, size);
+
+  block->size = size;
+  block->num_segments = cell.num_segments;
+  block->num_vertices = cell.num_vertices;
+}
+
+
+
+/*
+
+    Copy the encoded segments for a cell straight out of an existing file into block (for updates and merges).
+    Nothing gets decoded (or inflated), ccl_cell_raw walks the segment headers to find the size of the cell's block if
+    it isn't compressed.  The levels of detail and the segment index block (if any) are copied too, the caller has
+    already made sure that the file has the same layout.
+
+*/
+
+void copy_cell (CCL_READER *reader, int32_t x, int32_t y, CELL_BLOCK *block)
+{
+  const uint8_t     *data;
+  int32_t           j;
+  int64_t           size;
+
+
+  copy_level (reader, 0, x, y, block);
+
+  if (block->lod != NULL)
+    {
+      for (j = 1 ; j <= reader->num_levels ; j++) copy_level (reader, j, x, y, &block->lod[j - 1]);
+    }
+
+  if (block->index != NULL)
+    {
+      block->index->size = 0;
+      block->index->num_segments = 0;
+      block->index->num_vertices = 0;
+
+      if (block->num_segments && (size = ccl_cell_raw (reader, CCL_INDEX_LEVEL, y, x, &data)) <= 0)
+        {
+          fprintf (stderr, "\n\nThe segment index for cell %d %d in the file being copied is corrupt, terminating!\n\n",
+                   y, x);
+          exit (-1);
+        }
+
+      if (block->num_segments)
+        {
+          block->index->size = size;
+          block->index->buffer = (uint8_t *) grow_buffer (block->index->buffer, &block->index->alloc,
+                                                          block->index->size, sizeof (uint8_t));
+          memcpy (block->index->buffer, data, block->index->size);
+          block->index->num_segments = block->num_segments;
+        }
+    }
+}
+
+
+
+/*
+
+    Compare the streaming bit writer to the old bit_pack calls on a set of synthetic segments whose offset widths are
+    spread around the ones we see in the SWBD data (plus some wide ones to exercise the generic packer).  Both outputs
+    are checked byte for byte and the encode rates are printed.  Returns the number of segments that didn't match.
+
+*/
+
+int32_t encode_benchmark ()
+{
+  int32_t           i, k, n, pass, num_segments, *segx, *segy, *count, total, mismatches, size, step;
+  int64_t           vertices, bytes, offset, *start;
+  uint8_t           *old_buffer, *new_buffer;
+  SEGMENT_HEADER    *header;
+  double            seconds[2], clock_start;
+
+
+  num_segments = 20000;
+  total = 0;
+
+  count = (int32_t *) malloc (num_segments * sizeof (int32_t));
+  start = (int64_t *) malloc ((num_segments + 1) * sizeof (int64_t));
+  header = (SEGMENT_HEADER *) malloc (num_segments * sizeof (SEGMENT_HEADER));
+
+  if (count == NULL || start == NULL || header == NULL)
+    {
+      perror ("Allocating benchmark memory");
+      exit (-1);
+    }
+
+  srand (4321);
+
+  for (i = 0 ; i < num_segments ; i++)
+    {
+      count[i] = 2 + rand () % 1000;
+      total += count[i];
+    }
+
+  segx = (int32_t *) malloc (total * sizeof (int32_t));
+  segy = (int32_t *) malloc (total * sizeof (int32_t));
+
+  if (segx == NULL || segy == NULL)
+    {
+      perror ("Allocating benchmark memory");
+      exit (-1);
+    }
+
+
+  /*  Random walks.  Most segments step by up to a few hundred units (9 to 11 bit offsets) like SWBD does.  */
+
+  offset = 0;
+  bytes = 0;
+  for (i = 0 ; i < num_segments ; i++)
+    {
+      step = (i % 10) ? 64 << (rand () % 4) : 1 + rand () % 100000;
+
+      segx[offset] = 10000000 + rand () % 1000000;
+      segy[offset] = 5000000 + rand () % 1000000;
+
+      for (k = 1 ; k < count[i] ; k++)
+        {
+          segx[offset + k] = segx[offset + k - 1] + rand () % (2 * step + 1) - step;
+          segy[offset + k] = segy[offset + k - 1] + rand () % (2 * step + 1) - step;
+        }
+
+      segment_header (&segx[offset], &segy[offset], count[i], &header[i]);
+
+      start[i] = bytes;
+      bytes += segment_size (&header[i]);
+      offset += count[i];
+    }
+
+  start[num_segments] = bytes;
+
+  old_buffer = (uint8_t *) malloc (bytes);
+  new_buffer = (uint8_t *) malloc (bytes);
+
+  if (old_buffer == NULL || new_buffer == NULL)
+    {
+      perror ("Allocating benchmark memory");
+      exit (-1);
+    }
+
+
+  /*  Run each a few times.  */
+
+  n = 5;
+
+  for (pass = 0 ; pass < 2 ; pass++)
+    {
+      clock_start = metrics_time ();
+
+      for (i = 0 ; i < n ; i++)
+        {
+          if (!pass) memset (old_buffer, 0, bytes);
+
+          for (k = 0, offset = 0 ; k < num_segments ; offset += count[k], k++)
+            {
+              if (pass)
+                {
+                  pack_segment (&new_buffer[start[k]], &segx[offset], &segy[offset], &header[k], start[k + 1] - start[k]);
+                }
+              else
+                {
+                  pack_segment_bit_pack (&old_buffer[start[k]], &segx[offset], &segy[offset], &header[k]);
+                }
+            }
+        }
+
+      seconds[pass] = metrics_time () - clock_start;
+      if (seconds[pass] <= 0.0) seconds[pass] = 1.0e-6;
+    }
+
+
+  mismatches = 0;
+  for (k = 0 ; k < num_segments ; k++)
+    {
+      size = start[k + 1] - start[k];
+      if (memcmp (&old_buffer[start[k]], &new_buffer[start[k]], size)) mismatches++;
+    }
+
+
+  vertices = (int64_t) total * n;
+
+  fprintf (stderr, "%d segments, %d vertices, %"PRId64" bytes, %d passes\n", num_segments, total, bytes, n);
+  fprintf (stderr, "bit_pack:    %8.2f million vertices/second  %8.2f MB/second\n", vertices / seconds[0] / 1.0e6,
+           bytes * n / seconds[0] / 1048576.0);
+  fprintf (stderr, "bit writer:  %8.2f million vertices/second  %8.2f MB/second\n", vertices / seconds[1] / 1.0e6,
+           bytes * n / seconds[1] / 1048576.0);
+  fprintf (stderr, "speedup:     %8.2f\n", seconds[0] / seconds[1]);
+  fprintf (stderr, "%d segments did not match\n", mismatches);
+
+
+  free (old_buffer);
+  free (new_buffer);
+  free (segx);
+  free (segy);
+  free (header);
+  free (start);
+  free (count);
+
+  return (mismatches);
+}
@@ -0,0 +1,411 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "build_swbd.h"
+
+
+/*  Everything we need to carry from one shape to the next while reading a cell.  */
+
+typedef struct
+{
+  CELL_TASK         *task;
+  SEGMENT           *seg;
+  CELL_STORE        *store;
+  INGEST_STATS      *stats;
+  double            cornerx[2];
+  double            cornery[2];
+  uint8_t           bad_flag;
+} INGEST_STATE;
+
+
+
+/*  Add the current segment (if it has more than one point) to the cell store and empty it.  */
+
+static void flush_segment (INGEST_STATE *state)
+{
+  SEGMENT           *seg = state->seg;
+
+
+  if (seg->count > 1) cell_store_add_segment (state->store, state->task->x, state->task->y, seg->count, seg->x, seg->y);
+
+  seg->count = 0;
+}
+
+
+
+/*
+
+    Split one shape into coastline segments.  The shape can come from shapelib or from the memory mapped reader so
+    the part starts and coordinates are passed as byte pointers.  parts points to nParts 32 bit part start indices and
+    the X and Y of point j are at px + j * stride and py + j * stride.  The whole shape is converted to fixed point
+    (with the boundary check) in one shot by the (possibly vectorized) conversion kernel and then we walk the results
+    to split the segments.
+
+*/
+
+static void ingest_shape (INGEST_STATE *state, int32_t nVertices, int32_t nParts, const uint8_t *parts,
+                          const uint8_t *px, const uint8_t *py, int32_t stride)
+{
+  SEGMENT           *seg = state->seg;
+  INGEST_STATS      *stats = state->stats;
+  METRICS_TIME      start, converted, end;
+  int32_t           j, numParts;
+  int64_t           alloc;
+  uint8_t           start_segment = NVFalse;
+
+
+  stats->shapes++;
+  stats->parts += nParts;
+
+
+  /*  Get all vertices  */
+
+  if (nVertices >= 2)
+    {
+      if (stats->timed) metrics_thread_clock (&start);
+
+
+      /*  Convert the whole shape.  */
+
+      if (nVertices > seg->convert_alloc)
+        {
+          alloc = seg->convert_alloc;
+          seg->ix = (int32_t *) grow_buffer (seg->ix, &alloc, nVertices, sizeof (int32_t));
+          alloc = seg->convert_alloc;
+          seg->iy = (int32_t *) grow_buffer (seg->iy, &alloc, nVertices, sizeof (int32_t));
+          seg->bad = (uint8_t *) grow_buffer (seg->bad, &seg->convert_alloc, nVertices, sizeof (uint8_t));
+        }
+
+      convert_points (px, py, stride, nVertices, state->cornerx, state->cornery, seg->ix, seg->iy, seg->bad);
+
+      if (stats->timed)
+        {
+          metrics_thread_clock (&converted);
+          metrics_add (&stats->conversion, &start, &converted);
+        }
+
+
+      for (j = 0, numParts = 1 ; j < nVertices ; j++)
+        {
+          start_segment = NVFalse;
+
+
+          /*  Check for start of a new segment.  */
+
+          if (!j && nParts > 0) start_segment = NVTrue;
+
+
+          /*  If the previous point was directly on a boundary it was probably a closure line (SWBD shape files
+              are closed polygons that define areas of water) so we throw it out.  */
+
+          if (state->bad_flag)
+            {
+              start_segment = NVTrue;
+              state->bad_flag = NVFalse;
+            }
+
+
+          /*  Check for the start of a new segment inside a larger group of points (this would be a "Ring" point).  */
+
+          if (numParts < nParts && shp_map_int (&parts[numParts * sizeof (int32_t)]) == j)
+            {
+              start_segment = NVTrue;
+              numParts++;
+            }
+
+
+          /*  Check for points (almost) exactly on any of the boundaries.  The longitudes get a bit fuzzy as we move
+              farther away from the equator.  We may lose a point or two here or there but we're trying to make coastline
+              not containers.  */
+
+          if (seg->bad[j])
+            {
+              state->bad_flag = NVTrue;
+              stats->dropped++;
+            }
+          else
+            {
+              /*  Start a new segment  */
+
+              if (start_segment)
+                {
+                  /*  Close last segment, start new segment  */
+
+                  flush_segment (state);
+                }
+
+
+              /*  Make room for the new point.  The buffers grow geometrically and are reused for every segment
+                  this thread reads so this almost never actually allocates anything.  */
+
+              if (seg->count >= seg->alloc)
+                {
+                  alloc = seg->alloc;
+                  seg->x = (int32_t *) grow_buffer (seg->x, &alloc, seg->count + 1, sizeof (int32_t));
+                  seg->y = (int32_t *) grow_buffer (seg->y, &seg->alloc, seg->count + 1, sizeof (int32_t));
+                }
+
+
+              /*  Add point to current segment  */
+
+              seg->x[seg->count] = seg->ix[j];
+              seg->y[seg->count] = seg->iy[j];
+
+
+              /*  Increment the point counter.  */
+
+              seg->count++;
+            }
+        }
+
+      if (stats->timed)
+        {
+          metrics_thread_clock (&end);
+          metrics_add (&stats->segmentation, &converted, &end);
+        }
+    }
+}
+
+
+
+/*  Read all of the shapes using shapelib.  */
+
+static void read_shapelib (INGEST_STATE *state, INGEST_STATS *stats)
+{
+  SHPHandle         shpHandle;
+  SHPObject         *shape = NULL;
+  int32_t           i, type, numShapes;
+  double            minBounds[4], maxBounds[4];
+
+
+  /*  Open shape file  */
+
+  shpHandle = SHPOpen (state->task->shpname, "rb");
+
+  if (shpHandle == NULL)
+    {
+      perror (state->task->shpname);
+      exit (-1);
+    }
+
+
+  /*  Get shape file header info  */
+
+  SHPGetInfo (shpHandle, &numShapes, &type, minBounds, maxBounds);
+
+
+  /*  Read all shapes  */
+
+  for (i = 0 ; i < numShapes ; i++)
+    {
+      shape = SHPReadObject (shpHandle, i);
+
+      stats->points += shape->nVertices;
+
+      ingest_shape (state, shape->nVertices, shape->nParts, (uint8_t *) shape->panPartStart, (uint8_t *) shape->padfX,
+                    (uint8_t *) shape->padfY, sizeof (double));
+
+
+      /*  Destroy the shape object.  */
+
+      SHPDestroyObject (shape);
+    }
+
+
+  /*  Close the input file.  */
+
+  SHPClose (shpHandle);
+}
+
+
+
+/*  Read all of the shapes straight out of the memory mapped shape file.  */
+
+static void read_mapped (INGEST_STATE *state, INGEST_STATS *stats)
+{
+  SHP_MAP           map;
+  SHP_MAP_SHAPE     shape;
+  int32_t           i;
+
+
+  if (shp_map_open (&map, state->task->shpname))
+    {
+      perror (state->task->shpname);
+      exit (-1);
+    }
+
+  for (i = 0 ; i < map.num_shapes ; i++)
+    {
+      if (shp_map_read (&map, i, &shape))
+        {
+          fprintf (stderr, "\n\nBad record %d in %s, terminating!\n\n", i, state->task->shpname);
+          exit (-1);
+        }
+
+      stats->points += shape.nVertices;
+
+
+      /*  Points are X/Y pairs so X is at the start of each 16 bytes and Y is right after it.  */
+
+      ingest_shape (state, shape.nVertices, shape.nParts, shape.parts, shape.points, shape.points + sizeof (double),
+                    2 * sizeof (double));
+    }
+
+  shp_map_close (&map);
+}
+
+
+
+/*  Read all of the shapes from a shape file that the decompression threads have inflated out of a zip archive.  */
+
+static void read_zipped (INGEST_STATE *state, INGEST_STATS *stats, ZIP_FEEDER *feeder, int32_t index)
+{
+  SHP_MAP           map;
+  SHP_MAP_SHAPE     shape;
+  uint8_t           *shp, *shx;
+  int32_t           i;
+
+
+  if (zip_feeder_get (feeder, index, &shp, &shx) ||
+      shp_map_memory (&map, shp, state->task->zip.shp.size, shx, state->task->zip.shx.size))
+    {
+      fprintf (stderr, "\n\nUnable to read %s, terminating!\n\n", state->task->shpname);
+      exit (-1);
+    }
+
+  for (i = 0 ; i < map.num_shapes ; i++)
+    {
+      if (shp_map_read (&map, i, &shape))
+        {
+          fprintf (stderr, "\n\nBad record %d in %s, terminating!\n\n", i, state->task->shpname);
+          exit (-1);
+        }
+
+      stats->points += shape.nVertices;
+
+      ingest_shape (state, shape.nVertices, shape.nParts, shape.parts, shape.points, shape.points + sizeof (double),
+                    2 * sizeof (double));
+    }
+
+  zip_feeder_release (feeder, index);
+}
+
+
+
+/*
+
+    Read all of the shapes from a single one-degree SWBD shape file and add the coastline segments to that cell in
+    the cell store.  Cells are independent of each other so this may be called from any number of threads at once as
+    long as each thread has its own SEGMENT buffer and stats.  reader is READER_SHAPELIB or READER_MMAP.  Shape files
+    in zip archives always come from feeder (as tile number index) and are read in memory with the mapped reader.  If
+    ahead isn't NULL the other shape files are read into the file cache ahead of time (as file number index) so we
+    wait for that before opening them.
+
+*/
+
+void ingest_cell (CELL_TASK *task, SEGMENT *seg, INGEST_STATS *stats, CELL_STORE *store, int32_t reader,
+                  ZIP_FEEDER *feeder, READ_AHEAD *ahead, int32_t index)
+{
+  INGEST_STATE      state;
+  METRICS_TIME      start, end;
+
+
+  if (stats->timed) metrics_thread_clock (&start);
+
+  state.task = task;
+  state.seg = seg;
+  state.store = store;
+  state.stats = stats;
+
+
+  /*  Figure out where the boundaries of the one degree cell are.  */
+
+  state.cornerx[0] = task->x * 3600.0;
+  state.cornerx[1] = (task->x + 1) * 3600.0;
+  state.cornery[0] = task->y * 3600.0;
+  state.cornery[1] = (task->y + 1) * 3600.0;
+
+
+  cell_store_touch (store, task->x, task->y);
+
+
+  stats->files++;
+
+
+  /*  Initialize loop variables  */
+
+  seg->count = 0;
+  state.bad_flag = NVFalse;
+
+
+  fprintf (stderr,"Reading %s                        \r", task->shpname);
+  fflush (stderr);
+
+
+  if (task->zip.zipname[0])
+    {
+      read_zipped (&state, stats, feeder, index);
+    }
+  else
+    {
+      if (ahead != NULL) read_ahead_get (ahead, index);
+
+      if (reader == READER_MMAP)
+        {
+          read_mapped (&state, stats);
+        }
+      else
+        {
+          read_shapelib (&state, stats);
+        }
+
+      if (ahead != NULL) read_ahead_release (ahead, index);
+    }
+
+
+  /*  Close out the last segment is it's not already closed.  */
+
+  flush_segment (&state);
+
+  cell_store_finish (store, task->x, task->y);
+
+  if (stats->timed)
+    {
+      metrics_thread_clock (&end);
+      metrics_add (&stats->busy, &start, &end);
+    }
+}
@@ -36,16 +36,12 @@
 *****************************************  IMPORTANT NOTE  **********************************/
 
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <errno.h>
-#include <math.h>
-#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
 
-#include "nvutility.h"
-
-#include "shapefil.h"
-#include "version.h"
+#include "build_swbd.h"
+#include "thread_pool.h"
+#include "manifest.h"
 
 
 /*
@@ -78,6 +74,36 @@
                       latitudes and 180 to all longitudes so that we can work in positive numbers so, in essence we really
                       go from 0/0 to 89/359.
 
+                      In the V2.00 format (-F 2) the address is a 64 bit integer (stored as two 32 bit integers, high
+                      word first) so each group is 16 bytes.  If the cell blocks are aligned (-A) the version string has a
+                      second line saying so and each non-empty cell block starts on a 4096 byte boundary (the gaps are
+                      zero filled).  Readers don't need to know about the alignment since the addresses are absolute.
+
+                      V2.00 files may also have simplified levels of detail (-L) and a segment index (-I).  Each level
+                      is a complete copy of the coastline (same cell record format).  The segment index has a block for
+                      each cell with the bounding box and byte offset of each segment and an 8 X 8 grid of sub-cells
+                      listing the segments that touch each one (see ccl_reader.h).  The blocks for each level, then the
+                      segment index blocks, follow the full resolution blocks.  After them is a directory whose address
+                      is given by a "Directory at ADDRESS" line in the version string.  The directory is the number of
+                      levels (32 bits), a flags word (32 bits, 1 if there's a segment index plus 2 if the segments were
+                      stitched plus 4 if the cell blocks are compressed plus 8 if the segments are Rice coded), one 32
+                      bit tolerance (in 100000ths of a degree) per level, the stitching gap (32 bits, only if the
+                      stitched flag is set), the zlib compression level (32 bits, only if the compressed flag is set),
+                      the Rice prediction order (32 bits, only if the Rice coded flag is set), then a 180 X 360
+                      header (same 16 byte groups as the full resolution header) for each level and for the segment
+                      index.  In the segment index header the last value of each group is the size of the index block
+                      instead of the number of vertices.
+
+                      If the segments were stitched (-S) a V1.01 file has a "Segments stitched within GAP" line in the
+                      version string (GAP in 100000ths of a degree) and a V2.00 file always has a directory.
+
+                      If the cell blocks are compressed (-K) each non-empty full resolution and level of detail block
+                      is the size of the block before compression (32 bits), the size of the compressed data (32
+                      bits), and then the zlib compressed cell records.  Each cell is compressed on its own so any
+                      cell can still be read without touching the others.  The segment index blocks aren't
+                      compressed (their offsets are into the uncompressed block).  A compressed file always has a
+                      directory.
+
 
                   Cell records:
 
@@ -115,6 +141,40 @@
                       find it much easier to understand if I keep that kind of logistical nightmare to a minimum ;-)  The
                       savings in storage are pretty minimal anyway.
 
+                      With -e (V2.00 only) the segments are Rice coded instead.  One big jump in a segment makes every
+                      fixed width offset in it wide, so each segment is the count bits (5 bits), the count, the size
+                      bits (5 bits), the size of the segment in bytes, the start lon (26 bits) and lat (25 bits), the
+                      prediction order (1 bit, 0 for deltas from the previous point and 1 for the change in the delta),
+                      and a Rice parameter for lon and for lat (5 bits each).  That's followed by a lon and a lat
+                      residual for each point after the first.  The residuals are zigzag coded (0, -1, 1, -2, ... are
+                      stored as 0, 1, 2, 3, ...) then written as the value shifted right by the Rice parameter in unary
+                      (that many one bits and a zero bit) followed by the low Rice parameter bits of the value.  If
+                      the unary part would be 16 or more bits it's 16 one bits followed by the whole value in 32 bits.
+
+                      With -O (V2.00 only) the cell is columnar.  The segments have the same fields as above but they
+                      are regrouped.  The cell starts with the count bits (5 bits, the biggest count bits of any of
+                      its segments), the position bits (5 bits), and the byte offset of the lon offset stream, the
+                      byte offset of the lat offset stream, and the size of the cell in bytes (32 bits each).  Then
+                      there's a table with a fixed size record for each segment:
+
+
+                          count bits:    count of vertices in the segment
+                          5 bits:        lon offset bits
+                          5 bits:        lat offset bits
+                          18 bits:       lon bias + 2**17
+                          18 bits:       lat bias + 2**17
+                          26 bits:       start lon (times 100000)
+                          25 bits:       start lat (times 100000)
+                          position bits: bit position of the segment's first lon offset in the lon offset stream
+                          position bits: bit position of the segment's first lat offset in the lat offset stream
+
+
+                      That's followed by the lon offsets of every segment, then (starting on a byte boundary) the lat
+                      offsets of every segment, and 4 zero bytes.  Since the records are all the same size segment N
+                      can be read without reading the ones in front of it, and the decoder runs through the lon
+                      offsets and then the lat offsets instead of alternating between them.  If there's a segment
+                      index its segment offsets are the segment numbers.
+
 
   Caveats:        Requires shapelib version 1.2.10 or newer (many thanks to Frank Warmerdam for the library).
 
@@ -123,684 +183,1193 @@
                   original SWBD shape files.  The output file from this program is about 327MB in size.  The original,
                   uncompressed shapefiles use up about 3.5GB.  Even compressed, the original files are 840MB in size.
 
-                  The output file can be read using the read_coast function.  Note that this program and the read_coast
-                  function use the variable type definitions in build_swbd_pfm_nvtypes.h.  That file was created in the early
-                  1990's at the Naval Oceanographic Office and the type definitions are meant to be architecture independent.
+                  The output file can be read using the read_coast function (or the ccl_reader library that is built
+                  along with this program).  Note that this program and the read_coast function use the variable type
+                  definitions in build_swbd_pfm_nvtypes.h.  That file was created in the early 1990's at the Naval
+                  Oceanographic Office and the type definitions are meant to be architecture independent.
+
+
+  Arguments:      Options followed by the input directory and output file name, for example:
+
+                  build_swbd -j 32 /data1/SWBDdata coast_swbd.ccl
+
+                  The input directory can have the tiles as shape files or still in the zip archives that SWBD is
+                  distributed in (or a mix).  Every .zip file in the directory is searched for tiles (a .shp member
+                  with an SWBD tile name and its .shx) and they are inflated in memory as they're needed so there's
+                  no need to unpack the 3.5GB of shape files first.  If a tile is in both places the shape file wins.
+
+                  -j THREADS     Number of threads used to read the shape files and to pack the cells.  Each one-degree
+                                 cell has its own shape file so the cells are handed out to a work-stealing thread pool.
+                                 Packed cells are written to the output file, in order, by a separate writer thread.
+                                 Use 0 to use all of the processors.  The default is 1 and the most is 256.
+
+                  -Z, --zip-threads THREADS
+                                 Number of threads used to inflate tiles that are read straight out of zip archives.
+                                 The default is the same as -j (0 uses all of the processors).
+
+                  -a, --read-ahead FILES
+                                 Read the next FILES shape files (and their .shx files) into the system's file cache
+                                 while the cell workers are busy with the current ones, so that they don't sit idle
+                                 on every cold file open and read.  This is most of the win when the tiles are on
+                                 slow or remote storage.  Up to 16 I/O threads (one per file) use posix_fadvise to
+                                 queue all of a file's reads at once and then read it through.  The average and most
+                                 files ready and waiting when a worker needed one (queue depth) and the time the
+                                 workers spent waiting on the read-ahead are printed.  The default is 0 (no
+                                 read-ahead).  Tiles in zip archives are already read ahead by the -Z threads.
+
+                  -k KERNEL      Vertex conversion kernel, auto, scalar, sse4, or avx2.  The SSE4.1 and AVX2 kernels convert
+                                 2 or 4 points at a time and give bit for bit the same results as the scalar kernel.
+                                 The default is auto (the best one this processor supports).
+
+                  -m MEMORY_MB   Memory budget, in megabytes, for the segments read from the shape files.  They are kept
+                                 in memory until pass 2 packs them.  If the budget is exceeded the overflow is written to
+                                 a single OUTPUT_FILE.spill file which is unlinked as soon as it's created (so it's
+                                 never left behind).  The default is 0 (no limit).
+
+                  -r READER      Shape file reader, mmap or shapelib.  The mmap reader maps the .shp and .shx files and
+                                 reads the points in place without allocating anything per shape.  The shapelib reader
+                                 uses SHPReadObject.  They produce identical output.  The default is mmap (shapelib on
+                                 big endian systems).  Tiles in zip archives are always read in memory the same way
+                                 as the mmap reader.
+
+                  -u, --update   Update an existing output file instead of building it from scratch.  Every build writes
+                                 OUTPUT_FILE.manifest listing the shape files used for each cell with their size and
+                                 modification time (and a hash of their contents, filled in by -u when a file's size
+                                 or time has changed so that touching a file doesn't cause work).  With -u only the
+                                 cells whose files have changed (or that are new) are read and packed, the rest are
+                                 copied byte for byte from the old file.  The result is identical to a full build.  If the old file or its
+                                 manifest is missing everything is rebuilt.
+
+                  -s, --shard K/N
+                                 Only build shard K (1 to N) of N.  The shards are interleaved by rows of cells.  The
+                                 output only contains the cells in the shard.  Use "merge" to put the pieces together.
+
+                  -b, --band W,E,S,N
+                                 Only build the cells that overlap the lon/lat box (for regional products or to split
+                                 a build by area).  If W is greater than E the box crosses the date line.  This can be
+                                 combined with -s.
+
+                  merge OUTPUT_FILE PART_FILE [PART_FILE ...]
+                                 Merge the partial files from -s or -b builds.  The packed cells are copied without
+                                 decoding them and the header is rebuilt.  A cell may only be in one of the parts.  The
+                                 result is identical to building all of the cells at once.  The manifests are merged too
+                                 so the merged file can be updated with -u.
+
+                  -F, --format FORMAT
+                                 Output file format, 1 or 2.  Format 1 is the original V1.01 file that read_coast
+                                 understands, it can't be bigger than 2GB.  Format 2 (V2.00) has 64 bit cell addresses
+                                 (16 byte header entries) so there's no size limit.  The default is 1, or 2 if an
+                                 option that needs format 2 is used (asking for -F 1 with one of them is an error).
+
+                  -A, --align    Start each (non-empty) cell block on a 4KB page boundary so that a memory mapped reader
+                                 only faults in the pages for the cells it's reading.  This implies -F 2.
+
+                  -S, --stitch GAP
+                                 Join the segments in each cell whose ends meet (the end of one is no more than GAP arc
+                                 seconds from the start of the next in X and Y, 0 for exact matches only) into longer
+                                 segments and drop repeated points.  Cutting out the closure lines leaves a lot of short
+                                 pieces that each carry a segment header so this makes the file smaller and faster to
+                                 read.  Segments are only joined in the direction they were digitized (water is on the
+                                 right) and never across cells since each cell is packed on its own.  The GAP is saved
+                                 in the version string, -u rebuilds everything if it changes.
+
+                  -e, --entropy ORDER
+                                 Rice code the segments (see Cell records above) instead of giving every offset in a
+                                 segment the width of its biggest one.  With ORDER 1 the residuals are the deltas
+                                 between points.  With ORDER 2 each segment uses either the deltas or the change in
+                                 the deltas (delta of deltas), whichever is smaller, which helps on long smooth lines.
+                                 Use -D on the result to see the size in bits per vertex and the decode rate.  This
+                                 implies -F 2.
+
+                  -O, --columnar Write columnar cell blocks (see Cell records above), a table of fixed size segment
+                                 records followed by separate lon and lat offset streams, so that any segment in a
+                                 cell can be found without walking the ones in front of it.  This can't be used with
+                                 -e and implies -F 2.
+
+                  -K, --compress LEVEL
+                                 Also compress each cell block (and its levels of detail) on its own with zlib at LEVEL
+                                 (1 to 9, 1 is the fastest to build and 9 the smallest, they all inflate at about the
+                                 same speed).  Readers inflate a cell the first time they touch it.  Use -X to see
+                                 what each level costs on your data.  This implies -F 2.
+
+                  -L, --levels TOLERANCE[,TOLERANCE...]
+                                 Also build simplified levels of detail (up to 8) for drawing at smaller scales.  Each
+                                 TOLERANCE is in degrees, in increasing order, and the segments are simplified to it
+                                 using Douglas-Peucker.  Segments that fit in a TOLERANCE box are left out of that
+                                 level.  For example, -L 0.0005,0.005,0.05 for roughly 50m, 500m, and 5km.  This
+                                 implies -F 2.
+
+                  -I, --index    Also build a segment index with the bounding box of every segment and a grid of
+                                 sub-cells for each cell, so that a reader can find the segments in a small area
+                                 without decoding the whole cell.  This implies -F 2.
+
+                  -M, --metrics METRICS_FILE
+                                 Time each phase of the build and write a JSON report to METRICS_FILE when we're done
+                                 (metrics.c).  The phases are discovery (finding the tiles and building the manifest),
+                                 ingest (pass 1), read, conversion, and segmentation (how the pass 1 workers' time
+                                 in the shape files splits up), pack (pass 2), and encode and write (the encoders'
+                                 and the writer's time), each with wall and CPU seconds.  Read, conversion,
+                                 segmentation, encode, and write are added up over the threads and are reported
+                                 apart from the others, as thread_phases with thread_seconds.  The counters are
+                                 files, shapes, parts, vertices read, vertices dropped by the cell boundary check,
+                                 and the segments, vertices, bytes, and bits per vertex written at full resolution.
+                                 There are histograms of the segments' count bits and lon and lat offset bits (the
+                                 Rice parameters with -e) for the whole file and for each cell.  Cells copied by -u
+                                 only get their totals.
+
+                  -T             Check the vector conversion kernels against the scalar kernel and exit.  The exit
+                                 status is 0 if they match.
+
+                  -B             Benchmark the segment bit packing (the streaming bit writer against the old bit_pack
+                                 calls) on synthetic segments, check that they match, and exit.
+
+                  -Q W,E,S,N     Instead of building a file, query an existing .ccl file (the only argument) for all of
+                                 the segments in the cells that touch the lon/lat box using the reader library
+                                 (ccl_reader.c).  Everything found is decoded and checked against the cell index.  If
+                                 W is greater than E the box crosses the date line.
+
+                  -l LEVEL       Level of detail to query with -Q (0, the default, is full resolution).
+
+                  -c             Use the segment index to only return the segments whose bounding boxes touch the -Q
+                                 box.  The result is checked against decoding every segment in the cells.
+
+                  -D             Benchmark the segment decoders (scalar and AVX2) on an existing .ccl file (the only
+                                 argument), check that they match, and exit.
+
+                  -X             Benchmark cell block compression on an existing .ccl file (the only argument).  Each
+                                 full resolution cell block is compressed with no compression and zlib levels 1, 6, and
+                                 9 and the total size, compression rate, and the mean, median, and 99th percentile
+                                 time to inflate and decode a cell are printed so that a level can be picked for each
+                                 deployment.  The decoded cells are checked against the original.
+
+                  -C             Benchmark the decoded cell cache (ccl_cache.c) on an existing .ccl file (the only
+                                 argument) with -j threads doing lookups that mostly hit a small set of hot cells.  -m
+                                 sets the cache budget.  The lookup rate and the hit, miss, eviction, and corrupt cell
+                                 counts are printed and the cached cells are checked against a fresh decode.
+
+                  -P POINTS_FILE Instead of building a file, find the distance to the coastline and whether it's land or
+                                 water for each point in POINTS_FILE using an existing .ccl file (the first argument)
+                                 and write the results to the second argument (ccl_distance.c).  POINTS_FILE is
+                                 lon/lat pairs in degrees (native byte order doubles).  The output has lon, lat,
+                                 distance in meters (-1 if there is no coastline within -R meters), and land (1 for
+                                 land, 0 for water, -1 for unknown) for each point, also as doubles.  The points are
+                                 run in parallel on -j threads.
+
+                  -R METERS      How far to look for the coastline with -P and -E.  The default is 50000.
+
+                  -E             Benchmark the distance engine on an existing .ccl file (the only argument) with a
+                                 million random points in the cells that have data using -j threads.  The rate in
+                                 points per second is printed and some of the distances are checked against
+                                 decoding every nearby segment.
+
+*/
 
 
-  Arguments:      Input directory followed by output file name, for example:
+/*  Everything the pass 1 workers need.  */
 
-                  build_swbd /data1/SWBDdata coast_swbd.ccl
+typedef struct
+{
+  CELL_TASK         *task;
+  SEGMENT           *seg;
+  INGEST_STATS      *stats;
+  CELL_STORE        *store;
+  int32_t           reader;
+  ZIP_FEEDER        *feeder;                  /*  Inflates the tiles that are in zip archives  */
+  READ_AHEAD        *ahead;                   /*  Reads the other shape files into the file cache ahead of us  */
+} INGEST_JOB;
 
-*/
 
+/*  Everything the pass 2 encoders need.  */
 
-int32_t main (int32_t argc, char **argv)
+typedef struct
 {
-  SHPHandle         shpHandle;
-  SHPObject         *shape = NULL;
-  FILE              *tfp, *fp, *ofp;
-  int32_t           i, j, k, lnh, ln, lth, lt, ds, type, numShapes, numParts, total, diff_x[2], diff_y[2], num_vertices, segCount, *segx, *segy, file_ext;
-  int32_t           input_file_count, percent, old_percent, address, offset, xoff, yoff, num_segments, range_x, range_y, count_bits, lon_offset_bits;
-  int32_t           lat_offset_bits, size, bias_x, bias_y, pos, max_bias, lon_start, lon_end, lat_start, lat_end;
-  uint8_t           start_segment = NVFalse, file_check = NVFalse, bad_flag = NVFalse;
-  double            minBounds[4], maxBounds[4], lon, lat, cornerx[2], cornery[2], slon, slat;
-  char              fname[512], dirname[512], shpname[512], version[128], outname[512], lathem, lonhem, dataset[6] = {'a', 'e', 'f', 'i', 'n', 's'};
-  uint8_t           *buffer, head_buf[12];
+  CELL_STORE        *store;
+  CELL_WRITER       *writer;
+  ARENA             *scratch;
+  CCL_READER        *old;                     /*  The previous output file when updating  */
+  uint8_t           *reuse;                   /*  Set for cells that can be copied from old (NULL if not updating)  */
+  METRICS           *metrics;                 /*  NULL unless we're writing a metrics report  */
+} ENCODE_JOB;
 
 
-  printf ("\n\n%s\n\n", VERSION);
+/*  Everything the manifest workers need.  */
 
+typedef struct
+{
+  CELL_TASK         *task;
+  MANIFEST_ENTRY    *entry;
+  MANIFEST_ENTRY    *old;                     /*  The previous manifest when updating, otherwise NULL  */
+  uint8_t           *reuse;
+} MANIFEST_JOB;
 
-  if (argc < 3)
-    {
-      fprintf (stderr, "Usage: %s INPUT_DIR OUTPUT_FILE\n", argv[0]);
-      fprintf (stderr, "If the output file name does not have a .ccl extension it will be added.\n");
-      exit (-1);
-    }
 
 
-  strcpy (dirname, argv[1]);
+static void usage (char *name)
+{
+  fprintf (stderr, "Usage: %s [-j THREADS] [-Z THREADS] [-a FILES] [-k auto|scalar|sse4|avx2] [-m MEMORY_MB] "
+           "[-r mmap|shapelib] [-u] [-s K/N] [-b W,E,S,N] [-F 1|2] [-A] [-S GAP] [-e 1|2 | -O] [-K LEVEL] [-L TOL,...] "
+           "[-I] [-M METRICS_FILE] INPUT_DIR OUTPUT_FILE\n", name);
+  fprintf (stderr, "       %s merge OUTPUT_FILE PART_FILE [PART_FILE ...]\n", name);
+  fprintf (stderr, "       %s -T\n", name);
+  fprintf (stderr, "       %s -B\n", name);
+  fprintf (stderr, "       %s [-l LEVEL] [-c] -Q WEST,EAST,SOUTH,NORTH CCL_FILE\n", name);
+  fprintf (stderr, "       %s -D CCL_FILE\n", name);
+  fprintf (stderr, "       %s -X CCL_FILE\n", name);
+  fprintf (stderr, "       %s [-j THREADS] [-m MEMORY_MB] -C CCL_FILE\n", name);
+  fprintf (stderr, "       %s [-j THREADS] [-R METERS] -P POINTS_FILE CCL_FILE OUTPUT_FILE\n", name);
+  fprintf (stderr, "       %s [-j THREADS] [-R METERS] -E CCL_FILE\n", name);
+  fprintf (stderr, "If the output file name does not have a .ccl extension it will be added.\n");
+  exit (-1);
+}
 
 
-  /*  Initialize variables  */
 
-  input_file_count = 0;
-  total = 0;
-  segx = NULL;
-  segy = NULL;
-  fp = NULL;
-  lon = -999.0;
-  lat = -999.0;
+/*  Add the time since *start to a phase of the metrics report (if we're writing one) and start the next phase.  */
 
+static void end_phase (METRICS *report, int32_t phase, METRICS_TIME *start)
+{
+  METRICS_TIME      now;
 
-  /*  Make sure we don't have any old cell files hanging around in case we crashed previously.  */
 
-  for (i = 0 ; i < 180 ; i++)
-    {
-      for (j = 0 ; j < 360 ; j++)
-        {
-          sprintf (fname, "cell_%03d_%03d", j, i);
-          remove (fname);
-        }
-    }
+  if (report == NULL) return;
 
+  metrics_clock (&now);
+  metrics_add (&report->phase[phase], start, &now);
 
-  /*  Loop for both hemispheres.  */
+  *start = now;
+}
 
-  for (lnh = 0 ; lnh < 2 ; lnh++)
-    {
-      if (lnh)
-        {
-          lonhem = 'e';
-          lon_start = 0;
-          lon_end = 180;
-        }
-      else
-        {
-          lonhem = 'w';
-          lon_start = 1;
-          lon_end = 181;
-        }
 
 
-      /*  Loop throught the longitudes.  */
+static void ingest_task (int32_t task, int32_t thread, void *data)
+{
+  INGEST_JOB        *job = (INGEST_JOB *) data;
 
-      for (ln = lon_start ; ln < lon_end ; ln++)
-        {
+  ingest_cell (&job->task[task], &job->seg[thread], &job->stats[thread], job->store, job->reader, job->feeder,
+               job->ahead, task);
+}
 
 
-          /*  Loop for both hemispheres.  */
 
-          for (lth = 0 ; lth < 2 ; lth++)
-            {
-              if (lth)
-                {
-                  lathem = 'n';
-                  lat_start = 0;
-                  lat_end = 90;
-                }
-              else
-                {
-                  lathem = 's';
-                  lat_start = 1;
-                  lat_end = 91;
-                }
+/*  Fill in the manifest entry for a cell and, when updating, decide if the cell can be copied from the old file.  */
 
+static void manifest_task (int32_t task, int32_t thread, void *data)
+{
+  MANIFEST_JOB      *job = (MANIFEST_JOB *) data;
+  MANIFEST_ENTRY    *entry, *old;
+  int32_t           cell, status;
+  uint8_t           zipped;
 
-              /*  Loop through the latitudes.  */
 
-              for (lt = lat_start ; lt < lat_end ; lt++)
-                {
-                  file_check = NVFalse;
+  (void) thread;
 
+  cell = job->task[task].y * CELL_COLS + job->task[task].x;
+  entry = &job->entry[cell];
 
-                  /*  Check to make sure we have a valid file before we open the output file.  */
 
-                  for (ds = 0 ; ds < 6 ; ds++)
-                    {
-                      sprintf (shpname, "%s/%1c%03d%1c%02d%1c.shp", dirname, lonhem, ln, lathem, lt, dataset[ds]);
+  /*  Tiles in zip archives get their hash from the archive's CRCs so it's already done.  */
 
+  zipped = (job->task[task].zip.zipname[0] != 0);
 
-                      /*  Make sure the file exists before we try to open it with the shape library.  */
+  if (zipped)
+    {
+      status = manifest_stat_zip (job->task[task].shpname, &job->task[task].zip, entry);
+    }
+  else
+    {
+      status = manifest_stat (job->task[task].shpname, entry);
+    }
 
-                      if ((tfp = fopen (shpname, "rb")) != NULL)
-                        {
-                          file_check = NVTrue;
-                          file_ext = ds;
-                          fclose (tfp);
-                          break;
-                        }
-                    }
+  if (status)
+    {
+      perror (job->task[task].shpname);
+      exit (-1);
+    }
 
 
-                  if (file_check)
-                    {
-                      /*  Figure out where the boundaries of the one degree cell are and build the output (temporary) filename.  */
+  /*  Same file, same size, same time, we don't even need to look at it.  */
 
-                      if (lnh)
-                        {
-                          if (lth)
-                            {
-                              sprintf (fname, "cell_%03d_%03d", ln + 180, lt + 90);
+  old = (job->old != NULL) ? &job->old[cell] : NULL;
 
-                              cornerx[0] = (ln + 180) * 3600.0;
-                              cornerx[1] = (ln + 181) * 3600.0;
-                              cornery[0] = (lt + 90) * 3600.0;
-                              cornery[1] = (lt + 91) * 3600.0;
-                            }
-                          else
-                            {
-                              sprintf (fname, "cell_%03d_%03d", ln + 180, -lt + 90);
+  if (old != NULL && old->valid && !strcmp (old->path, entry->path) && old->size == entry->size &&
+      old->mtime == entry->mtime)
+    {
+      entry->hash = old->hash;
+      job->reuse[cell] = NVTrue;
+      return;
+    }
 
-                              cornerx[0] = (ln + 180) * 3600.0;
-                              cornerx[1] = (ln + 181) * 3600.0;
-                              cornery[0] = (-lt + 90) * 3600.0;
-                              cornery[1] = (-lt + 91) * 3600.0;
-                            }
-                        }
-                      else
-                        {
-                          if (lth)
-                            {
-                              sprintf (fname, "cell_%03d_%03d", -ln + 180, lt + 90);
+  /*  Only an update needs the hash, a full build would just be reading all of the input twice.  */
 
-                              cornerx[0] = (-ln + 180) * 3600.0;
-                              cornerx[1] = (-ln + 181) * 3600.0;
-                              cornery[0] = (lt + 90) * 3600.0;
-                              cornery[1] = (lt + 91) * 3600.0;
-                            }
-                          else
-                            {
-                              sprintf (fname, "cell_%03d_%03d", -ln + 180, -lt + 90);
+  if (old == NULL) return;
 
-                              cornerx[0] = (-ln + 180) * 3600.0;
-                              cornerx[1] = (-ln + 181) * 3600.0;
-                              cornery[0] = (-lt + 90) * 3600.0;
-                              cornery[1] = (-lt + 91) * 3600.0;
-                            }
-                        }
+  if (!zipped && manifest_hash (entry))
+    {
+      perror (job->task[task].shpname);
+      exit (-1);
+    }
 
+  if (old->valid && old->hash && old->size == entry->size && old->hash == entry->hash) job->reuse[cell] = NVTrue;
+}
 
-                      /*  Open the output file.  */
 
-                      if ((fp = fopen (fname, "ab")) == NULL)
-                        {
-                          perror (fname);
-                          exit (-1);
-                        }
 
+static void encode_task (int32_t task, int32_t thread, void *data)
+{
+  ENCODE_JOB        *job = (ENCODE_JOB *) data;
+  CELL_BLOCK        *block;
+  METRICS_CELL      *metrics;
+  METRICS_TIME      start, end;
+  int32_t           cell;
 
-                      /*  Define the input shape file name.  */
 
-                      sprintf (shpname, "%s/%1c%03d%1c%02d%1c.shp", dirname, lonhem, ln, lathem, lt, dataset[file_ext]);
+  block = cell_writer_acquire (job->writer, task);
 
+  cell = job->writer->cell[task];
 
-                      input_file_count++;
+  metrics = NULL;
+  if (job->metrics != NULL)
+    {
+      metrics = metrics_cell (job->metrics, cell);
+      metrics_thread_clock (&start);
+    }
 
+  if (job->reuse != NULL && job->reuse[cell])
+    {
+      copy_cell (job->old, cell % CELL_COLS, cell / CELL_COLS, block);
 
-                      /*  Initialize loop variables  */
+      if (metrics != NULL) metrics->copied = NVTrue;
+    }
+  else
+    {
+      encode_cell (job->store, cell % CELL_COLS, cell / CELL_COLS, block, &job->scratch[thread], job->writer->stitch,
+                   job->writer->coding, job->writer->columnar, job->writer->compression, job->writer->num_levels,
+                   job->writer->tolerance, metrics);
+    }
 
-                      segCount = 0;
-                      percent = 0;
-                      old_percent = -1;
+  if (metrics != NULL)
+    {
+      metrics_thread_clock (&end);
+      metrics_add (&job->metrics->thread[thread], &start, &end);
 
+      metrics->segments = block->num_segments;
+      metrics->vertices = block->num_vertices;
+      metrics->bytes = block->size;
+    }
 
-                      /*  Open shape file  */
+  cell_writer_submit (job->writer, task);
+}
 
-                      shpHandle = SHPOpen (shpname, "rb");
 
-                      if (shpHandle == NULL)
-                        {
-                          perror (shpname);
-                          exit (-1);
-                        }
 
+int32_t main (int32_t argc, char **argv)
+{
+  FILE              *ofp;
+  int32_t           i, j, total, unchanged, removed;
+  int32_t           num_threads, num_tasks, num_cells, option_index, kernel, *cell, shard, num_shards;
+  int32_t           format, alignment, num_levels, tolerance[CCL_MAX_LEVELS + 1], level, stitch, compression, coding;
+  uint8_t           query, decode, cache, update, *reuse, segment_index, clip, distance_bench, compress_bench, columnar;
+  int32_t           zip_threads, num_zipped, read_ahead;
+  ZIP_FEEDER        feeder;
+  ZIP_SOURCE        **source;
+  READ_AHEAD        ahead;
+  char              **ahead_name, *metrics_name;
+  METRICS           metrics, *report;
+  METRICS_TIME      build_start, stage_start;
+  double            west, east, south, north, band[4], *band_ptr;
+  int64_t           budget;
+  char              fname[512], dirname[512], outname[512], writename[512], manifest_name[512], *file_version, *ptr;
+  double            value, max_distance;
+  char              *points_name;
+  CELL_TASK         *task;
+  INGEST_JOB        job;
+  ENCODE_JOB        encode;
+  MANIFEST_JOB      mjob;
+  MANIFEST_ENTRY    *manifest, *old_manifest;
+  CCL_READER        old;
+  CELL_STORE        store;
+  CELL_WRITER       writer;
+  ARENA_COUNTERS    pass1_counters, pass2_counters;
+  extern char       *optarg;
+  extern int        optind;
+  static struct option long_options[] = {{"update", no_argument, NULL, 'u'},
+                                         {"shard", required_argument, NULL, 's'},
+                                         {"band", required_argument, NULL, 'b'},
+                                         {"format", required_argument, NULL, 'F'},
+                                         {"align", no_argument, NULL, 'A'},
+                                         {"stitch", required_argument, NULL, 'S'},
+                                         {"compress", required_argument, NULL, 'K'},
+                                         {"entropy", required_argument, NULL, 'e'},
+                                         {"columnar", no_argument, NULL, 'O'},
+                                         {"zip-threads", required_argument, NULL, 'Z'},
+                                         {"read-ahead", required_argument, NULL, 'a'},
+                                         {"metrics", required_argument, NULL, 'M'},
+                                         {"levels", required_argument, NULL, 'L'},
+                                         {"index", no_argument, NULL, 'I'},
+                                         {NULL, 0, NULL, 0}};
 
-                      fprintf (stderr,"Reading %s                        \r", shpname);
-                      fflush (stderr);
 
+  printf ("\n\n%s\n\n", VERSION);
 
-                      /*  Get shape file header info  */
 
-                      SHPGetInfo (shpHandle, &numShapes, &type, minBounds, maxBounds);
+  num_threads = 1;
+  zip_threads = 0;
+  read_ahead = 0;
+  metrics_name = NULL;
+  budget = 0;
+  job.reader = shp_map_supported () ? READER_MMAP : READER_SHAPELIB;
+  kernel = KERNEL_AUTO;
+  query = decode = cache = update = segment_index = clip = distance_bench = compress_bench = columnar = NVFalse;
+  shard = num_shards = 1;
+  format = 0;
+  alignment = 1;
+  stitch = -1;
+  compression = coding = 0;
+  num_levels = level = 0;
+  memset (tolerance, 0, sizeof (tolerance));
+  band_ptr = NULL;
+  points_name = NULL;
+  max_distance = 50000.0;
+
+
+  /*  Merging partial files from a sharded build.  */
+
+  if (argc > 1 && !strcmp (argv[1], "merge"))
+    {
+      if (argc < 4) usage (argv[0]);
 
+      strcpy (outname, argv[2]);
+      if (strcmp (&outname[strlen (outname) - 4], ".ccl")) sprintf (outname, "%s.ccl", argv[2]);
 
-                      /*  Read all shapes  */
+      exit (merge_files (outname, argc - 3, &argv[3]));
+    }
 
-                      bad_flag = NVFalse;
-                      for (i = 0 ; i < numShapes ; i++)
-                        {
-                          shape = SHPReadObject (shpHandle, i);
+  west = east = south = north = 0.0;
 
-                          total += shape->nVertices;
+  while ((option_index = getopt_long (argc, argv, "ABCDEF:IK:L:M:OP:Q:R:S:XZ:a:b:ce:j:k:l:m:r:s:Tu", long_options, NULL)) != EOF)
+    {
+      switch (option_index)
+        {
+        case 'k':
+          if (!strcmp (optarg, "scalar"))
+            {
+              kernel = KERNEL_SCALAR;
+            }
+          else if (!strcmp (optarg, "sse4"))
+            {
+              kernel = KERNEL_SSE4;
+            }
+          else if (!strcmp (optarg, "avx2"))
+            {
+              kernel = KERNEL_AVX2;
+            }
+          else if (strcmp (optarg, "auto"))
+            {
+              usage (argv[0]);
+            }
+          break;
 
+        case 'T':
+          exit (convert_self_test () ? -1 : 0);
+          break;
 
-                          /*  Get all vertices  */
+        case 'B':
+          exit (encode_benchmark () ? -1 : 0);
+          break;
 
-                          if (shape->nVertices >= 2)
-                            {
-                              for (j = 0, numParts = 1 ; j < shape->nVertices ; j++)
-                                {
-                                  start_segment = NVFalse;
+        case 'C':
+          cache = NVTrue;
+          break;
 
+        case 'D':
+          decode = NVTrue;
+          break;
 
-                                  /*  Check for start of a new segment.  */
+        case 'X':
+          compress_bench = NVTrue;
+          break;
 
-                                  if (!j && shape->nParts > 0) start_segment = NVTrue;
+        case 'Q':
+          if (sscanf (optarg, "%lf,%lf,%lf,%lf", &west, &east, &south, &north) != 4) usage (argv[0]);
+          query = NVTrue;
+          break;
 
+        case 'r':
+          if (!strcmp (optarg, "shapelib"))
+            {
+              job.reader = READER_SHAPELIB;
+            }
+          else if (!strcmp (optarg, "mmap"))
+            {
+              if (!shp_map_supported ())
+                {
+                  fprintf (stderr, "The mmap reader is only available on little endian systems.\n");
+                  exit (-1);
+                }
 
-                                  /*  If the previous point was directly on a boundary it was probably a closure line (SWBD shape files
-                                      are closed polygons that define areas of water) so we throw it out.  */
+              job.reader = READER_MMAP;
+            }
+          else
+            {
+              usage (argv[0]);
+            }
+          break;
 
-                                  if (bad_flag)
-                                    {
-                                      start_segment = NVTrue;
-                                      bad_flag = NVFalse;
-                                    }
+        case 'm':
+          if (sscanf (optarg, "%"PRId64, &budget) != 1 || budget <= 0) usage (argv[0]);
+          budget *= 1024 * 1024;
+          break;
 
+        case 'u':
+          update = NVTrue;
+          break;
 
-                                  /*  Check for the start of a new segment inside a larger group of points (this would be a "Ring" point).  */
+        case 'F':
+          if (sscanf (optarg, "%d", &format) != 1 || (format != CCL_FORMAT_1 && format != CCL_FORMAT_2)) usage (argv[0]);
+          break;
 
-                                  if (numParts < shape->nParts && shape->panPartStart[numParts] == j)
-                                    {
-                                      start_segment = NVTrue;
-                                      numParts++;
-                                    }
+        case 'A':
+          alignment = CCL_PAGE_SIZE;
+          break;
 
+        case 'S':
+          if (sscanf (optarg, "%lf", &value) != 1 || value < 0.0 || value > 3600.0) usage (argv[0]);
+          stitch = NINT (value * CCL_SCALE / 3600.0);
+          break;
 
-                                  /*  Bias lat and lon by 90 and 180 so that all points are positive  */
+        case 'K':
+          if (sscanf (optarg, "%d", &compression) != 1 || compression < 1 || compression > 9) usage (argv[0]);
+          break;
 
-                                  lon = shape->padfX[j] + 180.0;
-                                  lat = shape->padfY[j] + 90.0;
+        case 'e':
+          if (sscanf (optarg, "%d", &coding) != 1 || coding < 1 || coding > 2) usage (argv[0]);
+          break;
 
+        case 'L':
+          num_levels = 0;
+          for (ptr = strtok (optarg, ",") ; ptr != NULL ; ptr = strtok (NULL, ","))
+            {
+              if (num_levels == CCL_MAX_LEVELS || sscanf (ptr, "%lf", &value) != 1) usage (argv[0]);
 
-                                  /*  Position in seconds to be compared with the cell boundaries.  */
+              num_levels++;
+              tolerance[num_levels] = NINT (value * CCL_SCALE);
 
-                                  slon = lon * 3600.0;
-                                  slat = lat * 3600.0;
+              if (tolerance[num_levels] <= tolerance[num_levels - 1]) usage (argv[0]);
+            }
+          break;
+
+        case 'l':
+          if (sscanf (optarg, "%d", &level) != 1 || level < 0 || level > CCL_MAX_LEVELS) usage (argv[0]);
+          break;
+
+        case 'I':
+          segment_index = NVTrue;
+          break;
+
+        case 'O':
+          columnar = NVTrue;
+          break;
+
+        case 'c':
+          clip = NVTrue;
+          break;
+
+        case 'P':
+          points_name = optarg;
+          break;
+
+        case 'E':
+          distance_bench = NVTrue;
+          break;
+
+        case 'R':
+          if (sscanf (optarg, "%lf", &max_distance) != 1 || max_distance <= 0.0) usage (argv[0]);
+          break;
+
+        case 's':
+          if (sscanf (optarg, "%d/%d", &shard, &num_shards) != 2 || num_shards < 1 || shard < 1 || shard > num_shards)
+            usage (argv[0]);
+          break;
+
+        case 'b':
+          if (sscanf (optarg, "%lf,%lf,%lf,%lf", &band[0], &band[1], &band[2], &band[3]) != 4) usage (argv[0]);
+          band_ptr = band;
+          break;
+
+        case 'j':
+          if (sscanf (optarg, "%d", &num_threads) != 1 || num_threads < 0 || num_threads > MAX_THREADS) usage (argv[0]);
+          if (!num_threads) num_threads = MIN (pool_cpu_count (), MAX_THREADS);
+          break;
+
+        case 'Z':
+          if (sscanf (optarg, "%d", &zip_threads) != 1) usage (argv[0]);
+          if (zip_threads <= 0) zip_threads = pool_cpu_count ();
+          break;
+
+        case 'a':
+          if (sscanf (optarg, "%d", &read_ahead) != 1 || read_ahead < 0) usage (argv[0]);
+          break;
+
+        case 'M':
+          metrics_name = optarg;
+          break;
+
+        default:
+          usage (argv[0]);
+          break;
+        }
+    }
 
 
-                                  /*  Check for points (almost) exactly on any of the boundaries.  The longitudes get a bit fuzzy as we move
-                                      farther away from the equator.  We may lose a point or two here or there but we're trying to make coastline
-                                      not containers.  */
+  if (cache)
+    {
+      if (argc - optind < 1) usage (argv[0]);
 
-                                  if (fabs (slon - cornerx[0]) < 1.00000000000000015 || fabs (slon - cornerx[1]) < 1.00000000000000015 ||
-                                      fabs (slat - cornery[0]) < 1.0 || fabs (slat - cornery[1]) < 1.0)
-                                    {
-                                      bad_flag = NVTrue;
-                                    }
-                                  else
-                                    {
-                                      /*  Damn boundary conditions!  */
+      exit (cache_benchmark (argv[optind], num_threads, budget) ? -1 : 0);
+    }
 
-                                      if (lon == 360.0) lon = 359.99999;
 
+  if (distance_bench)
+    {
+      if (argc - optind < 1) usage (argv[0]);
 
-                                      /*  Start a new segment  */
+      exit (distance_benchmark (argv[optind], num_threads, max_distance) ? -1 : 0);
+    }
 
-                                      if (start_segment)
-                                        {
-                                          /*  Close last segment, start new segment  */
 
-                                          if (segCount > 1)
-                                            {
-                                              fwrite (&segCount, sizeof (int32_t), 1, fp);
+  if (points_name != NULL)
+    {
+      if (argc - optind < 2) usage (argv[0]);
 
-                                              for (k = 0 ; k < segCount ; k++)
-                                                {
-                                                  fwrite (&segx[k], sizeof (int32_t), 1, fp);
-                                                  fwrite (&segy[k], sizeof (int32_t), 1, fp);
-                                                }
-                                            }
+      exit (distance_points (argv[optind], points_name, argv[optind + 1], num_threads, max_distance) ? -1 : 0);
+    }
 
-                                          segCount = 0;
-                                        }
 
+  if (decode)
+    {
+      if (argc - optind < 1) usage (argv[0]);
 
-                                      /*  Allocate memory for the new point.  */
+      exit (decode_benchmark (argv[optind]) ? -1 : 0);
+    }
 
-                                      segx = (int32_t *) realloc (segx, (segCount + 1) * sizeof (int32_t));
-                                      if (segx == NULL)
-                                        {
-                                          perror ("Allocating segx memory");
-                                          exit (-1);
-                                        }
 
-                                      segy = (int32_t *) realloc (segy, (segCount + 1) * sizeof (int32_t));
-                                      if (segy == NULL)
-                                        {
-                                          perror ("Allocating segy memory");
-                                          exit (-1);
-                                        }
+  if (compress_bench)
+    {
+      if (argc - optind < 1) usage (argv[0]);
 
+      exit (compress_benchmark (argv[optind]) ? -1 : 0);
+    }
 
-                                      /*  Add point to current segment  */
 
-                                      segx[segCount] = NINT (lon * 100000.0);
-                                      segy[segCount] = NINT (lat * 100000.0);
+  if (query)
+    {
+      if (argc - optind < 1) usage (argv[0]);
 
+      exit (query_box (argv[optind], level, clip, west, east, south, north) ? -1 : 0);
+    }
 
-                                      /*  Increment the point counter.  */
 
-                                      segCount++;
-                                    }
-                                }
-                            }
+  if (argc - optind < 2) usage (argv[0]);
 
 
-                          /*  Destroy the shape object.  */
+  /*  Columnar blocks are laid out from the fixed width segment fields so they can't be Rice coded.  */
 
-                          SHPDestroyObject (shape);
-                        }
+  if (columnar && coding) usage (argv[0]);
 
 
-                      /*  Close out the last segment is it's not already closed.  */
+  /*  Aligned cell blocks, Rice coding, columnar blocks, compression, levels of detail, and the segment index are only
+      in format 2.  They imply -F 2 unless -F 1 was asked for, which is an error.  */
 
-                      if (segCount > 1)
-                        {
-                          fwrite (&segCount, sizeof (int32_t), 1, fp);
+  if (alignment > 1 || coding || columnar || compression || num_levels || segment_index)
+    {
+      if (format == CCL_FORMAT_1) usage (argv[0]);
+      format = CCL_FORMAT_2;
+    }
 
-                          for (k = 0 ; k < segCount ; k++)
-                            {
-                              fwrite (&segx[k], sizeof (int32_t), 1, fp);
-                              fwrite (&segy[k], sizeof (int32_t), 1, fp);
-                            }
+  if (!format) format = CCL_FORMAT_1;
 
-                          segCount = 0;
-                        }
+  file_version = (format == CCL_FORMAT_2) ? FILE_VERSION_2 : FILE_VERSION;
 
 
-                      /*  Close the input file.  */
+  if ((kernel = convert_select (kernel)) < 0)
+    {
+      fprintf (stderr, "The requested conversion kernel is not supported by this processor.\n");
+      exit (-1);
+    }
 
-                      SHPClose (shpHandle);
+  fprintf (stderr, "Using the %s vertex conversion kernel\n\n", convert_name (kernel));
 
 
-                      /*  Close the temporary output file.  */
+  strcpy (dirname, argv[optind]);
 
-                      fclose (fp);
-                    }
-                }
-            }
-        }
-    }
 
+  /*  Start the clock for the metrics report.  */
 
-  /*  Free the segment memory.  */
+  report = NULL;
+  if (metrics_name != NULL)
+    {
+      metrics_init (&metrics, num_threads);
+      report = &metrics;
 
-  if (segx != NULL) free (segx);
-  if (segy != NULL) free (segy);
+      metrics_clock (&build_start);
+      stage_start = build_start;
+    }
 
 
-  /*  Set the loop variables.  */
+  /*  Initialize variables  */
 
-  percent = 0;
-  old_percent = -1;
   total = 0;
 
 
   /*  Create the final output file name.  */
 
-  strcpy (outname, argv[2]);
-  if (strcmp (&outname[strlen (outname) - 4], ".ccl")) sprintf (outname, "%s.ccl", argv[2]);
+  strcpy (outname, argv[optind + 1]);
+  if (strcmp (&outname[strlen (outname) - 4], ".ccl")) sprintf (outname, "%s.ccl", argv[optind + 1]);
 
 
-  fprintf (stderr,"\n\n%s\n\n", outname);
-  fflush (stderr);
+  /*  Pass 1 output is kept in memory.  If we go over the memory budget the overflow goes to a single spill file next to
+      the output file.  */
+
+  sprintf (fname, "%s.spill", outname);
+  cell_store_init (&store, budget, fname);
 
 
-  /*  Try to open the output file.  */
+  /*  Build the list of input files from the tiles in the input directory.  */
 
-  if ((ofp = fopen (outname, "wb")) == NULL)
+  task = (CELL_TASK *) calloc (CELL_ROWS * CELL_COLS, sizeof (CELL_TASK));
+  if (task == NULL)
     {
-      perror (outname);
+      perror ("Allocating task memory");
       exit (-1);
     }
 
+  num_tasks = discover_cells (dirname, task);
 
-  /*  Write the header  */
 
-  memset (version, 0, 128);
-  sprintf (version, "%s\n", FILE_VERSION);
-  fprintf(stderr,"%s\n",version);
-  fflush (stderr);
-  fwrite (version, 128, 1, ofp);
+  /*  Only build our piece of a sharded or regional build.  */
+
+  if (num_shards > 1 || band_ptr != NULL)
+    {
+      num_tasks = select_cells (task, num_tasks, shard, num_shards, band_ptr);
+
+      fprintf (stderr, "%d cells selected", num_tasks);
+      if (num_shards > 1) fprintf (stderr, " for shard %d of %d", shard, num_shards);
+      if (band_ptr != NULL) fprintf (stderr, " in %.5f %.5f %.5f %.5f", band[0], band[1], band[2], band[3]);
+      fprintf (stderr, "\n\n");
+    }
+
+
+  /*  Build the manifest for the new file.  If we're updating an existing file we compare against its manifest to find
+      the cells that can just be copied from it.  */
+
+  manifest = (MANIFEST_ENTRY *) calloc (CELL_ROWS * CELL_COLS, sizeof (MANIFEST_ENTRY));
+  if (manifest == NULL)
+    {
+      perror ("Allocating manifest memory");
+      exit (-1);
+    }
 
+  sprintf (manifest_name, "%s.manifest", outname);
 
-  /*  Initialize the header area  */
+  mjob.task = task;
+  mjob.entry = manifest;
+  mjob.old = old_manifest = NULL;
+  mjob.reuse = reuse = NULL;
+  memset (&old, 0, sizeof (CCL_READER));
 
-  for (i = 0 ; i < 180 ; i++)
+  if (update)
     {
-      for (j = 0 ; j < 360 ; j++)
+      old_manifest = (MANIFEST_ENTRY *) calloc (CELL_ROWS * CELL_COLS, sizeof (MANIFEST_ENTRY));
+      reuse = (uint8_t *) calloc (CELL_ROWS * CELL_COLS, sizeof (uint8_t));
+
+      if (old_manifest == NULL || reuse == NULL)
         {
-          offset = (i * 360 + j) * (3 * sizeof (int32_t)) + 128;
+          perror ("Allocating manifest memory");
+          exit (-1);
+        }
+
+      if (manifest_read (manifest_name, file_version, old_manifest) || ccl_open (&old, outname) ||
+          !cell_writer_matches (&old, format, alignment, stitch, coding, columnar, compression, num_levels,
+                                tolerance, segment_index))
+        {
+          fprintf (stderr, "%s or %s is missing or out of date, rebuilding everything.\n\n", outname, manifest_name);
+
+          if (old.file.data != NULL) ccl_close (&old);
+          free (old_manifest);
+          free (reuse);
+          old_manifest = NULL;
+          reuse = NULL;
+          update = NVFalse;
+        }
+      else
+        {
+          mjob.old = old_manifest;
+          mjob.reuse = reuse;
+        }
+    }
 
-          address = 0;
-          num_segments = 0;
-          num_vertices = 0;
+  pool_run (num_threads, num_tasks, manifest_task, &mjob);
 
-          fseek (ofp, offset, SEEK_SET);
 
-          pos = 0;
-          bit_pack (head_buf, pos, 8 * sizeof (int32_t), address); pos += (8 * sizeof (int32_t));
-          bit_pack (head_buf, pos, 8 * sizeof (int32_t), num_segments); pos += (8 * sizeof (int32_t));
-          bit_pack (head_buf, pos, 8 * sizeof (int32_t), num_vertices);
+  /*  When updating, only the changed cells get read.  The unchanged ones are still marked as present so that they get
+      copied from the old file.  */
 
-          fwrite (head_buf, 3 * sizeof (int32_t), 1, ofp);
+  if (update)
+    {
+      unchanged = 0;
+      for (i = 0, j = 0 ; i < num_tasks ; i++)
+        {
+          if (reuse[task[i].y * CELL_COLS + task[i].x])
+            {
+              cell_store_touch (&store, task[i].x, task[i].y);
+              unchanged++;
+            }
+          else
+            {
+              task[j++] = task[i];
+            }
         }
+
+      removed = 0;
+      for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++) if (old_manifest[i].valid && !manifest[i].valid) removed++;
+
+      fprintf (stderr, "Updating %s, %d cells unchanged, %d cells to re-encode, %d cells removed\n\n", outname,
+               unchanged, j, removed);
+      fflush (stderr);
+
+      num_tasks = j;
     }
 
 
-  /*  Compute the maximum delta value.  */
+  end_phase (report, METRICS_DISCOVERY, &stage_start);
 
-  max_bias = (int32_t) (pow (2.0, 17.0) - 1.0);
 
+  /*  Read the shape files.  Each thread gets its own segment buffer and counters.  */
 
-  /*  Latitude loop.  */
+  job.task = task;
+  job.store = &store;
+  job.seg = (SEGMENT *) calloc (num_threads, sizeof (SEGMENT));
+  job.stats = (INGEST_STATS *) calloc (num_threads, sizeof (INGEST_STATS));
 
-  for (i = 0 ; i < 180 ; i++)
+  if (job.seg == NULL || job.stats == NULL)
     {
+      perror ("Allocating thread memory");
+      exit (-1);
+    }
 
+  for (i = 0 ; i < num_threads ; i++) job.stats[i].timed = (report != NULL);
 
-      /*  Longitude loop.  */
 
-      for (j = 0 ; j < 360 ; j++)
-        {
-          num_segments = 0;
-          num_vertices = 0;
+  /*  Tiles in zip archives are inflated by their own pool of threads that runs ahead of the cell workers and, with
+      -a, the other shape files are read into the file cache by another one.  Both go through the tiles in order so
+      the workers have to as well (the work-stealing pool would have every thread but the first waiting on a tile
+      nobody has gotten to yet).  */
 
+  source = (ZIP_SOURCE **) calloc (MAX (num_tasks, 1), sizeof (ZIP_SOURCE *));
+  ahead_name = (char **) calloc (MAX (num_tasks, 1), sizeof (char *));
 
-          /*  Define the input (temporary) file name.  */
+  if (source == NULL || ahead_name == NULL)
+    {
+      perror ("Allocating decompression memory");
+      exit (-1);
+    }
 
-          sprintf (fname, "cell_%03d_%03d", j, i);
+  for (i = 0, num_zipped = 0 ; i < num_tasks ; i++)
+    {
+      source[i] = &task[i].zip;
 
+      if (task[i].zip.zipname[0])
+        {
+          num_zipped++;
+        }
+      else
+        {
+          ahead_name[i] = task[i].shpname;
+        }
+    }
 
-          /*  Try to open the input file.  */
+  job.feeder = NULL;
+  job.ahead = NULL;
 
-          if ((fp = fopen (fname, "rb")) != NULL)
-            {
+  if (num_zipped)
+    {
+      if (!shp_map_supported ())
+        {
+          fprintf (stderr, "Reading tiles from zip archives isn't supported on this system, unpack them first.\n");
+          exit (-1);
+        }
 
-              /*  Compute the offset in the header at which to write the address, the number of segments, and the number of vertices.  */
+      if (zip_threads <= 0) zip_threads = num_threads;
 
-              offset = (i * 360 + j) * (3 * sizeof (int32_t)) + 128;
-              address = ftell (ofp);
+      zip_feeder_start (&feeder, num_tasks, source, zip_threads, 2 * (num_threads + zip_threads));
+      job.feeder = &feeder;
+    }
 
 
-              /*  Read the segment count from the input file.  */
+  /*  Each worker holds on to the file it's reading so the window is the read-ahead plus the number of workers.  */
 
-              while (fread (&segCount, sizeof (int32_t), 1, fp))
-                {
-                  /*  Just in case we happened to write an empty (or single point) segment between files ;-)  */
+  if (read_ahead && num_zipped < num_tasks)
+    {
+      read_ahead_start (&ahead, num_tasks, ahead_name, read_ahead, read_ahead + num_threads);
+      job.ahead = &ahead;
+    }
 
-                  if (segCount > 1)
-                    {
-                      num_vertices += segCount;
-                      num_segments++;
-                      total += segCount;
+  if (job.feeder != NULL || job.ahead != NULL)
+    {
+      pool_run_ordered (num_threads, num_tasks, ingest_task, &job);
+    }
+  else
+    {
+      pool_run (num_threads, num_tasks, ingest_task, &job);
+    }
 
+  if (job.feeder != NULL)
+    {
+      zip_feeder_finish (&feeder);
 
-                      /*  Allocate memory for the segment.  */
+      fprintf (stderr, "\n\n%d tiles inflated by %d threads, %.1f MB from %.1f MB compressed\n", num_zipped, zip_threads,
+               (double) feeder.bytes / 1048576.0, (double) feeder.compressed_bytes / 1048576.0);
+    }
 
-                      segx = (int32_t *) calloc (segCount, sizeof (int32_t));
-                      if (segx == NULL)
-                        {
-                          perror ("Allocating segx memory");
-                          exit (-1);
-                        }
+  if (job.ahead != NULL)
+    {
+      read_ahead_finish (&ahead);
 
-                      segy = (int32_t *) calloc (segCount, sizeof (int32_t));
-                      if (segy == NULL)
-                        {
-                          perror ("Allocating segy memory");
-                          exit (-1);
-                        }
+      fprintf (stderr, "\n\n%d shape files read ahead by %d threads (%.1f MB), queue depth %.1f average and %d most\n",
+               ahead.files, ahead.num_threads, (double) ahead.bytes / 1048576.0,
+               ahead.gets ? (double) ahead.depth / ahead.gets : 0.0, ahead.max_depth);
+      fprintf (stderr, "Workers waited on the read-ahead %d times for %.3f seconds\n", ahead.stalls, ahead.stall);
+    }
 
+  free (source);
+  free (ahead_name);
 
-                      /*  Compute the maximum difference between adjacent points in the segment.  */
+  end_phase (report, METRICS_INGEST, &stage_start);
 
-                      diff_x[0] = 99999999;
-                      diff_x[1] = -99999999;
-                      diff_y[0] = 99999999;
-                      diff_y[1] = -99999999;
 
-                      for (k = 0 ; k < segCount ; k++)
-                        {
-                          if (!fread (&segx[k], sizeof (int32_t), 1, fp))
-			    {
-			      fprintf (stderr, "Bad return in file %s, function %s at line %d.  This should never happen!", __FILE__, __FUNCTION__, __LINE__ - 2);
-			      fflush (stderr);
-			      exit (-1);
-			    }
-			  
-                          if (!fread (&segy[k], sizeof (int32_t), 1, fp))
-			    {
-			      fprintf (stderr, "Bad return in file %s, function %s at line %d.  This should never happen!", __FILE__, __FUNCTION__, __LINE__ - 2);
-			      fflush (stderr);
-			      exit (-1);
-			    }
+  /*  The read time is whatever the workers spent in the shape files that wasn't conversion or segmentation.  */
 
-                          if (k)
-                            {
-                              diff_x[0] = MIN (segx[k] - segx[k - 1], diff_x[0]);
-                              diff_x[1] = MAX (segx[k] - segx[k - 1], diff_x[1]);
-                              diff_y[0] = MIN (segy[k] - segy[k - 1], diff_y[0]);
-                              diff_y[1] = MAX (segy[k] - segy[k - 1], diff_y[1]);
-                            }
-                        }
+  if (report != NULL)
+    {
+      for (i = 0 ; i < num_threads ; i++)
+        {
+          metrics.files += job.stats[i].files;
+          metrics.shapes += job.stats[i].shapes;
+          metrics.parts += job.stats[i].parts;
+          metrics.vertices_read += job.stats[i].points;
+          metrics.vertices_dropped += job.stats[i].dropped;
+
+          metrics.phase[METRICS_CONVERSION].wall += job.stats[i].conversion.wall;
+          metrics.phase[METRICS_CONVERSION].cpu += job.stats[i].conversion.cpu;
+          metrics.phase[METRICS_SEGMENTATION].wall += job.stats[i].segmentation.wall;
+          metrics.phase[METRICS_SEGMENTATION].cpu += job.stats[i].segmentation.cpu;
+          metrics.phase[METRICS_READ].wall += job.stats[i].busy.wall - job.stats[i].conversion.wall -
+            job.stats[i].segmentation.wall;
+          metrics.phase[METRICS_READ].cpu += job.stats[i].busy.cpu - job.stats[i].conversion.cpu -
+            job.stats[i].segmentation.cpu;
+        }
+    }
 
 
-                      bias_x = -diff_x[0];
-                      bias_y = -diff_y[0];
+  /*  Free the segment memory.  */
 
+  for (i = 0 ; i < num_threads ; i++)
+    {
+      if (job.seg[i].x != NULL)
+        {
+          free (job.seg[i].x);
+          free (job.seg[i].y);
+          arena_count (0, 2, 0);
+        }
 
-                      if (bias_x > max_bias || bias_x < -max_bias)
-                        {
-                          fprintf (stderr, "\n\nlon bias out of range, terminating!\n\n");
-                          fprintf (stderr, "%d %d %d\n", i,j,bias_x);
-                          exit (-1);
-                        }
+      if (job.seg[i].ix != NULL)
+        {
+          free (job.seg[i].ix);
+          free (job.seg[i].iy);
+          free (job.seg[i].bad);
+          arena_count (0, 3, 0);
+        }
+    }
 
+  free (job.seg);
+  free (job.stats);
+  free (task);
 
-                      if (bias_y > max_bias || bias_y < -max_bias)
-                        {
-                          fprintf (stderr, "\n\nlat bias out of range, terminating!\n\n");
-                          fprintf (stderr, "%d %d %d\n", i,j,bias_y);
-                          exit (-1);
-                        }
 
+  arena_get_counters (&pass1_counters);
 
-                      range_x = diff_x[1] - diff_x[0];
-                      range_y = diff_y[1] - diff_y[0];
 
+  fprintf (stderr,"\n\n%s\n\n", outname);
+  fflush (stderr);
 
-                      if (!range_x) range_x = 1;
-                      if (!range_y) range_y = 1;
 
+  /*  Try to open the output file.  When updating we're still reading the old one so we write a new one next to it
+      and rename it when we're done.  */
 
-                      /*  Compute the number of bits needed to store the data.  */
+  strcpy (writename, outname);
+  if (update) sprintf (writename, "%s.tmp", outname);
 
-                      count_bits = int_log2 (segCount) + 1;
-                      lon_offset_bits = int_log2 (range_x) + 1;
-                      lat_offset_bits = int_log2 (range_y) + 1;
+  if ((ofp = fopen (writename, "wb")) == NULL)
+    {
+      perror (writename);
+      exit (-1);
+    }
 
 
-                      /*  Compute the size, in bytes, of the write buffer.  */
+  /*  Use a big output buffer.  Everything after the header is written sequentially.  */
 
-                      size = 5 + 5 + 5 + count_bits + lon_offset_bits + lat_offset_bits + 18 + 18 + 26 + 25 + 
-                        (segCount - 1) * (lon_offset_bits + lat_offset_bits);
+  setvbuf (ofp, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
 
-                      size = size / 8 + 1;
 
+  /*  Make the list of cells that had shape files, in the order in which they go in the file.  */
 
-                      /*  Allocate the write buffer space.  */
+  cell = (int32_t *) calloc (CELL_ROWS * CELL_COLS, sizeof (int32_t));
+  if (cell == NULL)
+    {
+      perror ("Allocating cell list memory");
+      exit (-1);
+    }
 
-                      buffer = (uint8_t *) calloc (1, size);
+  num_cells = 0;
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++)
+    {
+      if (store.cell[i].present) cell[num_cells++] = i;
+    }
 
-                      if (buffer == NULL)
-                        {
-                          perror ("Allocating buffer");
-                          exit (-1);
-                        }
 
+  /*  Encode the cells in parallel while the writer thread streams them to the output file in order.  The header is
+      built in memory as the cells are written so the writer just skips over it for now.  */
 
-                      /*  Bit pack the data into the write buffer.  */
+  cell_writer_start (&writer, ofp, num_cells, cell, 4 * num_threads + 64, format, alignment, stitch, coding,
+                     columnar, compression, num_levels, tolerance, segment_index);
 
-                      pos = 0;
-                      bit_pack (buffer, pos, 5, count_bits); pos += 5;
-                      bit_pack (buffer, pos, 5, lon_offset_bits); pos += 5;
-                      bit_pack (buffer, pos, 5, lat_offset_bits); pos +=5;
-                      bit_pack (buffer, pos, count_bits, segCount); pos += count_bits;
-                      bit_pack (buffer, pos, 18, bias_x + max_bias); pos += 18;
-                      bit_pack (buffer, pos, 18, bias_y + max_bias); pos += 18;
-                      bit_pack (buffer, pos, 26, segx[0]); pos += 26;
-                      bit_pack (buffer, pos, 25, segy[0]); pos += 25;
+  fprintf (stderr, "%s\n", (char *) writer.header);
+  fflush (stderr);
 
+  encode.store = &store;
+  encode.writer = &writer;
+  encode.old = &old;
+  encode.reuse = reuse;
+  encode.metrics = report;
+  encode.scratch = (ARENA *) calloc (num_threads, sizeof (ARENA));
 
-                      for (k = 1 ; k < segCount ; k++)
-                        {
-                          xoff = (segx[k] - segx[k - 1]) + bias_x;
-                          yoff = (segy[k] - segy[k - 1]) + bias_y;
+  if (encode.scratch == NULL)
+    {
+      perror ("Allocating scratch arena memory");
+      exit (-1);
+    }
 
-                          bit_pack (buffer, pos, lon_offset_bits, xoff); pos += lon_offset_bits;
-                          bit_pack (buffer, pos, lat_offset_bits, yoff); pos += lat_offset_bits;
-                        }
+  for (i = 0 ; i < num_threads ; i++) arena_init (&encode.scratch[i], SCRATCH_ARENA_SIZE);
 
+  pool_run_ordered (num_threads, num_cells, encode_task, &encode);
 
-                      /*  Now, write the buffer to the output file.  */
+  cell_writer_finish (&writer);
 
-                      fwrite (buffer, size, 1, ofp);
+  if (report != NULL)
+    {
+      for (i = 0 ; i < num_threads ; i++)
+        {
+          metrics.phase[METRICS_ENCODE].wall += metrics.thread[i].wall;
+          metrics.phase[METRICS_ENCODE].cpu += metrics.thread[i].cpu;
+        }
 
+      metrics.phase[METRICS_WRITE] = writer.write;
+    }
 
-                      /*  Free the buffer and segment memory.  */
+  for (i = 0 ; i < num_threads ; i++) arena_free (&encode.scratch[i]);
+  free (encode.scratch);
 
-                      free (buffer);
-                      free (segx);
-                      free (segy);
-                    }
-                }
+  total = (int32_t) writer.total;
+
+
+  /*  Now write the version and the complete header in one shot.  */
 
+  FSEEKO (ofp, 0, SEEK_SET);
 
-              /*  Close the input file and delete it.  */
+  if (fwrite (writer.header, writer.header_size, 1, ofp) != 1)
+    {
+      perror (writename);
+      exit (-1);
+    }
 
-              fclose (fp);
-              remove (fname);
+  cell_writer_free (&writer);
+  free (cell);
 
 
-              /*  Write the address, number of segments, and number of vertices in the header  */
+  /*  Close the output file.  */
 
-              fseek (ofp, offset, SEEK_SET);
+  if (fclose (ofp))
+    {
+      perror (writename);
+      exit (-1);
+    }
 
-              k = 8 * sizeof (int32_t);
+  end_phase (report, METRICS_PACK, &stage_start);
 
-              pos = 0;
-              bit_pack (head_buf, pos, k, address); pos += k;
-              bit_pack (head_buf, pos, k, num_segments); pos += k;
-              bit_pack (head_buf, pos, k, num_vertices);
 
-              fwrite (head_buf, 3 * sizeof (int32_t), 1, ofp);
+  /*  Replace the old file with the updated one.  */
 
-              fseek (ofp, 0, SEEK_END);
-            }
-        }
+  if (update)
+    {
+      ccl_close (&old);
 
-      percent = (int32_t) (((float) i / 181.0) * 100.0);
-      if (percent != old_percent)
+#ifdef NVWIN3X
+      remove (outname);
+#endif
+
+      if (rename (writename, outname))
         {
-          fprintf (stderr, "%03d%% packed\r", percent);
-          fflush (stderr);
-          old_percent = percent;
+          perror (outname);
+          exit (-1);
         }
+
+      free (old_manifest);
+      free (reuse);
     }
 
 
-  /*  Close the output file.  */
+  /*  Save the manifest so that the next run can be an update.  */
 
-  fclose (ofp);
+  if (manifest_write (manifest_name, file_version, manifest))
+    {
+      perror (manifest_name);
+      exit (-1);
+    }
+
+  free (manifest);
+
+
+  cell_store_close (&store);
+
+
+  arena_get_counters (&pass2_counters);
 
 
   fprintf (stderr, "100%% packed\n\n");
   fprintf (stderr, "Total points packed = %d\n\n", total);
+  fprintf (stderr, "System allocations: pass 1 = %"PRId64" (%"PRId64" bytes), pass 2 = %"PRId64" (%"PRId64" bytes, %"PRId64
+           " arena resets)\n\n", pass1_counters.mallocs, pass1_counters.bytes, pass2_counters.mallocs - pass1_counters.mallocs,
+           pass2_counters.bytes - pass1_counters.bytes, pass2_counters.resets);
   fflush (stderr);
 
+
+  /*  The metrics report.  */
+
+  if (report != NULL)
+    {
+      stage_start = build_start;
+      end_phase (report, METRICS_TOTAL, &stage_start);
+
+      if (metrics_write (report, metrics_name, outname))
+        {
+          perror (metrics_name);
+          exit (-1);
+        }
+
+      fprintf (stderr, "Metrics written to %s\n\n", metrics_name);
+
+      metrics_free (report);
+    }
+
   return (0);
 }
@@ -0,0 +1,296 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "build_swbd.h"
+#include "manifest.h"
+
+
+/*
+
+    The build manifest.  It's a text file next to the output file (OUTPUT_FILE.manifest) with one line for each cell
+    that had a shape file:
+
+        ROW COL SIZE MTIME HASH PATH
+
+    The first line is a comment with the output file version.  An update run (-u or --update) compares each input
+    file against its line.  If the path, size, and modification time (in nanoseconds, so an edit in the same second
+    as the last build still shows up) match the cell is assumed to be unchanged.  If not, the files are hashed and the
+    cell is only re-encoded if the hash is different (so touching a file or copying the tiles somewhere else doesn't
+    cause any work).  Plain shape files are only hashed by update runs, a full build doesn't read its input twice
+    just to fill in the manifest, so their HASH is 0 until the first update that finds them changed.
+
+*/
+
+
+#define MANIFEST_TAG         "# build_swbd manifest"
+
+
+
+/*  Modification time of a file in nanoseconds.  */
+
+static int64_t stat_mtime (struct stat *st)
+{
+#ifdef NVWIN3X
+  return ((int64_t) st->st_mtime * 1000000000LL);
+#else
+  return ((int64_t) st->st_mtim.tv_sec * 1000000000LL + (int64_t) st->st_mtim.tv_nsec);
+#endif
+}
+
+
+
+/*  Get the .shx name for a .shp name.  */
+
+static void shx_name (char *shpname, char *shxname)
+{
+  int32_t           len;
+
+
+  strcpy (shxname, shpname);
+  len = strlen (shxname);
+
+  if (len >= 3) shxname[len - 1] = (shxname[len - 1] == 'P') ? 'X' : 'x';
+}
+
+
+
+/*  Fill in the path, size, and mtime for a .shp file (and its .shx file).  Returns 0 or -1 if either one can't be
+    found.  */
+
+int32_t manifest_stat (char *shpname, MANIFEST_ENTRY *entry)
+{
+  struct stat       st;
+  char              shxname[512];
+
+
+  memset (entry, 0, sizeof (MANIFEST_ENTRY));
+  strcpy (entry->path, shpname);
+
+  if (stat (shpname, &st)) return (-1);
+
+  entry->size = (int64_t) st.st_size;
+  entry->mtime = stat_mtime (&st);
+
+  shx_name (shpname, shxname);
+
+  if (stat (shxname, &st)) return (-1);
+
+  entry->size += (int64_t) st.st_size;
+  entry->mtime = MAX (entry->mtime, stat_mtime (&st));
+
+  entry->valid = NVTrue;
+
+  return (0);
+}
+
+
+
+/*  Fill in the path, size, mtime, and hash for a shape file in a zip archive.  The size is the uncompressed size of
+    the .shp and .shx members and the time is the archive's.  The archive already has a CRC for each member so the
+    hash is made from those (and the sizes) instead of the data, that way nothing has to be inflated to check a
+    tile.  Returns 0 or -1 if the archive can't be found.  */
+
+int32_t manifest_stat_zip (char *shpname, ZIP_SOURCE *zip, MANIFEST_ENTRY *entry)
+{
+  struct stat       st;
+  uint64_t          h, word[4];
+  int32_t           i;
+
+
+  memset (entry, 0, sizeof (MANIFEST_ENTRY));
+  strcpy (entry->path, shpname);
+
+  if (stat (zip->zipname, &st)) return (-1);
+
+  entry->size = zip->shp.size + zip->shx.size;
+  entry->mtime = stat_mtime (&st);
+
+  word[0] = zip->shp.crc;
+  word[1] = (uint64_t) zip->shp.size;
+  word[2] = zip->shx.crc;
+  word[3] = (uint64_t) zip->shx.size;
+
+  h = 0xcbf29ce484222325ULL;
+  for (i = 0 ; i < 4 ; i++) h = (h ^ word[i]) * 0x100000001b3ULL;
+
+  entry->hash = h ^ (h >> 32);
+  entry->valid = NVTrue;
+
+  return (0);
+}
+
+
+
+/*  Hash one file into *hash.  This is FNV-1a over 64 bit words (and then the leftover bytes) which is plenty to tell
+    if a tile was changed and runs at memory speed.  */
+
+static int32_t hash_file (char *name, uint64_t *hash)
+{
+  MAPPED_FILE       file;
+  uint64_t          h, word;
+  int64_t           i;
+
+
+  if (map_file (&file, name, NVTrue)) return (-1);
+
+  h = *hash;
+
+  for (i = 0 ; i + 8 <= file.size ; i += 8)
+    {
+      memcpy (&word, &file.data[i], sizeof (uint64_t));
+      h = (h ^ word) * 0x100000001b3ULL;
+    }
+
+  for ( ; i < file.size ; i++) h = (h ^ file.data[i]) * 0x100000001b3ULL;
+
+  h = (h ^ (uint64_t) file.size) * 0x100000001b3ULL;
+
+  *hash = h ^ (h >> 32);
+
+  unmap_file (&file);
+
+  return (0);
+}
+
+
+
+/*  Hash the .shp and .shx files for an entry (after manifest_stat).  Returns 0 or -1 on failure.  */
+
+int32_t manifest_hash (MANIFEST_ENTRY *entry)
+{
+  char              shxname[512];
+
+
+  entry->hash = 0xcbf29ce484222325ULL;
+
+  if (hash_file (entry->path, &entry->hash)) return (-1);
+
+  shx_name (entry->path, shxname);
+
+  return (hash_file (shxname, &entry->hash));
+}
+
+
+
+/*
+
+    Read a manifest into entry (CELL_ROWS * CELL_COLS entries, cell y * CELL_COLS + x).  version is the file
+    version string of the output file that it describes (without the newline).  Returns 0 or -1 if the manifest can't
+    be read or is for a different file version.
+
+*/
+
+int32_t manifest_read (char *name, char *version, MANIFEST_ENTRY *entry)
+{
+  FILE              *fp;
+  char              string[1024], tag[256];
+  int32_t           row, col, len, pos;
+  int64_t           size, mtime;
+  uint64_t          hash;
+
+
+  memset (entry, 0, CELL_ROWS * CELL_COLS * sizeof (MANIFEST_ENTRY));
+
+  if ((fp = fopen (name, "r")) == NULL) return (-1);
+
+
+  /*  Check the version.  */
+
+  sprintf (tag, "%s %s\n", MANIFEST_TAG, version);
+
+  if (fgets (string, sizeof (string), fp) == NULL || strcmp (string, tag))
+    {
+      fclose (fp);
+      return (-1);
+    }
+
+
+  while (fgets (string, sizeof (string), fp) != NULL)
+    {
+      len = strlen (string);
+      if (len && string[len - 1] == '\n') string[--len] = 0;
+
+      pos = -1;
+
+      if (sscanf (string, "%d %d %"SCNd64" %"SCNd64" %"SCNx64" %n", &row, &col, &size, &mtime, &hash, &pos) < 5 ||
+          pos < 0 || row < 0 || row >= CELL_ROWS || col < 0 || col >= CELL_COLS || len - pos >= 512)
+        {
+          fclose (fp);
+          return (-1);
+        }
+
+      entry[row * CELL_COLS + col].size = size;
+      entry[row * CELL_COLS + col].mtime = mtime;
+      entry[row * CELL_COLS + col].hash = hash;
+      strcpy (entry[row * CELL_COLS + col].path, &string[pos]);
+      entry[row * CELL_COLS + col].valid = NVTrue;
+    }
+
+  fclose (fp);
+
+  return (0);
+}
+
+
+
+/*  Write the manifest for an output file.  Returns 0 or -1 on failure (with errno set).  */
+
+int32_t manifest_write (char *name, char *version, MANIFEST_ENTRY *entry)
+{
+  FILE              *fp;
+  int32_t           i;
+
+
+  if ((fp = fopen (name, "w")) == NULL) return (-1);
+
+  fprintf (fp, "%s %s\n", MANIFEST_TAG, version);
+
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++)
+    {
+      if (entry[i].valid) fprintf (fp, "%d %d %"PRId64" %"PRId64" %016"PRIx64" %s\n", i / CELL_COLS, i % CELL_COLS,
+                                   entry[i].size, entry[i].mtime, entry[i].hash, entry[i].path);
+    }
+
+  if (fclose (fp)) return (-1);
+
+  return (0);
+}
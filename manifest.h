@@ -0,0 +1,76 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __MANIFEST_H__
+#define __MANIFEST_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+#include "zip_reader.h"
+
+
+  /*  Where each cell in an output file came from.  size is the combined size of the .shp and .shx files, mtime is the
+      newer of their modification times (nanoseconds), and hash is a 64 bit hash of their contents (0 if it hasn't been
+      computed).  */
+
+  typedef struct
+  {
+    char              path[512];              /*  The .shp file  */
+    int64_t           size;
+    int64_t           mtime;
+    uint64_t          hash;
+    uint8_t           valid;
+  } MANIFEST_ENTRY;
+
+
+  int32_t manifest_stat (char *shpname, MANIFEST_ENTRY *entry);
+  int32_t manifest_stat_zip (char *shpname, ZIP_SOURCE *zip, MANIFEST_ENTRY *entry);
+  int32_t manifest_hash (MANIFEST_ENTRY *entry);
+  int32_t manifest_read (char *name, char *version, MANIFEST_ENTRY *entry);
+  int32_t manifest_write (char *name, char *version, MANIFEST_ENTRY *entry);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "build_swbd.h"
+#include "manifest.h"
+
+
+/*
+
+    Merge partial .ccl files (from sharded builds, -s or -b) into one file.  Each cell has to come from only one of
+    the parts.  The encoded cell blocks are copied byte for byte, in cell order, through the same writer that a normal
+    build uses (which figures out the new addresses and builds the header) so nothing gets decoded and the result is
+    identical to building all of the cells in one run.  If every part has a manifest they are merged too.
+
+*/
+
+int32_t merge_files (char *outname, int32_t num_parts, char **partname)
+{
+  FILE              *ofp;
+  CCL_READER        *part;
+  CELL_WRITER       writer;
+  CELL_BLOCK        *block;
+  MANIFEST_ENTRY    *manifest, *part_manifest;
+  int16_t           *owner;
+  int32_t           i, p, num_cells, *cell;
+  char              fname[512], *file_version;
+  uint8_t           manifests;
+
+
+  part = (CCL_READER *) calloc (num_parts, sizeof (CCL_READER));
+  owner = (int16_t *) malloc (CELL_ROWS * CELL_COLS * sizeof (int16_t));
+  cell = (int32_t *) malloc (CELL_ROWS * CELL_COLS * sizeof (int32_t));
+
+  if (part == NULL || owner == NULL || cell == NULL)
+    {
+      perror ("Allocating merge memory");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++) owner[i] = -1;
+
+
+  /*  Find out which part each cell comes from.  A cell that had a shape file has an address even if it has no
+      segments so we look at the raw header entries.  */
+
+  for (p = 0 ; p < num_parts ; p++)
+    {
+      if (ccl_open (&part[p], partname[p]))
+        {
+          perror (partname[p]);
+          exit (-1);
+        }
+
+
+      /*  The output is the same format (and alignment, stitching, segment coding, columnar blocks, compression, levels
+          of detail, and segment index) as the parts so they all have to match.  */
+
+      if (!cell_writer_matches (&part[p], part[0].format, part[0].alignment, part[0].stitch, part[0].coding,
+                                part[0].columnar, part[0].compression, part[0].num_levels, part[0].tolerance,
+                                part[0].index_table != 0))
+        {
+          fprintf (stderr, "\n\n%s is not the same format as %s, terminating!\n\n", partname[p], partname[0]);
+          exit (-1);
+        }
+
+      for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++)
+        {
+          if (ccl_cell_address (&part[p], i / CELL_COLS, i % CELL_COLS))
+            {
+              if (owner[i] >= 0)
+                {
+                  fprintf (stderr, "\n\nCell %d %d is in both %s and %s, terminating!\n\n", i / CELL_COLS - 90,
+                           i % CELL_COLS - 180, partname[owner[i]], partname[p]);
+                  exit (-1);
+                }
+
+              owner[i] = p;
+            }
+        }
+    }
+
+  num_cells = 0;
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++)
+    {
+      if (owner[i] >= 0) cell[num_cells++] = i;
+    }
+
+
+  if ((ofp = fopen (outname, "wb")) == NULL)
+    {
+      perror (outname);
+      exit (-1);
+    }
+
+  setvbuf (ofp, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+  cell_writer_start (&writer, ofp, num_cells, cell, 64, part[0].format, part[0].alignment, part[0].stitch,
+                     part[0].coding, part[0].columnar, part[0].compression, part[0].num_levels, part[0].tolerance,
+                     part[0].index_table != 0);
+
+  file_version = (part[0].format == CCL_FORMAT_2) ? FILE_VERSION_2 : FILE_VERSION;
+
+  for (i = 0 ; i < num_cells ; i++)
+    {
+      block = cell_writer_acquire (&writer, i);
+
+      copy_cell (&part[owner[cell[i]]], cell[i] % CELL_COLS, cell[i] / CELL_COLS, block);
+
+      cell_writer_submit (&writer, i);
+    }
+
+  cell_writer_finish (&writer);
+
+
+  FSEEKO (ofp, 0, SEEK_SET);
+
+  if (fwrite (writer.header, writer.header_size, 1, ofp) != 1 || fclose (ofp))
+    {
+      perror (outname);
+      exit (-1);
+    }
+
+  fprintf (stderr, "100%% packed\n\n");
+  fprintf (stderr, "Merged %d cells from %d files into %s, total points = %"PRId64"\n\n", num_cells, num_parts, outname,
+           writer.total);
+
+  cell_writer_free (&writer);
+
+  for (p = 0 ; p < num_parts ; p++) ccl_close (&part[p]);
+
+
+  /*  Merge the manifests so that the merged file can be updated.  If any of them are missing we don't write one.  */
+
+  manifest = (MANIFEST_ENTRY *) calloc (CELL_ROWS * CELL_COLS, sizeof (MANIFEST_ENTRY));
+  part_manifest = (MANIFEST_ENTRY *) calloc (CELL_ROWS * CELL_COLS, sizeof (MANIFEST_ENTRY));
+
+  if (manifest == NULL || part_manifest == NULL)
+    {
+      perror ("Allocating manifest memory");
+      exit (-1);
+    }
+
+  manifests = NVTrue;
+
+  for (p = 0 ; p < num_parts && manifests ; p++)
+    {
+      sprintf (fname, "%s.manifest", partname[p]);
+
+      if (manifest_read (fname, file_version, part_manifest))
+        {
+          manifests = NVFalse;
+          break;
+        }
+
+      for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++)
+        {
+          if (owner[i] == p && part_manifest[i].valid) manifest[i] = part_manifest[i];
+        }
+    }
+
+  sprintf (fname, "%s.manifest", outname);
+
+  if (manifests)
+    {
+      if (manifest_write (fname, file_version, manifest))
+        {
+          perror (fname);
+          exit (-1);
+        }
+    }
+  else
+    {
+      fprintf (stderr, "Not all of the files have a manifest so %s was not written\n\n", fname);
+      remove (fname);
+    }
+
+
+  free (manifest);
+  free (part_manifest);
+  free (part);
+  free (owner);
+  free (cell);
+
+  return (0);
+}
@@ -0,0 +1,358 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <time.h>
+
+#include "build_swbd.h"
+#include "metrics.h"
+
+
+/*
+
+    Build metrics.  The phase times and counters are gathered as we go (only when -M is used) and written out at
+    the end as a JSON report so that nightly builds can be compared against each other.  Wall time is from the
+    monotonic clock and CPU time is from the process (or, for the per thread phases, the thread) CPU clock.
+
+*/
+
+
+static const char *phase_name[METRICS_PHASES] = {"discovery", "ingest", "read", "conversion", "segmentation", "pack",
+                                                 "encode", "write", "total"};
+
+
+/*  Phases that are summed over the threads that ran them rather than timed once on the wall clock.  */
+
+static const uint8_t phase_summed[METRICS_PHASES] = {0, 0, 1, 1, 1, 0, 1, 1, 0};
+
+
+
+static double clock_seconds (clockid_t id)
+{
+  struct timespec   ts;
+
+  clock_gettime (id, &ts);
+
+  return ((double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9);
+}
+
+
+
+/*  Monotonic wall clock time in seconds.  This is the clock that all of the timing (and the benchmarks) use.  */
+
+double metrics_time ()
+{
+  return (clock_seconds (CLOCK_MONOTONIC));
+}
+
+
+
+/*  Read the wall clock and the process CPU clock.  */
+
+void metrics_clock (METRICS_TIME *now)
+{
+  now->wall = clock_seconds (CLOCK_MONOTONIC);
+  now->cpu = clock_seconds (CLOCK_PROCESS_CPUTIME_ID);
+}
+
+
+
+/*  Read the wall clock and the calling thread's CPU clock.  */
+
+void metrics_thread_clock (METRICS_TIME *now)
+{
+  now->wall = clock_seconds (CLOCK_MONOTONIC);
+  now->cpu = clock_seconds (CLOCK_THREAD_CPUTIME_ID);
+}
+
+
+
+/*  Add the time from start to end to phase.  */
+
+void metrics_add (METRICS_TIME *phase, const METRICS_TIME *start, const METRICS_TIME *end)
+{
+  phase->wall += end->wall - start->wall;
+  phase->cpu += end->cpu - start->cpu;
+}
+
+
+
+void metrics_init (METRICS *metrics, int32_t num_threads)
+{
+  memset (metrics, 0, sizeof (METRICS));
+
+  metrics->num_threads = num_threads;
+  metrics->thread = (METRICS_TIME *) calloc (num_threads, sizeof (METRICS_TIME));
+  metrics->cell = (METRICS_CELL **) calloc (CELL_ROWS * CELL_COLS, sizeof (METRICS_CELL *));
+
+  if (metrics->thread == NULL || metrics->cell == NULL)
+    {
+      perror ("Allocating metrics memory");
+      exit (-1);
+    }
+}
+
+
+
+/*  Get the entry for a cell (row * CELL_COLS + column), starting a new one if we haven't seen the cell yet.  Each cell
+    is only packed by one thread so the entries don't need to be locked.  */
+
+METRICS_CELL *metrics_cell (METRICS *metrics, int32_t cell)
+{
+  if (metrics->cell[cell] == NULL && (metrics->cell[cell] = (METRICS_CELL *) calloc (1, sizeof (METRICS_CELL))) == NULL)
+    {
+      perror ("Allocating metrics memory");
+      exit (-1);
+    }
+
+  return (metrics->cell[cell]);
+}
+
+
+
+/*  Count one full resolution segment in a cell's histograms.  */
+
+void metrics_segment (METRICS_CELL *cell, int32_t count_bits, int32_t lon_offset_bits, int32_t lat_offset_bits)
+{
+  cell->count_bits[MAX (0, MIN (METRICS_BITS - 1, count_bits))]++;
+  cell->lon_offset_bits[MAX (0, MIN (METRICS_BITS - 1, lon_offset_bits))]++;
+  cell->lat_offset_bits[MAX (0, MIN (METRICS_BITS - 1, lat_offset_bits))]++;
+}
+
+
+
+/*  Write a string with the JSON escapes.  */
+
+static void json_string (FILE *fp, const char *string)
+{
+  fputc ('"', fp);
+
+  for ( ; *string ; string++)
+    {
+      if (*string == '"' || *string == '\\')
+        {
+          fprintf (fp, "\\%c", *string);
+        }
+      else if ((uint8_t) *string < 0x20)
+        {
+          fprintf (fp, "\\u%04x", (uint8_t) *string);
+        }
+      else
+        {
+          fputc (*string, fp);
+        }
+    }
+
+  fputc ('"', fp);
+}
+
+
+
+/*  Write a histogram as an array, leaving off the zeros at the top end.  */
+
+static void json_histogram (FILE *fp, const char *name, const uint64_t *histogram)
+{
+  int32_t           i, n;
+
+
+  for (n = METRICS_BITS ; n > 0 && !histogram[n - 1] ; n--);
+
+  fprintf (fp, "\"%s\": [", name);
+  for (i = 0 ; i < n ; i++) fprintf (fp, "%s%"PRIu64, i ? ", " : "", histogram[i]);
+  fprintf (fp, "]");
+}
+
+
+
+/*
+
+    Write the JSON report to name.  output is the .ccl file that was built.  The report looks like this (the
+    histograms are indexed by the number of bits):
+
+        {
+          "version": "...", "output": "...", "threads": N,
+          "phases": {"discovery": {"wall_seconds": S, "cpu_seconds": S}, ...},
+          "thread_phases": {"read": {"thread_seconds": S, "cpu_seconds": S}, ...},
+          "encode_threads": [{"wall_seconds": S, "cpu_seconds": S}, ...],
+          "counters": {"files": N, "shapes": N, "parts": N, "vertices_read": N, "vertices_dropped": N,
+                       "cells": N, "cells_copied": N, "segments_emitted": N, "vertices_emitted": N,
+                       "bytes_emitted": N, "bits_per_vertex": X},
+          "histograms": {"count_bits": [...], "lon_offset_bits": [...], "lat_offset_bits": [...]},
+          "cells": [{"lat": L, "lon": L, "segments": N, "vertices": N, "bytes": N, "bits_per_vertex": X,
+                     "copied": false, "count_bits": [...], "lon_offset_bits": [...], "lat_offset_bits": [...]}, ...]
+        }
+
+    phases are timed once on the wall clock.  thread_phases (read, conversion, segmentation, encode, and write) are
+    added up over the threads that ran them so thread_seconds can be more than the total wall time.  lat and lon are
+    the southwest corner of the cell.  Returns 0 or -1 if the file couldn't be written.
+
+*/
+
+int32_t metrics_write (METRICS *metrics, char *name, char *output)
+{
+  FILE              *fp;
+  METRICS_CELL      *cell;
+  int32_t           i, j, cells, copied, first;
+  int64_t           segments, vertices, bytes;
+  uint64_t          histogram[3][METRICS_BITS], local[3][METRICS_BITS];
+
+
+  if ((fp = fopen (name, "w")) == NULL) return (-1);
+
+
+  /*  Add up the cells.  */
+
+  cells = copied = 0;
+  segments = vertices = bytes = 0;
+  memset (histogram, 0, sizeof (histogram));
+
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++)
+    {
+      if ((cell = metrics->cell[i]) == NULL) continue;
+
+      cells++;
+      if (cell->copied) copied++;
+      segments += cell->segments;
+      vertices += cell->vertices;
+      bytes += cell->bytes;
+
+      for (j = 0 ; j < METRICS_BITS ; j++)
+        {
+          histogram[0][j] += cell->count_bits[j];
+          histogram[1][j] += cell->lon_offset_bits[j];
+          histogram[2][j] += cell->lat_offset_bits[j];
+        }
+    }
+
+
+  fprintf (fp, "{\n  \"version\": ");
+  json_string (fp, VERSION);
+  fprintf (fp, ",\n  \"output\": ");
+  json_string (fp, output);
+  fprintf (fp, ",\n  \"threads\": %d,\n", metrics->num_threads);
+
+  fprintf (fp, "  \"phases\": {\n");
+  for (i = 0, first = NVTrue ; i < METRICS_PHASES ; i++)
+    {
+      if (phase_summed[i]) continue;
+
+      fprintf (fp, "%s    \"%s\": {\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f}", first ? "" : ",\n", phase_name[i],
+               metrics->phase[i].wall, metrics->phase[i].cpu);
+      first = NVFalse;
+    }
+  fprintf (fp, "\n  },\n");
+
+  fprintf (fp, "  \"thread_phases\": {\n");
+  for (i = 0, first = NVTrue ; i < METRICS_PHASES ; i++)
+    {
+      if (!phase_summed[i]) continue;
+
+      fprintf (fp, "%s    \"%s\": {\"thread_seconds\": %.6f, \"cpu_seconds\": %.6f}", first ? "" : ",\n",
+               phase_name[i], metrics->phase[i].wall, metrics->phase[i].cpu);
+      first = NVFalse;
+    }
+  fprintf (fp, "\n  },\n");
+
+  fprintf (fp, "  \"encode_threads\": [");
+  for (i = 0 ; i < metrics->num_threads ; i++)
+    fprintf (fp, "%s{\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f}", i ? ", " : "", metrics->thread[i].wall,
+             metrics->thread[i].cpu);
+  fprintf (fp, "],\n");
+
+  fprintf (fp, "  \"counters\": {\"files\": %"PRId64", \"shapes\": %"PRId64", \"parts\": %"PRId64
+           ", \"vertices_read\": %"PRId64", \"vertices_dropped\": %"PRId64",\n", metrics->files, metrics->shapes,
+           metrics->parts, metrics->vertices_read, metrics->vertices_dropped);
+  fprintf (fp, "               \"cells\": %d, \"cells_copied\": %d, \"segments_emitted\": %"PRId64
+           ", \"vertices_emitted\": %"PRId64", \"bytes_emitted\": %"PRId64", \"bits_per_vertex\": %.4f},\n", cells,
+           copied, segments, vertices, bytes, vertices ? 8.0 * bytes / vertices : 0.0);
+
+  fprintf (fp, "  \"histograms\": {");
+  json_histogram (fp, "count_bits", histogram[0]);
+  fprintf (fp, ", ");
+  json_histogram (fp, "lon_offset_bits", histogram[1]);
+  fprintf (fp, ", ");
+  json_histogram (fp, "lat_offset_bits", histogram[2]);
+  fprintf (fp, "},\n");
+
+
+  /*  One line per cell.  */
+
+  fprintf (fp, "  \"cells\": [");
+
+  for (i = 0, first = NVTrue ; i < CELL_ROWS * CELL_COLS ; i++)
+    {
+      if ((cell = metrics->cell[i]) == NULL) continue;
+
+      for (j = 0 ; j < METRICS_BITS ; j++)
+        {
+          local[0][j] = cell->count_bits[j];
+          local[1][j] = cell->lon_offset_bits[j];
+          local[2][j] = cell->lat_offset_bits[j];
+        }
+
+      fprintf (fp, "%s\n    {\"lat\": %d, \"lon\": %d, \"segments\": %d, \"vertices\": %d, \"bytes\": %"PRId64
+               ", \"bits_per_vertex\": %.4f, \"copied\": %s, ", first ? "" : ",", i / CELL_COLS - 90,
+               i % CELL_COLS - 180, cell->segments, cell->vertices, cell->bytes,
+               cell->vertices ? 8.0 * cell->bytes / cell->vertices : 0.0, cell->copied ? "true" : "false");
+      json_histogram (fp, "count_bits", local[0]);
+      fprintf (fp, ", ");
+      json_histogram (fp, "lon_offset_bits", local[1]);
+      fprintf (fp, ", ");
+      json_histogram (fp, "lat_offset_bits", local[2]);
+      fprintf (fp, "}");
+
+      first = NVFalse;
+    }
+
+  fprintf (fp, "\n  ]\n}\n");
+
+  if (fclose (fp)) return (-1);
+
+  return (0);
+}
+
+
+
+void metrics_free (METRICS *metrics)
+{
+  int32_t           i;
+
+
+  for (i = 0 ; i < CELL_ROWS * CELL_COLS ; i++) free (metrics->cell[i]);
+
+  free (metrics->cell);
+  free (metrics->thread);
+}
@@ -0,0 +1,130 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+  /*  The build phases that we time.  Discovery, ingest (pass 1), and pack (pass 2) are the stages that main runs one
+      after the other, their CPU time is for the whole process.  Read, conversion, and segmentation split up the time
+      the pass 1 workers spent in each shape file, and encode and write are the time the pass 2 encoders spent packing
+      cells and the time the writer spent writing them.  Those are added up over all of the threads (thread seconds)
+      so they can be more than the wall time of their stage.  */
+
+#define METRICS_DISCOVERY    0
+#define METRICS_INGEST       1
+#define METRICS_READ         2
+#define METRICS_CONVERSION   3
+#define METRICS_SEGMENTATION 4
+#define METRICS_PACK         5
+#define METRICS_ENCODE       6
+#define METRICS_WRITE        7
+#define METRICS_TOTAL        8
+#define METRICS_PHASES       9
+
+
+  /*  Size of the bit width histograms (0 to 32 bits).  */
+
+#define METRICS_BITS         33
+
+
+  /*  Wall and CPU time, either a reading of the clocks or the time spent in a phase.  */
+
+  typedef struct
+  {
+    double            wall;
+    double            cpu;
+  } METRICS_TIME;
+
+
+  /*  What went in to one cell.  The histograms count the full resolution segments by their count bits and lon and
+      lat offset bits (the Rice parameters for Rice coded segments).  Cells copied from an old file (-u) only have the
+      totals.  */
+
+  typedef struct
+  {
+    int32_t           segments;
+    int32_t           vertices;
+    int64_t           bytes;                  /*  Size of the full resolution block as written  */
+    uint8_t           copied;
+    uint32_t          count_bits[METRICS_BITS];
+    uint32_t          lon_offset_bits[METRICS_BITS];
+    uint32_t          lat_offset_bits[METRICS_BITS];
+  } METRICS_CELL;
+
+
+  /*  Everything that goes in the report.  cell has an entry for each of the CCL_ROWS * CCL_COLS cells (NULL for the
+      ones that weren't built) and thread has the encode time of each pass 2 thread.  */
+
+  typedef struct
+  {
+    METRICS_TIME      phase[METRICS_PHASES];
+    int32_t           num_threads;
+    METRICS_TIME      *thread;
+    int64_t           files;
+    int64_t           shapes;
+    int64_t           parts;
+    int64_t           vertices_read;
+    int64_t           vertices_dropped;       /*  Points thrown out by the cell boundary check  */
+    METRICS_CELL      **cell;
+  } METRICS;
+
+
+  double metrics_time ();
+  void metrics_clock (METRICS_TIME *now);
+  void metrics_thread_clock (METRICS_TIME *now);
+  void metrics_add (METRICS_TIME *phase, const METRICS_TIME *start, const METRICS_TIME *end);
+  void metrics_init (METRICS *metrics, int32_t num_threads);
+  METRICS_CELL *metrics_cell (METRICS *metrics, int32_t cell);
+  void metrics_segment (METRICS_CELL *cell, int32_t count_bits, int32_t lon_offset_bits, int32_t lat_offset_bits);
+  int32_t metrics_write (METRICS *metrics, char *name, char *output);
+  void metrics_free (METRICS *metrics);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1259 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <zlib.h>
+
+#include "build_swbd.h"
+#include "ccl_cache.h"
+#include "ccl_distance.h"
+#include "thread_pool.h"
+
+
+/*  Everything the cache benchmark threads need.  */
+
+typedef struct
+{
+  CCL_CACHE         *cache;
+  int32_t           *cell;
+  int32_t           num_cells;
+  int32_t           num_hot;
+  int32_t           lookups;
+  int64_t           *sum;
+} CACHE_JOB;
+
+
+
+/*
+
+    Find the segments whose bounding boxes touch a box the slow way, by decoding every segment in the cells that the
+    box touches.  This is what a clipped query (using the segment index) should return.  The counts go in segments
+    and vertices.
+
+*/
+
+static void clip_brute_force (CCL_READER *reader, double west, double east, double south, double north,
+                              int64_t *segments, int64_t *vertices)
+{
+  CCL_QUERY         query;
+  CCL_SEGMENT       segment;
+  int32_t           k, alloc, *x, *y, box[4], x0, x1, y0, y1;
+
+
+  x = y = NULL;
+  alloc = 0;
+  *segments = *vertices = 0;
+
+  x0 = NINT ((MAX (-180.0, MIN (180.0, west)) + 180.0) * CCL_SCALE);
+  x1 = NINT ((MAX (-180.0, MIN (180.0, east)) + 180.0) * CCL_SCALE);
+  y0 = NINT ((MAX (-90.0, MIN (90.0, south)) + 90.0) * CCL_SCALE);
+  y1 = NINT ((MAX (-90.0, MIN (90.0, north)) + 90.0) * CCL_SCALE);
+
+  ccl_query_start (reader, &query, west, east, south, north);
+
+  while (ccl_query_next (&query, &segment) == 1)
+    {
+      if (segment.count > alloc)
+        {
+          alloc = segment.count;
+          x = (int32_t *) realloc (x, alloc * sizeof (int32_t));
+          y = (int32_t *) realloc (y, alloc * sizeof (int32_t));
+
+          if (x == NULL || y == NULL)
+            {
+              perror ("Allocating query memory");
+              exit (-1);
+            }
+        }
+
+      ccl_segment_decode (&segment, x, y);
+
+      box[0] = box[2] = x[0];
+      box[1] = box[3] = y[0];
+
+      for (k = 1 ; k < segment.count ; k++)
+        {
+          box[0] = MIN (box[0], x[k]);
+          box[1] = MIN (box[1], y[k]);
+          box[2] = MAX (box[2], x[k]);
+          box[3] = MAX (box[3], y[k]);
+        }
+
+
+      /*  The index pulls boxes that stick out of the cell back to the cell edges.  */
+
+      box[0] = MAX (box[0], segment.col * CCL_CELL_UNITS);
+      box[2] = MIN (box[2], (segment.col + 1) * CCL_CELL_UNITS);
+      box[1] = MAX (box[1], segment.row * CCL_CELL_UNITS);
+      box[3] = MIN (box[3], (segment.row + 1) * CCL_CELL_UNITS);
+
+      if (box[3] < y0 || box[1] > y1) continue;
+
+      if (x0 > x1)
+        {
+          if (box[2] < x0 && box[0] > x1) continue;
+        }
+      else
+        {
+          if (box[2] < x0 || box[0] > x1) continue;
+        }
+
+      (*segments)++;
+      *vertices += segment.count;
+    }
+
+  free (x);
+  free (y);
+}
+
+
+
+/*
+
+    Run a bounding box query against a .ccl file with the reader library and report what came back.  This is mostly
+    here so that the reader gets exercised by the same program that writes the files.  Every segment in the box is
+    fully decoded and the number of segments and vertices found in each cell are checked against the cell index.
+    level is the level of detail to query (0 for full resolution).  If clip is set the segment index is used to only
+    get the segments whose bounding boxes touch the box and the result is checked against decoding every segment in
+    the cells instead.  Returns the number of cells that didn't match, plus one if the clipped query didn't match (or
+    -1 if the file couldn't be read or doesn't have the level or a segment index).
+
+*/
+
+int32_t query_box (char *name, int32_t level, uint8_t clip, double west, double east, double south, double north)
+{
+  CCL_READER        reader;
+  CCL_QUERY         query;
+  CCL_SEGMENT       segment;
+  CCL_CELL          cell;
+  int32_t           status, cells, mismatches, cell_segments, cell_vertices, row, col, alloc;
+  int64_t           segments, vertices, check_segments, check_vertices;
+  double            *lon, *lat, min_lon, max_lon, min_lat, max_lat;
+  double            start;
+
+
+  if (ccl_open (&reader, name))
+    {
+      perror (name);
+      return (-1);
+    }
+
+  fprintf (stderr, "%s\n", reader.version);
+
+
+  lon = lat = NULL;
+  alloc = 0;
+  cells = mismatches = cell_segments = cell_vertices = 0;
+  row = col = -1;
+  segments = vertices = 0;
+  min_lon = min_lat = 999.0;
+  max_lon = max_lat = -999.0;
+
+  start = metrics_time ();
+
+  ccl_query_start (&reader, &query, west, east, south, north);
+
+  if (ccl_query_level (&query, level))
+    {
+      fprintf (stderr, "%s doesn't have level of detail %d\n", name, level);
+      ccl_close (&reader);
+      return (-1);
+    }
+
+  if (level) fprintf (stderr, "Level of detail %d, tolerance %.5f degrees\n", level,
+                      (double) reader.tolerance[level] / CCL_SCALE);
+
+  if (clip && ccl_query_clip (&query))
+    {
+      fprintf (stderr, "%s doesn't have a segment index (for level %d)\n", name, level);
+      ccl_close (&reader);
+      return (-1);
+    }
+
+  while (NVTrue)
+    {
+      status = ccl_query_next (&query, &segment);
+
+
+      /*  Check the totals for the previous cell when we move to a new one (or run out).  */
+
+      if (row >= 0 && (status != 1 || segment.row != row || segment.col != col))
+        {
+          ccl_cell_level (&reader, level, row, col, &cell);
+
+          if (!clip && (cell.num_segments != cell_segments || cell.num_vertices != cell_vertices))
+            {
+              fprintf (stderr, "Cell %d %d has %d segments and %d vertices, the index says %d and %d\n", row, col,
+                       cell_segments, cell_vertices, cell.num_segments, cell.num_vertices);
+              mismatches++;
+            }
+
+          row = -1;
+        }
+
+      if (status != 1) break;
+
+
+      if (row < 0)
+        {
+          row = segment.row;
+          col = segment.col;
+          cell_segments = cell_vertices = 0;
+          cells++;
+        }
+
+      cell_segments++;
+      cell_vertices += segment.count;
+
+
+      if (segment.count > alloc)
+        {
+          alloc = segment.count;
+          lon = (double *) realloc (lon, alloc * sizeof (double));
+          lat = (double *) realloc (lat, alloc * sizeof (double));
+
+          if (lon == NULL || lat == NULL)
+            {
+              perror ("Allocating query memory");
+              exit (-1);
+            }
+        }
+
+      ccl_segment_degrees (&segment, lon, lat);
+
+      min_lon = MIN (min_lon, lon[0]);
+      max_lon = MAX (max_lon, lon[0]);
+      min_lat = MIN (min_lat, lat[0]);
+      max_lat = MAX (max_lat, lat[0]);
+
+      segments++;
+      vertices += segment.count;
+    }
+
+
+  if (status < 0)
+    {
+      fprintf (stderr, "\n\n%s is truncated or corrupt!\n\n", name);
+      mismatches++;
+    }
+
+
+  fprintf (stderr, "%d cells, %"PRId64" segments, %"PRId64" vertices decoded in %.3f seconds\n", cells, segments,
+           vertices, metrics_time () - start);
+  if (segments) fprintf (stderr, "Segment start points are within %.5f %.5f %.5f %.5f\n", min_lon, max_lon, min_lat,
+                         max_lat);
+  fprintf (stderr, "%d cells did not match the index\n", mismatches);
+
+
+  if (clip && status == 0)
+    {
+      start = metrics_time ();
+
+      clip_brute_force (&reader, west, east, south, north, &check_segments, &check_vertices);
+
+      fprintf (stderr, "Decoding every segment in the cells found %"PRId64" segments, %"PRId64" vertices in %.3f seconds\n",
+               check_segments, check_vertices, metrics_time () - start);
+
+      if (check_segments != segments || check_vertices != vertices)
+        {
+          fprintf (stderr, "The segment index query did not match!\n");
+          mismatches++;
+        }
+    }
+
+
+  free (lon);
+  free (lat);
+
+  ccl_close (&reader);
+
+  return (mismatches);
+}
+
+
+
+/*
+
+    Decode every segment in a .ccl file with each of the segment decoders that this processor supports, to fixed point
+    and to degrees, and report the number of vertices decoded per second.  The output of each kernel is checked
+    against the scalar kernel.  The segments are found once up front so that only the decoding is timed.  Returns the
+    number of segments that didn't match (or -1 if the file couldn't be read).
+
+*/
+
+int32_t decode_benchmark (char *name)
+{
+  CCL_READER        reader;
+  CCL_QUERY         query;
+  CCL_SEGMENT       *segment;
+  int32_t           i, k, num_segments, alloc, kernel, degrees, passes, mismatches;
+  int32_t           *x, *y, *ref_x, *ref_y;
+  int64_t           vertices, max_count, offset, bytes;
+  double            *lon, *lat, *ref_lon, *ref_lat, seconds;
+  double            start;
+
+
+  if (ccl_open (&reader, name))
+    {
+      perror (name);
+      return (-1);
+    }
+
+
+  /*  Find all of the segments.  */
+
+  segment = NULL;
+  num_segments = alloc = 0;
+  vertices = max_count = bytes = 0;
+
+  ccl_query_start (&reader, &query, -180.0, 180.0, -90.0, 90.0);
+
+  while (NVTrue)
+    {
+      if (num_segments == alloc)
+        {
+          alloc = alloc ? alloc * 2 : 4096;
+          segment = (CCL_SEGMENT *) realloc (segment, alloc * sizeof (CCL_SEGMENT));
+
+          if (segment == NULL)
+            {
+              perror ("Allocating benchmark memory");
+              exit (-1);
+            }
+        }
+
+      if ((k = ccl_query_next (&query, &segment[num_segments])) != 1) break;
+
+      vertices += segment[num_segments].count;
+      bytes += segment[num_segments].size;
+      max_count = MAX (max_count, segment[num_segments].count);
+      num_segments++;
+    }
+
+  if (k < 0)
+    {
+      fprintf (stderr, "\n\n%s is truncated or corrupt!\n\n", name);
+      free (segment);
+      ccl_close (&reader);
+      return (-1);
+    }
+
+  fprintf (stderr, "%d segments, %"PRId64" vertices, %"PRId64" bytes (%.2f bits per vertex, %s offsets)\n",
+           num_segments, vertices, bytes, (double) bytes * 8.0 / MAX (vertices, 1),
+           reader.coding ? "Rice coded" : "fixed width");
+
+
+  /*  The reference output for the whole file (fixed point and degrees) so we can check the other kernels.  */
+
+  ref_x = (int32_t *) malloc (vertices * sizeof (int32_t));
+  ref_y = (int32_t *) malloc (vertices * sizeof (int32_t));
+  ref_lon = (double *) malloc (vertices * sizeof (double));
+  ref_lat = (double *) malloc (vertices * sizeof (double));
+  x = (int32_t *) malloc (max_count * sizeof (int32_t));
+  y = (int32_t *) malloc (max_count * sizeof (int32_t));
+  lon = (double *) malloc (max_count * sizeof (double));
+  lat = (double *) malloc (max_count * sizeof (double));
+
+  if (ref_x == NULL || ref_y == NULL || ref_lon == NULL || ref_lat == NULL || x == NULL || y == NULL || lon == NULL ||
+      lat == NULL)
+    {
+      perror ("Allocating benchmark memory");
+      exit (-1);
+    }
+
+  ccl_decode_select (CCL_DECODE_SCALAR);
+
+  for (i = 0, offset = 0 ; i < num_segments ; offset += segment[i].count, i++)
+    {
+      ccl_segment_decode (&segment[i], &ref_x[offset], &ref_y[offset]);
+      ccl_segment_degrees (&segment[i], &ref_lon[offset], &ref_lat[offset]);
+    }
+
+
+  /*  Enough passes to get a reasonable time.  */
+
+  passes = MAX (1, (int32_t) (50000000 / MAX (vertices, 1)));
+  mismatches = 0;
+
+  for (kernel = CCL_DECODE_SCALAR ; kernel <= CCL_DECODE_AVX2 ; kernel++)
+    {
+      if (ccl_decode_select (kernel) < 0) continue;
+
+      for (degrees = 0 ; degrees < 2 ; degrees++)
+        {
+          start = metrics_time ();
+
+          for (k = 0 ; k < passes ; k++)
+            {
+              for (i = 0 ; i < num_segments ; i++)
+                {
+                  if (degrees)
+                    {
+                      ccl_segment_degrees (&segment[i], lon, lat);
+                    }
+                  else
+                    {
+                      ccl_segment_decode (&segment[i], x, y);
+                    }
+                }
+            }
+
+          seconds = metrics_time () - start;
+          if (seconds <= 0.0) seconds = 1.0e-6;
+
+          fprintf (stderr, "%-8s %-12s %10.2f million vertices/second\n", ccl_decode_name (kernel),
+                   degrees ? "degrees" : "fixed point", (double) vertices * passes / seconds / 1.0e6);
+        }
+
+
+      /*  Check it.  */
+
+      for (i = 0, offset = 0 ; i < num_segments ; offset += segment[i].count, i++)
+        {
+          ccl_segment_decode (&segment[i], x, y);
+          ccl_segment_degrees (&segment[i], lon, lat);
+
+          if (memcmp (x, &ref_x[offset], segment[i].count * sizeof (int32_t)) ||
+              memcmp (y, &ref_y[offset], segment[i].count * sizeof (int32_t)) ||
+              memcmp (lon, &ref_lon[offset], segment[i].count * sizeof (double)) ||
+              memcmp (lat, &ref_lat[offset], segment[i].count * sizeof (double)))
+            {
+              if (!mismatches) fprintf (stderr, "The %s decoder does not match the scalar decoder for segment %d (cell %d %d)\n",
+                                        ccl_decode_name (kernel), i, segment[i].row, segment[i].col);
+              mismatches++;
+            }
+        }
+    }
+
+  fprintf (stderr, "%d segments did not match\n", mismatches);
+
+
+  ccl_decode_select (CCL_DECODE_AUTO);
+
+  free (ref_x);
+  free (ref_y);
+  free (ref_lon);
+  free (ref_lat);
+  free (x);
+  free (y);
+  free (lon);
+  free (lat);
+  free (segment);
+
+  ccl_close (&reader);
+
+  return (mismatches);
+}
+
+
+
+static int32_t compare_times (const void *a, const void *b)
+{
+  double            da = *(const double *) a, db = *(const double *) b;
+
+  return (da < db ? -1 : (da > db ? 1 : 0));
+}
+
+
+
+/*
+
+    Compare cell block compression settings on an existing .ccl file.  The full resolution block of every cell is
+    pulled out of the file (inflating it if the file is compressed) and then compressed on its own with each setting
+    (none and zlib levels 1, 6, and 9, the -K choices worth looking at).  For each one we print the total size, the
+    compression rate, and the time it takes to get the vertices for one cell (inflate the block and decode all of its
+    segments) as the mean, median, and 99th percentile over the cells.  The first pass over the cells checks that the
+    vertices match the original blocks, the second one is timed.  Returns the number of cells that didn't match.
+
+*/
+
+int32_t compress_benchmark (char *name)
+{
+  static const int32_t  level[4] = {0, 1, 6, 9};
+  static const char     *codec[4] = {"none", "zlib 1", "zlib 6", "zlib 9"};
+  CCL_READER        reader;
+  CCL_QUERY         query;
+  CCL_CELL          cell;
+  CCL_SEGMENT       *segment, copy;
+  int32_t           i, k, c, status, num_cells, num_segments, alloc, cell_alloc, *first, *count, *ref_x, *ref_y;
+  int32_t           *x, *y, max_count, pass, mismatches, bad;
+  int64_t           total_size, packed_size, bound, max_size, size, *offset, *extent;
+  const uint8_t     **block, *data, *end;
+  uint8_t           *packed, *inflated;
+  uLongf            length;
+  double            *latency, start, seconds, mean;
+
+
+  if (ccl_open (&reader, name))
+    {
+      perror (name);
+      return (-1);
+    }
+
+
+  /*  Find all of the cells and their segments.  The segments in a cell are one after the other so the block is from
+      the start of the first one to the end of the last one (a columnar block has its size in its header).  */
+
+  segment = NULL;
+  block = NULL;
+  extent = NULL;
+  first = count = NULL;
+  num_cells = num_segments = alloc = cell_alloc = max_count = 0;
+  total_size = max_size = bound = 0;
+  status = 0;
+
+  for (i = 0 ; i < CCL_ROWS * CCL_COLS && !status ; i++)
+    {
+      if (!ccl_cell (&reader, i / CCL_COLS, i % CCL_COLS, &cell)) continue;
+
+      if (num_cells == cell_alloc)
+        {
+          cell_alloc = cell_alloc ? cell_alloc * 2 : 1024;
+          block = (const uint8_t **) realloc (block, cell_alloc * sizeof (uint8_t *));
+          extent = (int64_t *) realloc (extent, cell_alloc * sizeof (int64_t));
+          first = (int32_t *) realloc (first, cell_alloc * sizeof (int32_t));
+          count = (int32_t *) realloc (count, cell_alloc * sizeof (int32_t));
+
+          if (block == NULL || extent == NULL || first == NULL || count == NULL)
+            {
+              perror ("Allocating benchmark memory");
+              exit (-1);
+            }
+        }
+
+      first[num_cells] = num_segments;
+
+      ccl_query_cell (&reader, &query, i / CCL_COLS, i % CCL_COLS);
+
+      while (NVTrue)
+        {
+          if (num_segments == alloc)
+            {
+              alloc = alloc ? alloc * 2 : 4096;
+              segment = (CCL_SEGMENT *) realloc (segment, alloc * sizeof (CCL_SEGMENT));
+
+              if (segment == NULL)
+                {
+                  perror ("Allocating benchmark memory");
+                  exit (-1);
+                }
+            }
+
+          if ((status = ccl_query_next (&query, &segment[num_segments])) != 1) break;
+
+          max_count = MAX (max_count, segment[num_segments].count);
+          num_segments++;
+        }
+
+      count[num_cells] = num_segments - first[num_cells];
+
+      if (count[num_cells])
+        {
+          if (reader.columnar)
+            {
+              block[num_cells] = ccl_cell_data (&reader, 0, i / CCL_COLS, i % CCL_COLS, &end);
+              size = ccl_get_bits (block[num_cells], 74, 32);
+            }
+          else
+            {
+              block[num_cells] = segment[first[num_cells]].data;
+              size = (segment[num_segments - 1].data + segment[num_segments - 1].size) - block[num_cells];
+            }
+
+          extent[num_cells] = size;
+          total_size += size;
+          max_size = MAX (max_size, size);
+          bound += compressBound (size);
+          num_cells++;
+        }
+    }
+
+  if (status < 0 || !num_cells)
+    {
+      fprintf (stderr, "\n\n%s is %s!\n\n", name, status < 0 ? "truncated or corrupt" : "empty");
+      free (segment);
+      free (block);
+      free (extent);
+      free (first);
+      free (count);
+      ccl_close (&reader);
+      return (-1);
+    }
+
+  fprintf (stderr, "%d cells, %d segments, %.2f MB of cell blocks\n\n", num_cells, num_segments,
+           (double) total_size / 1048576.0);
+
+
+  offset = (int64_t *) malloc ((num_cells + 1) * sizeof (int64_t));
+  packed = (uint8_t *) malloc (bound);
+  inflated = (uint8_t *) malloc (max_size);
+  latency = (double *) malloc (num_cells * sizeof (double));
+  ref_x = (int32_t *) malloc (max_count * sizeof (int32_t));
+  ref_y = (int32_t *) malloc (max_count * sizeof (int32_t));
+  x = (int32_t *) malloc (max_count * sizeof (int32_t));
+  y = (int32_t *) malloc (max_count * sizeof (int32_t));
+
+  if (offset == NULL || packed == NULL || inflated == NULL || latency == NULL || ref_x == NULL || ref_y == NULL ||
+      x == NULL || y == NULL)
+    {
+      perror ("Allocating benchmark memory");
+      exit (-1);
+    }
+
+
+  fprintf (stderr, "%-8s %12s %8s %14s %14s %14s %14s\n", "codec", "size (MB)", "ratio", "compress MB/s",
+           "mean us/cell", "median us/cell", "p99 us/cell");
+
+  mismatches = 0;
+
+  for (c = 0 ; c < 4 ; c++)
+    {
+      /*  Compress each cell block on its own, one after the other.  */
+
+      start = metrics_time ();
+
+      offset[0] = 0;
+      for (i = 0 ; i < num_cells ; i++)
+        {
+          length = extent[i];
+
+          if (level[c])
+            {
+              size = length;
+              length = compressBound (size);
+
+              if (compress2 (packed + offset[i], &length, block[i], size, level[c]) != Z_OK)
+                {
+                  fprintf (stderr, "\n\nUnable to compress cell %d %d\n\n", segment[first[i]].row,
+                           segment[first[i]].col);
+                  exit (-1);
+                }
+
+            }
+
+          offset[i + 1] = offset[i] + length;
+        }
+
+      packed_size = offset[num_cells] + (level[c] ? (int64_t) num_cells * CCL_BLOCK_HEADER : 0);
+
+      seconds = metrics_time () - start;
+      if (seconds <= 0.0) seconds = 1.0e-6;
+
+
+      /*  Get the vertices for each cell, checking them on the first pass and timing them on the second.  */
+
+      for (pass = 0 ; pass < 2 ; pass++)
+        {
+          for (i = 0 ; i < num_cells ; i++)
+            {
+              start = metrics_time ();
+
+              if (level[c])
+                {
+                  length = max_size;
+                  if (uncompress (inflated, &length, packed + offset[i], offset[i + 1] - offset[i]) != Z_OK)
+                    {
+                      fprintf (stderr, "\n\nUnable to inflate cell %d %d\n\n", segment[first[i]].row,
+                               segment[first[i]].col);
+                      exit (-1);
+                    }
+
+                  data = inflated;
+                }
+              else
+                {
+                  data = block[i];
+                }
+
+              for (k = 0, bad = 0 ; k < count[i] ; k++)
+                {
+                  copy = segment[first[i] + k];
+                  copy.data = data + (copy.data - block[i]);
+                  if (copy.lat_data != NULL) copy.lat_data = data + (copy.lat_data - block[i]);
+
+                  ccl_segment_decode (&copy, x, y);
+
+                  if (!pass)
+                    {
+                      ccl_segment_decode (&segment[first[i] + k], ref_x, ref_y);
+
+                      if (memcmp (x, ref_x, copy.count * sizeof (int32_t)) ||
+                          memcmp (y, ref_y, copy.count * sizeof (int32_t)))
+                        bad = 1;
+                    }
+                }
+
+              latency[i] = metrics_time () - start;
+              mismatches += bad;
+            }
+        }
+
+      qsort (latency, num_cells, sizeof (double), compare_times);
+
+      for (i = 0, mean = 0.0 ; i < num_cells ; i++) mean += latency[i];
+      mean /= num_cells;
+
+      fprintf (stderr, "%-8s %12.2f %8.2f %14.1f %14.2f %14.2f %14.2f\n", codec[c], (double) packed_size / 1048576.0,
+               (double) total_size / packed_size, level[c] ? (double) total_size / seconds / 1048576.0 : 0.0,
+               mean * 1.0e6, latency[num_cells / 2] * 1.0e6, latency[num_cells * 99 / 100] * 1.0e6);
+    }
+
+  fprintf (stderr, "\n%d cells did not match\n", mismatches);
+
+
+  free (offset);
+  free (packed);
+  free (inflated);
+  free (latency);
+  free (ref_x);
+  free (ref_y);
+  free (x);
+  free (y);
+  free (segment);
+  free (block);
+  free (extent);
+  free (first);
+  free (count);
+
+  ccl_close (&reader);
+
+  return (mismatches);
+}
+
+
+
+/*  One batch of cache lookups.  90% of them go to the hot cells, the rest are spread over the whole file.  */
+
+static void cache_task (int32_t task, int32_t thread, void *data)
+{
+  CACHE_JOB         *job = (CACHE_JOB *) data;
+  const CCL_CACHED_CELL *cell;
+  uint32_t          seed;
+  int32_t           i, key;
+  int64_t           sum;
+
+
+  (void) thread;
+
+  seed = 2654435761U * (task + 1);
+  sum = 0;
+
+  for (i = 0 ; i < job->lookups ; i++)
+    {
+      seed = seed * 1103515245U + 12345U;
+
+      if ((seed >> 16) % 10)
+        {
+          key = job->cell[(seed >> 8) % job->num_hot];
+        }
+      else
+        {
+          key = job->cell[(seed >> 8) % job->num_cells];
+        }
+
+      if ((cell = ccl_cache_get (job->cache, key / CCL_COLS, key % CCL_COLS)) != NULL)
+        {
+          sum += cell->x[cell->num_vertices - 1];
+          ccl_cache_release (job->cache, cell);
+        }
+    }
+
+  job->sum[task] = sum;
+}
+
+
+
+/*
+
+    Hammer the decoded cell cache with num_threads threads looking up the cells in a .ccl file (mostly a small hot set,
+    like the cells around a survey area) and report the lookup rate and the cache counters.  Afterwards every cell in
+    the cache is checked against a fresh decode.  Returns the number of cells that didn't match (or -1 if the file
+    couldn't be read).
+
+*/
+
+int32_t cache_benchmark (char *name, int32_t num_threads, int64_t budget)
+{
+  CCL_READER        reader;
+  CCL_CACHE         cache;
+  CCL_CACHE_STATS   stats;
+  CCL_CELL          entry;
+  CCL_QUERY         query;
+  CCL_SEGMENT       segment;
+  CACHE_JOB         job;
+  const CCL_CACHED_CELL *cell;
+  int32_t           i, k, num_tasks, mismatches, *x, *y, alloc, offset;
+  double            start, seconds;
+
+
+  if (ccl_open (&reader, name))
+    {
+      perror (name);
+      return (-1);
+    }
+
+  if (ccl_cache_init (&cache, &reader, budget, 0))
+    {
+      perror ("Allocating the cell cache");
+      exit (-1);
+    }
+
+
+  /*  The cells that have data, the hot set is the first 10% of them (at least 1).  */
+
+  memset (&job, 0, sizeof (CACHE_JOB));
+
+  job.cache = &cache;
+  job.cell = (int32_t *) malloc (CCL_ROWS * CCL_COLS * sizeof (int32_t));
+
+  num_tasks = 256;
+  job.lookups = 4000;
+  job.sum = (int64_t *) calloc (num_tasks, sizeof (int64_t));
+
+  if (job.cell == NULL || job.sum == NULL)
+    {
+      perror ("Allocating benchmark memory");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < CCL_ROWS * CCL_COLS ; i++)
+    {
+      if (ccl_cell (&reader, i / CCL_COLS, i % CCL_COLS, &entry)) job.cell[job.num_cells++] = i;
+    }
+
+  if (!job.num_cells)
+    {
+      fprintf (stderr, "%s has no data\n", name);
+      ccl_cache_free (&cache);
+      ccl_close (&reader);
+      return (-1);
+    }
+
+  job.num_hot = MAX (1, job.num_cells / 10);
+
+
+  start = metrics_time ();
+
+  pool_run (num_threads, num_tasks, cache_task, &job);
+
+  seconds = MAX (metrics_time () - start, 1.0e-6);
+
+
+  ccl_cache_stats (&cache, &stats);
+
+  fprintf (stderr, "%d threads, %d cells (%d hot), %.2f million lookups/second\n", num_threads, job.num_cells, job.num_hot,
+           (double) num_tasks * job.lookups / seconds / 1.0e6);
+  fprintf (stderr, "%"PRId64" hits, %"PRId64" misses, %"PRId64" evictions, %"PRId64" corrupt, %d cells (%"PRId64
+           " bytes) cached\n", stats.hits, stats.misses, stats.evictions, stats.corrupt, stats.cells, stats.bytes);
+
+
+  /*  Check everything that's still in the cache (looking it up doesn't change the set when it's already there).  */
+
+  x = y = NULL;
+  alloc = 0;
+  mismatches = 0;
+
+  for (i = 0 ; i < cache.num_shards ; i++)
+    {
+      for (cell = cache.shard[i].head ; cell != NULL ; cell = cell->next)
+        {
+          ccl_query_cell (&reader, &query, cell->row, cell->col);
+
+          k = offset = 0;
+          while (ccl_query_next (&query, &segment) == 1)
+            {
+              if (segment.count > alloc)
+                {
+                  alloc = segment.count;
+                  x = (int32_t *) realloc (x, alloc * sizeof (int32_t));
+                  y = (int32_t *) realloc (y, alloc * sizeof (int32_t));
+
+                  if (x == NULL || y == NULL)
+                    {
+                      perror ("Allocating benchmark memory");
+                      exit (-1);
+                    }
+                }
+
+              ccl_segment_decode (&segment, x, y);
+
+              if (k >= cell->num_segments || cell->start[k] != offset || cell->start[k + 1] - offset != segment.count ||
+                  memcmp (x, &cell->x[offset], segment.count * sizeof (int32_t)) ||
+                  memcmp (y, &cell->y[offset], segment.count * sizeof (int32_t)))
+                {
+                  mismatches++;
+                  break;
+                }
+
+              k++;
+              offset += segment.count;
+            }
+        }
+    }
+
+  fprintf (stderr, "%d cached cells did not match\n", mismatches);
+
+
+  free (x);
+  free (y);
+  free (job.cell);
+  free (job.sum);
+
+  ccl_cache_free (&cache);
+  ccl_close (&reader);
+
+  return (mismatches);
+}
+
+
+
+/*  Print the results of a distance batch.  */
+
+static void distance_report (CCL_DISTANCE *engine, int64_t num_points, int8_t *land, double seconds)
+{
+  int64_t           i, counts[3];
+
+
+  counts[0] = counts[1] = counts[2] = 0;
+
+  for (i = 0 ; i < num_points ; i++) counts[land[i] + 1]++;
+
+  fprintf (stderr, "%"PRId64" points in %.3f seconds, %.0f points per second\n", num_points, seconds,
+           seconds > 0.0 ? (double) num_points / seconds : 0.0);
+  fprintf (stderr, "%"PRId64" water, %"PRId64" land, %"PRId64" with no coastline within %.0f meters\n", counts[1],
+           counts[2], counts[0], engine->max_distance);
+  fprintf (stderr, "%d cells loaded (%.1f MB)\n", engine->cells, (double) engine->bytes / (1024.0 * 1024.0));
+}
+
+
+
+/*
+
+    Compute the distance to the coastline and land/water for a file of points.  The input is lon/lat pairs (in degrees,
+    native byte order doubles) and the output is lon, lat, distance (meters, -1 if there's no coastline within
+    max_distance), and land (1 for land, 0 for water, -1 for unknown) for each point, also as doubles.  Returns 0 or
+    -1 on failure.
+
+*/
+
+int32_t distance_points (char *name, char *points_name, char *output_name, int32_t num_threads, double max_distance)
+{
+  CCL_READER        reader;
+  CCL_DISTANCE      engine;
+  MAPPED_FILE       points;
+  FILE              *ofp;
+  int64_t           i, num_points;
+  double            *distance, start, record[4];
+  const double      *point;
+  int8_t            *land;
+
+
+  if (ccl_open (&reader, name))
+    {
+      perror (name);
+      return (-1);
+    }
+
+  if (map_file (&points, points_name, 1))
+    {
+      perror (points_name);
+      ccl_close (&reader);
+      return (-1);
+    }
+
+  num_points = points.size / (2 * sizeof (double));
+  point = (const double *) points.data;
+
+  distance = (double *) malloc (MAX (1, num_points) * sizeof (double));
+  land = (int8_t *) malloc (MAX (1, num_points) * sizeof (int8_t));
+
+  if (distance == NULL || land == NULL || ccl_distance_init (&engine, &reader, max_distance))
+    {
+      perror ("Allocating distance memory");
+      exit (-1);
+    }
+
+
+  start = metrics_time ();
+
+  if (ccl_distance_batch (&engine, num_threads, num_points, point, distance, land))
+    {
+      perror ("Allocating distance memory");
+      exit (-1);
+    }
+
+  distance_report (&engine, num_points, land, metrics_time () - start);
+
+
+  if ((ofp = fopen (output_name, "wb")) == NULL)
+    {
+      perror (output_name);
+      exit (-1);
+    }
+
+  setvbuf (ofp, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+  for (i = 0 ; i < num_points ; i++)
+    {
+      record[0] = point[2 * i];
+      record[1] = point[2 * i + 1];
+      record[2] = distance[i];
+      record[3] = land[i];
+
+      if (fwrite (record, sizeof (record), 1, ofp) != 1)
+        {
+          perror (output_name);
+          exit (-1);
+        }
+    }
+
+  if (fclose (ofp))
+    {
+      perror (output_name);
+      exit (-1);
+    }
+
+
+  free (distance);
+  free (land);
+  ccl_distance_free (&engine);
+  unmap_file (&points);
+  ccl_close (&reader);
+
+  return (0);
+}
+
+
+
+/*  The distance from a point to the nearest edge within max_distance (or -1) found by decoding every segment in all of
+    the cells within max_distance.  Same metric as ccl_distance_point.  x, y, and alloc are the caller's decode
+    buffers.  */
+
+static double brute_force_distance (CCL_READER *reader, double lon, double lat, double max_distance, int32_t **x,
+                                    int32_t **y, int32_t *alloc)
+{
+  CCL_QUERY         query;
+  CCL_SEGMENT       segment;
+  int32_t           k, *sx, *sy;
+  double            px, py, scale_x, scale_y, dlon, dlat, west, east, best, ax, ay, dx, dy, length, t, qx, qy, d, shift;
+
+
+  px = (lon + 180.0) * CCL_SCALE;
+  py = (lat + 90.0) * CCL_SCALE;
+  scale_y = CCL_METERS_PER_DEGREE / CCL_SCALE;
+  scale_x = scale_y * MAX (cos (lat * 0.017453292519943295), 0.01);
+
+  dlat = max_distance / CCL_METERS_PER_DEGREE + 0.01;
+  dlon = MIN (179.0, max_distance / (scale_x * CCL_SCALE) + 0.01);
+
+  west = lon - dlon;
+  east = lon + dlon;
+  if (west < -180.0) west += 360.0;
+  if (east > 180.0) east -= 360.0;
+
+  best = max_distance * max_distance;
+
+  ccl_query_start (reader, &query, west, east, MAX (-90.0, lat - dlat), MIN (90.0, lat + dlat));
+
+  while (ccl_query_next (&query, &segment) == 1)
+    {
+      if (segment.count > *alloc)
+        {
+          *alloc = segment.count;
+          *x = (int32_t *) realloc (*x, *alloc * sizeof (int32_t));
+          *y = (int32_t *) realloc (*y, *alloc * sizeof (int32_t));
+
+          if (*x == NULL || *y == NULL)
+            {
+              perror ("Allocating benchmark memory");
+              exit (-1);
+            }
+        }
+
+      sx = *x;
+      sy = *y;
+
+      ccl_segment_decode (&segment, sx, sy);
+
+
+      /*  Move cells on the other side of the date line next to the point.  */
+
+      shift = 0.0;
+      if (sx[0] - px > 180.0 * CCL_SCALE) shift = -360.0 * CCL_SCALE;
+      if (sx[0] - px < -180.0 * CCL_SCALE) shift = 360.0 * CCL_SCALE;
+
+      for (k = 0 ; k < segment.count - 1 ; k++)
+        {
+          ax = (sx[k] + shift - px) * scale_x;
+          ay = (sy[k] - py) * scale_y;
+          dx = (sx[k + 1] + shift - px) * scale_x - ax;
+          dy = (sy[k + 1] - py) * scale_y - ay;
+
+          length = dx * dx + dy * dy;
+          t = (length > 0.0) ? MAX (0.0, MIN (1.0, -(ax * dx + ay * dy) / length)) : 0.0;
+
+          qx = ax + t * dx;
+          qy = ay + t * dy;
+          d = qx * qx + qy * qy;
+
+          best = MIN (best, d);
+        }
+    }
+
+  return (best < max_distance * max_distance ? sqrt (best) : -1.0);
+}
+
+
+
+/*
+
+    Benchmark the distance engine on an existing .ccl file with a million random points in the cells that have data
+    (so they're all near some coastline).  The batch is run twice, once with nothing loaded and once with all of the
+    cells loaded.  Some of the distances are then checked against decoding every segment near the point.  Returns the
+    number of points that didn't match (or -1 if the file couldn't be read).
+
+*/
+
+int32_t distance_benchmark (char *name, int32_t num_threads, double max_distance)
+{
+  CCL_READER        reader;
+  CCL_DISTANCE      engine;
+  CCL_CELL          entry;
+  int32_t           i, num_cells, *cell, mismatches, pass, *x, *y, alloc;
+  int64_t           num_points, p;
+  uint32_t          seed;
+  double            *point, *distance, start, check;
+  int8_t            *land;
+
+
+  if (ccl_open (&reader, name))
+    {
+      perror (name);
+      return (-1);
+    }
+
+  num_points = 1000000;
+
+  cell = (int32_t *) malloc (CCL_ROWS * CCL_COLS * sizeof (int32_t));
+  point = (double *) malloc (2 * num_points * sizeof (double));
+  distance = (double *) malloc (num_points * sizeof (double));
+  land = (int8_t *) malloc (num_points * sizeof (int8_t));
+
+  if (cell == NULL || point == NULL || distance == NULL || land == NULL ||
+      ccl_distance_init (&engine, &reader, max_distance))
+    {
+      perror ("Allocating benchmark memory");
+      exit (-1);
+    }
+
+  num_cells = 0;
+  for (i = 0 ; i < CCL_ROWS * CCL_COLS ; i++)
+    {
+      if (ccl_cell (&reader, i / CCL_COLS, i % CCL_COLS, &entry)) cell[num_cells++] = i;
+    }
+
+  if (!num_cells)
+    {
+      fprintf (stderr, "%s has no data\n", name);
+      ccl_distance_free (&engine);
+      ccl_close (&reader);
+      return (-1);
+    }
+
+
+  seed = 12345;
+  for (p = 0 ; p < num_points ; p++)
+    {
+      seed = seed * 1103515245U + 12345U;
+      i = cell[(seed >> 8) % num_cells];
+
+      seed = seed * 1103515245U + 12345U;
+      point[2 * p] = i % CCL_COLS - 180.0 + (double) (seed >> 8) / 16777216.0;
+
+      seed = seed * 1103515245U + 12345U;
+      point[2 * p + 1] = i / CCL_COLS - 90.0 + (double) (seed >> 8) / 16777216.0;
+    }
+
+
+  for (pass = 0 ; pass < 2 ; pass++)
+    {
+      fprintf (stderr, "%s, %d threads:\n", pass ? "Cells loaded" : "Nothing loaded", num_threads);
+
+      start = metrics_time ();
+
+      if (ccl_distance_batch (&engine, num_threads, num_points, point, distance, land))
+        {
+          perror ("Allocating benchmark memory");
+          exit (-1);
+        }
+
+      distance_report (&engine, num_points, land, metrics_time () - start);
+      fprintf (stderr, "\n");
+    }
+
+
+  /*  Check every 1000th point the slow way.  */
+
+  x = y = NULL;
+  alloc = 0;
+  mismatches = 0;
+
+  for (p = 0 ; p < num_points ; p += 1000)
+    {
+      check = brute_force_distance (&reader, point[2 * p], point[2 * p + 1], max_distance, &x, &y, &alloc);
+
+      if (fabs (check - distance[p]) > 1.0e-6 * MAX (1.0, check))
+        {
+          if (mismatches < 10) fprintf (stderr, "Point %.7f %.7f distance %.3f, should be %.3f\n", point[2 * p],
+                                        point[2 * p + 1], distance[p], check);
+          mismatches++;
+        }
+    }
+
+  fprintf (stderr, "%d of %"PRId64" checked points did not match\n", mismatches, num_points / 1000);
+
+
+  free (x);
+  free (y);
+  free (cell);
+  free (point);
+  free (distance);
+  free (land);
+  ccl_distance_free (&engine);
+  ccl_close (&reader);
+
+  return (mismatches);
+}
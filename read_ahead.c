@@ -0,0 +1,286 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NVWIN3X
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+#include "nvutility.h"
+
+#include "metrics.h"
+#include "read_ahead.h"
+
+
+/*
+
+    Shape file read-ahead.  The cell workers open a shape file, read every shape in it, and move on to the next one
+    so on slow (or far away) storage they spend most of their time waiting for the first read of each file.  Since
+    they take the files strictly in order we know what they'll want next, so a few I/O threads read the next files
+    into the file cache while the workers are busy converting and splitting the current ones.  Where the system has
+    posix_fadvise we first tell it that we'll need the whole file (so all of its reads get queued at once instead of
+    one readahead window at a time) and then read it through to wait for it to get there.  Elsewhere we just read it
+    through.  The data we read is thrown away, the workers read the files the same way they always have (mapped or
+    with shapelib) and just find them already in memory.
+
+*/
+
+
+
+/*  Pull one file into the file cache.  Returns the number of bytes read (0 if it couldn't be opened, the worker will
+    complain about it when it gets there).  */
+
+static int64_t read_file (char *name, uint8_t *buffer)
+{
+  int64_t           bytes = 0;
+
+
+#ifdef NVWIN3X
+
+  FILE              *fp;
+  size_t            n;
+
+
+  if ((fp = fopen (name, "rb")) == NULL) return (0);
+
+  while ((n = fread (buffer, 1, READ_AHEAD_CHUNK, fp)) > 0) bytes += n;
+
+  fclose (fp);
+
+#else
+
+  int               fd;
+  ssize_t           n;
+
+
+  if ((fd = open (name, O_RDONLY)) < 0) return (0);
+
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+  while ((n = read (fd, buffer, READ_AHEAD_CHUNK)) > 0) bytes += n;
+
+  close (fd);
+
+#endif
+
+  return (bytes);
+}
+
+
+
+/*  I/O thread.  Takes the next file (in order) whenever there's room in the window.  */
+
+static void *read_ahead_thread (void *data)
+{
+  READ_AHEAD        *ahead = (READ_AHEAD *) data;
+  char              shxname[512];
+  uint8_t           *buffer;
+  int32_t           i, len;
+  int64_t           bytes;
+
+
+  if ((buffer = (uint8_t *) malloc (READ_AHEAD_CHUNK)) == NULL)
+    {
+      perror ("Allocating read-ahead memory");
+      exit (-1);
+    }
+
+  pthread_mutex_lock (&ahead->mutex);
+
+  for (;;)
+    {
+      while (ahead->next < ahead->num_files && ahead->name[ahead->next] == NULL) ahead->next++;
+
+      if (ahead->next >= ahead->num_files) break;
+
+      if (ahead->outstanding >= ahead->window)
+        {
+          pthread_cond_wait (&ahead->cond, &ahead->mutex);
+          continue;
+        }
+
+      i = ahead->next++;
+      ahead->outstanding++;
+
+      pthread_mutex_unlock (&ahead->mutex);
+
+
+      /*  The index has the same name with a .shx (or .SHX) extension.  */
+
+      bytes = read_file (ahead->name[i], buffer);
+
+      strcpy (shxname, ahead->name[i]);
+      len = strlen (shxname);
+      if (len >= 4)
+        {
+          strcpy (&shxname[len - 3], (shxname[len - 3] == 'S') ? "SHX" : "shx");
+          bytes += read_file (shxname, buffer);
+        }
+
+
+      pthread_mutex_lock (&ahead->mutex);
+
+      ahead->ready[i] = NVTrue;
+      ahead->queued++;
+      ahead->files++;
+      ahead->bytes += bytes;
+
+      pthread_cond_broadcast (&ahead->cond);
+    }
+
+  pthread_mutex_unlock (&ahead->mutex);
+
+  free (buffer);
+
+  return (NULL);
+}
+
+
+
+/*
+
+    Start the I/O threads for a list of shape files.  name[i] is the shape file for task i (NULL for the ones that
+    shouldn't be read ahead, tiles in zip archives for instance).  The cell workers call read_ahead_get for file i
+    before they open it, which waits for it to be read, and read_ahead_release when they're done with it.  The files
+    are read in order so the workers should take them in the same order.  window should be the number of files to
+    read ahead plus the number of workers (each one holds a file while it's reading it).
+
+*/
+
+void read_ahead_start (READ_AHEAD *ahead, int32_t num_files, char **name, int32_t num_threads, int32_t window)
+{
+  int32_t           i;
+
+
+  memset (ahead, 0, sizeof (READ_AHEAD));
+
+  ahead->num_files = num_files;
+  ahead->name = name;
+  ahead->window = MAX (window, 1);
+  ahead->num_threads = MAX (1, MIN (num_threads, READ_AHEAD_MAX_THREADS));
+
+  ahead->ready = (uint8_t *) calloc (MAX (num_files, 1), sizeof (uint8_t));
+  ahead->thread = (pthread_t *) calloc (ahead->num_threads, sizeof (pthread_t));
+
+  if (ahead->ready == NULL || ahead->thread == NULL)
+    {
+      perror ("Allocating read-ahead memory");
+      exit (-1);
+    }
+
+  pthread_mutex_init (&ahead->mutex, NULL);
+  pthread_cond_init (&ahead->cond, NULL);
+
+  for (i = 0 ; i < ahead->num_threads ; i++)
+    {
+      if (pthread_create (&ahead->thread[i], NULL, read_ahead_thread, ahead))
+        {
+          perror ("Starting read-ahead thread");
+          exit (-1);
+        }
+    }
+}
+
+
+
+/*  Wait for file index to be read.  The queue depth and the time spent waiting go in the stats.  */
+
+void read_ahead_get (READ_AHEAD *ahead, int32_t index)
+{
+  double            start;
+
+
+  pthread_mutex_lock (&ahead->mutex);
+
+  ahead->gets++;
+  ahead->depth += ahead->queued;
+  ahead->max_depth = MAX (ahead->max_depth, ahead->queued);
+
+  if (!ahead->ready[index])
+    {
+      ahead->stalls++;
+      start = metrics_time ();
+
+      while (!ahead->ready[index]) pthread_cond_wait (&ahead->cond, &ahead->mutex);
+
+      ahead->stall += metrics_time () - start;
+    }
+
+  ahead->queued--;
+
+  pthread_mutex_unlock (&ahead->mutex);
+}
+
+
+
+/*  Done with file index, make room for the I/O threads to get another one going.  */
+
+void read_ahead_release (READ_AHEAD *ahead, int32_t index)
+{
+  (void) index;
+
+  pthread_mutex_lock (&ahead->mutex);
+
+  ahead->outstanding--;
+  pthread_cond_broadcast (&ahead->cond);
+
+  pthread_mutex_unlock (&ahead->mutex);
+}
+
+
+
+/*  Wait for the I/O threads to finish and free everything.  Every file has to have been released.  */
+
+void read_ahead_finish (READ_AHEAD *ahead)
+{
+  int32_t           i;
+
+
+  for (i = 0 ; i < ahead->num_threads ; i++) pthread_join (ahead->thread[i], NULL);
+
+  pthread_mutex_destroy (&ahead->mutex);
+  pthread_cond_destroy (&ahead->cond);
+
+  free (ahead->ready);
+  free (ahead->thread);
+}
@@ -0,0 +1,100 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __READ_AHEAD_H__
+#define __READ_AHEAD_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <pthread.h>
+
+
+  /*  Most I/O threads we'll start, no matter how far ahead we're asked to read.  */
+
+#define READ_AHEAD_MAX_THREADS  16
+
+
+  /*  Size of the buffer each I/O thread reads the files through.  */
+
+#define READ_AHEAD_CHUNK     (1024 * 1024)
+
+
+  /*  The read-ahead stage.  A pool of I/O threads reads the shape files (and their .shx indexes), in order, into the
+      system's file cache ahead of the cell workers so the workers don't sit idle waiting on the disk.  At most window
+      files are read (or being read) and not yet released at any one time so the read-ahead stays a bounded distance
+      in front of the workers and doesn't push the files they're about to use back out of the cache.  depth is the
+      number of files that were ready and waiting each time a worker asked for one and stall is the time the workers
+      spent waiting for files that weren't.  */
+
+  typedef struct
+  {
+    int32_t           num_files;
+    char              **name;                 /*  Shape file names, NULL for the ones we don't read ahead  */
+    uint8_t           *ready;
+    int32_t           window;
+    int32_t           next;                   /*  Next file to read  */
+    int32_t           outstanding;            /*  Files read (or being read) and not released  */
+    int32_t           queued;                 /*  Files read that no worker has asked for yet  */
+    int32_t           files;
+    int64_t           bytes;
+    int32_t           gets;                   /*  Number of files the workers asked for  */
+    int64_t           depth;                  /*  Sum of queued at each get  */
+    int32_t           max_depth;
+    int32_t           stalls;                 /*  Number of gets that had to wait  */
+    double            stall;                  /*  Seconds spent waiting  */
+    int32_t           num_threads;
+    pthread_t         *thread;
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+  } READ_AHEAD;
+
+
+  void read_ahead_start (READ_AHEAD *ahead, int32_t num_files, char **name, int32_t num_threads, int32_t window);
+  void read_ahead_get (READ_AHEAD *ahead, int32_t index);
+  void read_ahead_release (READ_AHEAD *ahead, int32_t index);
+  void read_ahead_finish (READ_AHEAD *ahead);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,364 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NVWIN3X
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+#include "nvutility.h"
+
+#include "shp_map.h"
+
+
+/*
+
+    A purpose built, zero copy shape file reader.  The .shp and .shx files are memory mapped and shapes are returned
+    as pointers into the mapped .shp file so nothing gets allocated per shape (shapelib's SHPReadObject allocates and
+    fills X, Y, Z, M, and part arrays for every record).  The shape file format is described in the ESRI Shapefile
+    Technical Description (July 1998).  The file header and record headers are big endian, everything else is little
+    endian.  Since we hand back pointers to the raw little endian doubles this is only used on little endian systems.
+
+*/
+
+
+static int32_t get_be_int (const uint8_t *ptr)
+{
+  return ((int32_t) (((uint32_t) ptr[0] << 24) | ((uint32_t) ptr[1] << 16) | ((uint32_t) ptr[2] << 8) | (uint32_t) ptr[3]));
+}
+
+
+
+/*  Returns NVTrue if the mapped reader can be used on this system (i.e. it's little endian).  */
+
+uint8_t shp_map_supported ()
+{
+  uint32_t          one = 1;
+
+  return (*((uint8_t *) &one) == 1);
+}
+
+
+
+/*  Map a whole file read-only.  Set sequential to NVTrue if the file is going to be read front to back (this turns on
+    aggressive read ahead), otherwise the pages are only read as they're touched.  Returns 0 on success or -1 on
+    failure (with errno set).  */
+
+int32_t map_file (MAPPED_FILE *file, char *name, uint8_t sequential)
+{
+  memset (file, 0, sizeof (MAPPED_FILE));
+
+#ifdef NVWIN3X
+  LARGE_INTEGER     size;
+
+  file->file_handle = CreateFileA (name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file->file_handle == INVALID_HANDLE_VALUE) return (-1);
+
+  if (!GetFileSizeEx (file->file_handle, &size))
+    {
+      CloseHandle (file->file_handle);
+      return (-1);
+    }
+
+  file->size = size.QuadPart;
+
+  if (file->size)
+    {
+      file->map_handle = CreateFileMappingA (file->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (file->map_handle == NULL)
+        {
+          CloseHandle (file->file_handle);
+          return (-1);
+        }
+
+      file->data = (uint8_t *) MapViewOfFile (file->map_handle, FILE_MAP_READ, 0, 0, 0);
+      if (file->data == NULL)
+        {
+          CloseHandle (file->map_handle);
+          CloseHandle (file->file_handle);
+          return (-1);
+        }
+    }
+#else
+  int32_t           fd;
+  struct stat       st;
+  void              *ptr;
+
+  if ((fd = open (name, O_RDONLY)) < 0) return (-1);
+
+  if (fstat (fd, &st))
+    {
+      close (fd);
+      return (-1);
+    }
+
+  file->size = (int64_t) st.st_size;
+
+  if (file->size)
+    {
+      ptr = mmap (NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED)
+        {
+          close (fd);
+          return (-1);
+        }
+
+
+      if (sequential)
+        {
+          /*  The advice values aren't flags so they have to be given one at a time.  */
+
+          madvise (ptr, file->size, MADV_SEQUENTIAL);
+          madvise (ptr, file->size, MADV_WILLNEED);
+        }
+      else
+        {
+          madvise (ptr, file->size, MADV_RANDOM);
+        }
+
+      file->data = (uint8_t *) ptr;
+    }
+
+
+  /*  The mapping stays valid after the descriptor is closed.  */
+
+  close (fd);
+#endif
+
+  return (0);
+}
+
+
+
+void unmap_file (MAPPED_FILE *file)
+{
+#ifdef NVWIN3X
+  if (file->data != NULL) UnmapViewOfFile (file->data);
+  if (file->map_handle != NULL) CloseHandle (file->map_handle);
+  if (file->file_handle != NULL) CloseHandle (file->file_handle);
+#else
+  if (file->data != NULL) munmap (file->data, file->size);
+#endif
+
+  memset (file, 0, sizeof (MAPPED_FILE));
+}
+
+
+
+/*  Check the index header and get the number of records.  Returns 0 or -1 if it isn't a shape file.  */
+
+static int32_t shp_map_header (SHP_MAP *map)
+{
+  int32_t           num;
+
+
+  if (map->shp.size < 100 || map->shx.size < 100 || get_be_int (map->shx.data) != 9994) return (-1);
+
+
+  /*  Number of records from the file length in the index header (in 16 bit words).  */
+
+  num = (int32_t) ((get_be_int (&map->shx.data[24]) * 2 - 100) / 8);
+  if (num < 0 || 100 + (int64_t) num * 8 > map->shx.size) num = (int32_t) ((map->shx.size - 100) / 8);
+
+  map->num_shapes = num;
+
+  return (0);
+}
+
+
+
+/*  Map the .shp file and its .shx index.  Returns 0 on success, -1 on failure.  */
+
+int32_t shp_map_open (SHP_MAP *map, char *shpname)
+{
+  char              shxname[512];
+  int32_t           len;
+
+
+  memset (map, 0, sizeof (SHP_MAP));
+
+  if (map_file (&map->shp, shpname, NVTrue)) return (-1);
+
+
+  /*  The index has the same name with a .shx (or .SHX) extension.  */
+
+  strcpy (shxname, shpname);
+  len = strlen (shxname);
+  if (len < 4)
+    {
+      unmap_file (&map->shp);
+      return (-1);
+    }
+
+  strcpy (&shxname[len - 3], (shxname[len - 3] == 'S') ? "SHX" : "shx");
+
+  if (map_file (&map->shx, shxname, NVTrue))
+    {
+      unmap_file (&map->shp);
+      return (-1);
+    }
+
+
+  if (shp_map_header (map))
+    {
+      shp_map_close (map);
+      return (-1);
+    }
+
+  return (0);
+}
+
+
+
+/*  Use a .shp and .shx that are already in memory (inflated from a zip archive, for instance).  The buffers still
+    belong to the caller so don't call shp_map_close.  Returns 0 or -1 if they don't look like a shape file.  */
+
+int32_t shp_map_memory (SHP_MAP *map, uint8_t *shp, int64_t shp_size, uint8_t *shx, int64_t shx_size)
+{
+  memset (map, 0, sizeof (SHP_MAP));
+
+  map->shp.data = shp;
+  map->shp.size = shp_size;
+  map->shx.data = shx;
+  map->shx.size = shx_size;
+
+  return (shp_map_header (map));
+}
+
+
+
+/*  Get shape i.  Returns 0 on success, -1 if the record is bogus.  */
+
+int32_t shp_map_read (SHP_MAP *map, int32_t i, SHP_MAP_SHAPE *shape)
+{
+  const uint8_t     *rec;
+  int64_t           offset, length, need;
+
+
+  memset (shape, 0, sizeof (SHP_MAP_SHAPE));
+
+  if (i < 0 || i >= map->num_shapes) return (-1);
+
+
+  /*  Offset and content length are in 16 bit words.  */
+
+  offset = (int64_t) get_be_int (&map->shx.data[100 + i * 8]) * 2;
+  length = (int64_t) get_be_int (&map->shx.data[100 + i * 8 + 4]) * 2;
+
+  if (offset < 100 || length < 4 || offset + 8 + length > map->shp.size) return (-1);
+
+
+  /*  Skip the record header.  */
+
+  rec = &map->shp.data[offset + 8];
+
+  shape->type = shp_map_int (rec);
+
+  switch (shape->type)
+    {
+      /*  Null shape.  */
+
+    case 0:
+      break;
+
+
+      /*  Point, PointZ, PointM.  */
+
+    case 1:
+    case 11:
+    case 21:
+      if (length < 20) return (-1);
+      shape->nVertices = 1;
+      shape->points = &rec[4];
+      break;
+
+
+      /*  MultiPoint, MultiPointZ, MultiPointM.  */
+
+    case 8:
+    case 18:
+    case 28:
+      if (length < 40) return (-1);
+      shape->nVertices = shp_map_int (&rec[36]);
+      shape->points = &rec[40];
+      need = 40 + (int64_t) shape->nVertices * 16;
+      if (shape->nVertices < 0 || need > length) return (-1);
+      break;
+
+
+      /*  PolyLine, Polygon, and their Z and M versions.  MultiPatch has a part type array after the part starts.  */
+
+    case 3:
+    case 5:
+    case 13:
+    case 15:
+    case 23:
+    case 25:
+    case 31:
+      if (length < 44) return (-1);
+      shape->nParts = shp_map_int (&rec[36]);
+      shape->nVertices = shp_map_int (&rec[40]);
+      if (shape->nParts < 0 || shape->nVertices < 0) return (-1);
+      shape->parts = &rec[44];
+      shape->points = &rec[44 + (int64_t) shape->nParts * ((shape->type == 31) ? 8 : 4)];
+      need = (shape->points - rec) + (int64_t) shape->nVertices * 16;
+      if (need > length) return (-1);
+      break;
+
+
+    default:
+      return (-1);
+    }
+
+  return (0);
+}
+
+
+
+void shp_map_close (SHP_MAP *map)
+{
+  unmap_file (&map->shp);
+  unmap_file (&map->shx);
+}
@@ -0,0 +1,118 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __SHP_MAP_H__
+#define __SHP_MAP_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <string.h>
+
+
+  /*  A read-only memory mapped file.  */
+
+  typedef struct
+  {
+    uint8_t           *data;
+    int64_t           size;
+#ifdef NVWIN3X
+    void              *file_handle;
+    void              *map_handle;
+#endif
+  } MAPPED_FILE;
+
+
+  /*  A memory mapped shape file (.shp plus its .shx index).  */
+
+  typedef struct
+  {
+    MAPPED_FILE       shp;
+    MAPPED_FILE       shx;
+    int32_t           num_shapes;
+  } SHP_MAP;
+
+
+  /*  One shape, pointing straight into the mapped file.  parts is nParts little endian 32 bit part start indices and
+      points is nVertices little endian X/Y double pairs (16 bytes per point).  Neither is necessarily aligned so use
+      shp_map_int and shp_map_double to get at them.  */
+
+  typedef struct
+  {
+    int32_t           type;
+    int32_t           nParts;
+    int32_t           nVertices;
+    const uint8_t     *parts;
+    const uint8_t     *points;
+  } SHP_MAP_SHAPE;
+
+
+  int32_t map_file (MAPPED_FILE *file, char *name, uint8_t sequential);
+  void unmap_file (MAPPED_FILE *file);
+
+  int32_t shp_map_open (SHP_MAP *map, char *shpname);
+  int32_t shp_map_memory (SHP_MAP *map, uint8_t *shp, int64_t shp_size, uint8_t *shx, int64_t shx_size);
+  int32_t shp_map_read (SHP_MAP *map, int32_t i, SHP_MAP_SHAPE *shape);
+  void shp_map_close (SHP_MAP *map);
+  uint8_t shp_map_supported ();
+
+
+  /*  Unaligned little endian accessors.  The memcpy gets turned into a plain load on anything we care about.  */
+
+  static inline int32_t shp_map_int (const uint8_t *ptr)
+  {
+    int32_t value;
+    memcpy (&value, ptr, sizeof (int32_t));
+    return (value);
+  }
+
+  static inline double shp_map_double (const uint8_t *ptr)
+  {
+    double value;
+    memcpy (&value, ptr, sizeof (double));
+    return (value);
+  }
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
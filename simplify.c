@@ -0,0 +1,121 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "build_swbd.h"
+
+
+/*
+
+    Douglas-Peucker line simplification for the levels of detail.  The end points are always kept.  Each span between
+    kept points is split at the point that is farthest from the line joining its ends until no point is more than
+    tolerance (fixed point units, i.e. 100000ths of a degree) away.  Distances are planar in lon/lat which is all the
+    levels need since they're just for drawing at smaller scales.  Instead of recursing (some SWBD segments have
+    hundreds of thousands of points) the spans to be checked are kept on stack, which must have room for 2 * count
+    values.  keep (count values) is set for each point that survives.  Returns the number of points kept.
+
+*/
+
+int32_t simplify_segment (int32_t *x, int32_t *y, int32_t count, int32_t tolerance, uint8_t *keep, int32_t *stack)
+{
+  int32_t           i, first, last, farthest, kept, sp;
+  double            dx, dy, length, distance, max_distance, tolerance_squared;
+
+
+  memset (keep, 0, count);
+
+  keep[0] = keep[count - 1] = 1;
+  kept = (count > 1) ? 2 : 1;
+
+  tolerance_squared = (double) tolerance * (double) tolerance;
+
+  sp = 0;
+  stack[sp++] = 0;
+  stack[sp++] = count - 1;
+
+  while (sp)
+    {
+      last = stack[--sp];
+      first = stack[--sp];
+
+      if (last - first < 2) continue;
+
+
+      /*  Find the point farthest from the line (or from the first point if the span is closed).  The distances are
+          all squared (the cross product squared over the length squared for the line).  */
+
+      dx = (double) x[last] - x[first];
+      dy = (double) y[last] - y[first];
+      length = dx * dx + dy * dy;
+
+      farthest = -1;
+      max_distance = -1.0;
+
+      for (i = first + 1 ; i < last ; i++)
+        {
+          if (length == 0.0)
+            {
+              distance = ((double) x[i] - x[first]) * ((double) x[i] - x[first]) +
+                ((double) y[i] - y[first]) * ((double) y[i] - y[first]);
+            }
+          else
+            {
+              distance = dx * ((double) y[i] - y[first]) - dy * ((double) x[i] - x[first]);
+              distance = distance * distance / length;
+            }
+
+          if (distance > max_distance)
+            {
+              max_distance = distance;
+              farthest = i;
+            }
+        }
+
+
+      if (max_distance > tolerance_squared)
+        {
+          keep[farthest] = 1;
+          kept++;
+
+          stack[sp++] = first;
+          stack[sp++] = farthest;
+          stack[sp++] = farthest;
+          stack[sp++] = last;
+        }
+    }
+
+  return (kept);
+}
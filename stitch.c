@@ -0,0 +1,221 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include "build_swbd.h"
+
+
+/*  Stitched segments are capped at this many points so the packed size (in bits) can't overflow.  */
+
+#define STITCH_MAX_COUNT     (1 << 24)
+
+
+/*  Segment starts are sorted on their X (high 32 bits) and segment number (low 32 bits) so we can find the ones near
+    a segment's end with a binary search.  */
+
+static int32_t compare_keys (const void *a, const void *b)
+{
+  int64_t           i = *(const int64_t *) a, j = *(const int64_t *) b;
+
+
+  return ((i < j) ? -1 : (i > j));
+}
+
+
+
+/*
+
+    Join the segments of one cell end to start.  rec is the cell's records from the cell store (a point count followed
+    by that many X/Y pairs for each segment).  A segment is joined to the segment whose first point is nearest its
+    last point if they're no more than gap fixed point units apart in X and Y (0 only joins exact matches).  Segments
+    are only ever joined in the direction they were digitized since the water side of SWBD coastline depends on it,
+    and a chain is never joined back on to its own start.  Consecutive duplicate points are removed from everything
+    that's written.  The stitched records (same layout) are allocated from scratch and returned in stitched.  Returns
+    the size of the stitched records in 32 bit words.
+
+    The chains are tracked by their ends.  For the segment at either end of a chain, other_end is the segment at the
+    other end, so a join is just a couple of stores and the loop check is free.
+
+*/
+
+int64_t stitch_cell (const int32_t *rec, int64_t rec_size, int32_t gap, ARENA *scratch, int32_t **stitched)
+{
+  int32_t           i, j, k, s, n, low, high, mid, num_segments, best, count, *first_x, *first_y, *last_x, *last_y,
+                    *order, *next, *prev, *other_end, *total, *out;
+  int64_t           r, size, d, best_d, *start, *key;
+
+
+  for (r = 0, num_segments = 0 ; r < rec_size ; r += 1 + 2 * (int64_t) rec[r]) num_segments++;
+
+  if (!num_segments)
+    {
+      *stitched = NULL;
+      return (0);
+    }
+
+
+  start = (int64_t *) arena_alloc (scratch, num_segments * sizeof (int64_t));
+  first_x = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  first_y = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  last_x = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  last_y = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  order = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  key = (int64_t *) arena_alloc (scratch, num_segments * sizeof (int64_t));
+  next = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  prev = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  other_end = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+  total = (int32_t *) arena_alloc (scratch, num_segments * sizeof (int32_t));
+
+
+  for (r = 0, s = 0 ; r < rec_size ; r += 1 + 2 * (int64_t) rec[r], s++)
+    {
+      start[s] = r;
+      count = rec[r];
+
+      first_x[s] = first_y[s] = last_x[s] = last_y[s] = 0;
+      if (count > 1)
+        {
+          first_x[s] = rec[r + 1];
+          first_y[s] = rec[r + 2];
+          last_x[s] = rec[r + 2 * count - 1];
+          last_y[s] = rec[r + 2 * count];
+        }
+
+      key[s] = (int64_t) first_x[s] * 4294967296LL + s;
+      next[s] = prev[s] = -1;
+      other_end[s] = s;
+      total[s] = rec[r];
+    }
+
+
+  qsort (key, num_segments, sizeof (int64_t), compare_keys);
+
+  for (k = 0 ; k < num_segments ; k++) order[k] = (int32_t) (key[k] & 0xffffffff);
+
+
+  /*  Segments with less than two points never make it into the file so they don't get joined either.  */
+
+  for (s = 0 ; s < num_segments ; s++)
+    {
+      if (rec[start[s]] < 2) continue;
+
+
+      /*  Find the first start that could be close enough in X.  */
+
+      low = 0;
+      high = num_segments;
+      while (low < high)
+        {
+          mid = (low + high) / 2;
+          if (first_x[order[mid]] < last_x[s] - gap)
+            {
+              low = mid + 1;
+            }
+          else
+            {
+              high = mid;
+            }
+        }
+
+
+      best = -1;
+      best_d = 0;
+
+      for (k = low ; k < num_segments && first_x[order[k]] <= last_x[s] + gap ; k++)
+        {
+          j = order[k];
+
+          if (j == s || prev[j] >= 0 || rec[start[j]] < 2 || j == other_end[s] ||
+              abs (first_y[j] - last_y[s]) > gap) continue;
+
+          d = (int64_t) (first_x[j] - last_x[s]) * (first_x[j] - last_x[s]) +
+            (int64_t) (first_y[j] - last_y[s]) * (first_y[j] - last_y[s]);
+
+          if (best < 0 || d < best_d)
+            {
+              best = j;
+              best_d = d;
+            }
+        }
+
+      if (best < 0 || (int64_t) total[other_end[s]] + total[best] > STITCH_MAX_COUNT) continue;
+
+
+      /*  s is the end of its chain and best is the start of its chain.  Tie them together.  */
+
+      i = other_end[s];
+      j = other_end[best];
+
+      next[s] = best;
+      prev[best] = s;
+      other_end[i] = j;
+      other_end[j] = i;
+      total[i] = total[j] = total[i] + total[best];
+    }
+
+
+  /*  Write the chains in the order of their first segments.  */
+
+  *stitched = out = (int32_t *) arena_alloc (scratch, rec_size * sizeof (int32_t));
+  size = 0;
+
+  for (s = 0 ; s < num_segments ; s++)
+    {
+      if (prev[s] >= 0 || rec[start[s]] < 2) continue;
+
+      n = 0;
+      for (i = s ; i >= 0 ; i = next[i])
+        {
+          for (k = 0 ; k < rec[start[i]] ; k++)
+            {
+              r = start[i] + 1 + 2 * k;
+
+              if (n && rec[r] == out[size + 1 + 2 * (n - 1)] && rec[r + 1] == out[size + 2 + 2 * (n - 1)]) continue;
+
+              out[size + 1 + 2 * n] = rec[r];
+              out[size + 2 + 2 * n] = rec[r + 1];
+              n++;
+            }
+        }
+
+      if (n < 2) continue;
+
+      out[size] = n;
+      size += 1 + 2 * (int64_t) n;
+    }
+
+  return (size);
+}
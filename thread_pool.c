@@ -0,0 +1,385 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#ifdef NVWIN3X
+  #include <windows.h>
+#else
+  #include <unistd.h>
+#endif
+
+#include "thread_pool.h"
+
+
+/*
+
+  A very small work-stealing thread pool.  All of the tasks are known up front (they're just the numbers 0 through
+  num_tasks - 1) so each thread starts out owning a contiguous block of them.  A thread takes tasks from the head of
+  its own block.  When it runs dry it steals the back half of the largest block it can find.  Since no new tasks are
+  ever added, a thread that can't find anything to steal is done.
+
+*/
+
+
+typedef struct
+{
+  pthread_mutex_t   mutex;
+  int32_t           head;                     /*  Next task to run  */
+  int32_t           tail;                     /*  One past the last task in this block  */
+} POOL_QUEUE;
+
+
+typedef struct
+{
+  int32_t           num_threads;
+  POOL_QUEUE        *queue;
+  POOL_FUNC         func;
+  void              *data;
+} POOL;
+
+
+typedef struct
+{
+  POOL              *pool;
+  int32_t           id;
+} POOL_WORKER;
+
+
+typedef struct
+{
+  pthread_mutex_t   mutex;
+  int32_t           next;
+  int32_t           num_tasks;
+  POOL_FUNC         func;
+  void              *data;
+} POOL_ORDERED;
+
+
+typedef struct
+{
+  POOL_ORDERED      *pool;
+  int32_t           id;
+} POOL_ORDERED_WORKER;
+
+
+
+/*  Return the number of online processors.  */
+
+int32_t pool_cpu_count ()
+{
+  int32_t           count;
+
+#ifdef NVWIN3X
+  SYSTEM_INFO       info;
+
+  GetSystemInfo (&info);
+  count = (int32_t) info.dwNumberOfProcessors;
+#else
+  count = (int32_t) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+
+  if (count < 1) count = 1;
+
+  return (count);
+}
+
+
+
+/*  Take the next task from our own block.  Returns -1 if the block is empty.  */
+
+static int32_t pool_pop (POOL_QUEUE *queue)
+{
+  int32_t           task = -1;
+
+
+  pthread_mutex_lock (&queue->mutex);
+
+  if (queue->head < queue->tail) task = queue->head++;
+
+  pthread_mutex_unlock (&queue->mutex);
+
+  return (task);
+}
+
+
+
+/*  Steal the back half of the largest remaining block belonging to some other thread.  We return the first stolen task
+    and put the rest in our own (empty) block.  Returns -1 if there's nothing left anywhere.  */
+
+static int32_t pool_steal (POOL *pool, int32_t id)
+{
+  int32_t           i, victim, size, best, best_size, start, end;
+
+
+  for (;;)
+    {
+      /*  Find the biggest block.  The owner changes head and tail under the lock so we have to take it to look, and
+          the block may have shrunk again by the time we come back to steal from it, so we check it again then.  */
+
+      best = -1;
+      best_size = 0;
+
+      for (i = 1 ; i < pool->num_threads ; i++)
+        {
+          victim = (id + i) % pool->num_threads;
+
+          pthread_mutex_lock (&pool->queue[victim].mutex);
+          size = pool->queue[victim].tail - pool->queue[victim].head;
+          pthread_mutex_unlock (&pool->queue[victim].mutex);
+
+          if (size > best_size)
+            {
+              best = victim;
+              best_size = size;
+            }
+        }
+
+      if (best < 0) return (-1);
+
+
+      pthread_mutex_lock (&pool->queue[best].mutex);
+
+      size = pool->queue[best].tail - pool->queue[best].head;
+
+      if (size <= 0)
+        {
+          /*  Somebody beat us to it, look again.  */
+
+          pthread_mutex_unlock (&pool->queue[best].mutex);
+          continue;
+        }
+
+      end = pool->queue[best].tail;
+      start = end - (size + 1) / 2;
+      pool->queue[best].tail = start;
+
+      pthread_mutex_unlock (&pool->queue[best].mutex);
+
+
+      pthread_mutex_lock (&pool->queue[id].mutex);
+
+      pool->queue[id].head = start + 1;
+      pool->queue[id].tail = end;
+
+      pthread_mutex_unlock (&pool->queue[id].mutex);
+
+      return (start);
+    }
+}
+
+
+
+static void *pool_worker (void *arg)
+{
+  POOL_WORKER       *worker = (POOL_WORKER *) arg;
+  POOL              *pool = worker->pool;
+  int32_t           task;
+
+
+  for (;;)
+    {
+      if ((task = pool_pop (&pool->queue[worker->id])) < 0)
+        {
+          if ((task = pool_steal (pool, worker->id)) < 0) break;
+        }
+
+      (*pool->func) (task, worker->id, pool->data);
+    }
+
+  return (NULL);
+}
+
+
+
+/*  Run func for every task from 0 to num_tasks - 1 using num_threads threads and wait for all of them to finish.  With
+    a single thread the tasks are simply run, in order, in the calling thread.  */
+
+void pool_run (int32_t num_threads, int32_t num_tasks, POOL_FUNC func, void *data)
+{
+  POOL              pool;
+  POOL_WORKER       *worker;
+  pthread_t         *thread;
+  int32_t           i, block;
+
+
+  if (num_threads < 2 || num_tasks < 2)
+    {
+      for (i = 0 ; i < num_tasks ; i++) (*func) (i, 0, data);
+      return;
+    }
+
+
+  if (num_threads > num_tasks) num_threads = num_tasks;
+
+
+  pool.num_threads = num_threads;
+  pool.func = func;
+  pool.data = data;
+
+  pool.queue = (POOL_QUEUE *) calloc (num_threads, sizeof (POOL_QUEUE));
+  worker = (POOL_WORKER *) calloc (num_threads, sizeof (POOL_WORKER));
+  thread = (pthread_t *) calloc (num_threads, sizeof (pthread_t));
+
+  if (pool.queue == NULL || worker == NULL || thread == NULL)
+    {
+      perror ("Allocating thread pool memory");
+      exit (-1);
+    }
+
+
+  /*  Hand out the tasks in contiguous blocks.  */
+
+  block = num_tasks / num_threads;
+
+  for (i = 0 ; i < num_threads ; i++)
+    {
+      pthread_mutex_init (&pool.queue[i].mutex, NULL);
+      pool.queue[i].head = i * block;
+      pool.queue[i].tail = (i == num_threads - 1) ? num_tasks : (i + 1) * block;
+
+      worker[i].pool = &pool;
+      worker[i].id = i;
+    }
+
+
+  for (i = 0 ; i < num_threads ; i++)
+    {
+      if (pthread_create (&thread[i], NULL, pool_worker, &worker[i]))
+        {
+          perror ("Creating thread");
+          exit (-1);
+        }
+    }
+
+  for (i = 0 ; i < num_threads ; i++) pthread_join (thread[i], NULL);
+
+
+  for (i = 0 ; i < num_threads ; i++) pthread_mutex_destroy (&pool.queue[i].mutex);
+
+  free (thread);
+  free (worker);
+  free (pool.queue);
+}
+
+
+
+static void *pool_ordered_worker (void *arg)
+{
+  POOL_ORDERED_WORKER *worker = (POOL_ORDERED_WORKER *) arg;
+  POOL_ORDERED      *pool = worker->pool;
+  int32_t           task;
+
+
+  for (;;)
+    {
+      pthread_mutex_lock (&pool->mutex);
+
+      task = pool->next < pool->num_tasks ? pool->next++ : -1;
+
+      pthread_mutex_unlock (&pool->mutex);
+
+      if (task < 0) break;
+
+      (*pool->func) (task, worker->id, pool->data);
+    }
+
+  return (NULL);
+}
+
+
+
+/*  Same as pool_run except that the tasks are started strictly in order from a single shared counter.  Use this when
+    something downstream consumes the results in task order (and may make the workers wait for it to catch up).
+    Stealing from the far end of another thread's block would defeat that.  */
+
+void pool_run_ordered (int32_t num_threads, int32_t num_tasks, POOL_FUNC func, void *data)
+{
+  POOL_ORDERED        pool;
+  POOL_ORDERED_WORKER *worker;
+  pthread_t           *thread;
+  int32_t             i;
+
+
+  if (num_threads < 2 || num_tasks < 2)
+    {
+      for (i = 0 ; i < num_tasks ; i++) (*func) (i, 0, data);
+      return;
+    }
+
+
+  if (num_threads > num_tasks) num_threads = num_tasks;
+
+
+  pthread_mutex_init (&pool.mutex, NULL);
+  pool.next = 0;
+  pool.num_tasks = num_tasks;
+  pool.func = func;
+  pool.data = data;
+
+  worker = (POOL_ORDERED_WORKER *) calloc (num_threads, sizeof (POOL_ORDERED_WORKER));
+  thread = (pthread_t *) calloc (num_threads, sizeof (pthread_t));
+
+  if (worker == NULL || thread == NULL)
+    {
+      perror ("Allocating thread pool memory");
+      exit (-1);
+    }
+
+
+  for (i = 0 ; i < num_threads ; i++)
+    {
+      worker[i].pool = &pool;
+      worker[i].id = i;
+
+      if (pthread_create (&thread[i], NULL, pool_ordered_worker, &worker[i]))
+        {
+          perror ("Creating thread");
+          exit (-1);
+        }
+    }
+
+  for (i = 0 ; i < num_threads ; i++) pthread_join (thread[i], NULL);
+
+
+  pthread_mutex_destroy (&pool.mutex);
+
+  free (thread);
+  free (worker);
+}
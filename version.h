@@ -38,10 +38,12 @@
 
 #ifndef VERSION
 
-#define     VERSION       "PFM Software - build_swbd V1.02 - 07/23/14"
+#define     VERSION       "PFM Software - build_swbd V2.00 - 10/15/26"
 
 #define     FILE_VERSION  "PFM Software - Compressed Coastline file V1.01 - 12/13/13"
 
+#define     FILE_VERSION_2  "PFM Software - Compressed Coastline file V2.00 - 10/15/26"
+
 #endif
 
 /*
@@ -67,4 +69,81 @@
     - Switched from using the old NV_INT64 and NV_U_INT32 type definitions to the C99 standard stdint.h and
       inttypes.h sized data types (e.g. int64_t and uint32_t).
 
+
+    Version 2.00
+    PFM Software
+    10/15/26
+
+    - Added the -j option to read the one-degree shape files in parallel using a work-stealing thread pool.  Each
+      thread has its own segment buffer.
+    - Replaced the 64,800 cell_XXX_YYY temporary files with an in-memory cell store.  The -m option sets a memory
+      budget.  Anything over the budget goes to a single OUTPUT_FILE.spill file that is removed at the end.
+    - Cells are now difference coded and bit packed in parallel (also controlled by -j).  A single writer thread
+      streams the encoded cells to the output file in cell order and computes the addresses from the block sizes
+      instead of using ftell/fseek.  The output is identical to the serial version.
+    - The version string and the 180 X 360 cell header are now built in memory and written in one piece at the end
+      instead of being zeroed and patched one 12 byte entry at a time.  The output file uses an 8MB stdio buffer.
+    - Added a small arena allocator.  The pass 1 segment buffers grow geometrically instead of being reallocated for
+      every vertex, the pass 2 segment and packing buffers come from per thread scratch arenas that are reset after
+      each cell, and the encoded cell blocks are recycled by the writer.  The number of system allocations made in
+      each pass is printed at the end.
+    - The input directory is now read once and the SWBD tile names are parsed into a cell table instead of trying to
+      open six possible file names for each of the 64,800 cells.  Duplicate tiles and the number of cells between
+      56S and 60N that have no tile are reported.
+    - Added a memory mapped shape file reader that walks the parts and points in place (using the .shx offsets)
+      instead of having shapelib allocate and fill arrays for every shape.  The -r option selects the reader (mmap or
+      shapelib) so that they can be compared.
+    - The degrees to fixed point conversion and cell boundary check are now done for a whole shape at a time by a
+      conversion kernel (scalar, SSE4.1, or AVX2, picked at run time or with -k).  The segment splitting uses the
+      resulting "bad" flags.  The vector kernels are bit for bit identical to the scalar one, -T checks that.
+    - Segments are now packed straight into the cell block by a streaming bit writer that accumulates whole words
+      instead of calling bit_pack for every field.  The offset loop is specialized for the common bit widths.  The -B
+      option benchmarks it against bit_pack and checks that the bytes match.
+    - Added a .ccl reader library (ccl_reader.c, built as libccl_reader.a by mk).  It memory maps the file, reads cell
+      index entries as they're needed, and returns the segments in the cells touching a lon/lat box as pointers into
+      the map that are only unpacked on request.  The -Q option runs a box query against an existing file.
+    - Added an AVX2 segment decoder (picked at run time, with the scalar one as the fallback) that unpacks 8 offset
+      pairs at a time with gathers and does the prefix sum in registers, straight into fixed point or degree arrays.
+      The -D option benchmarks the decoders on an existing .ccl file and checks them against each other.
+    - Added a thread safe, sharded LRU cache of decoded cells (ccl_cache.c) to the reader library.  Each shard has its
+      own lock and share of the byte budget, and keeps hit, miss, and eviction counts.  The -C option benchmarks it.
+    - Every build now writes a manifest (OUTPUT_FILE.manifest) with the path, size, time, and content hash of the
+      shape files for each cell.  The -u (--update) option uses it to only read and pack the cells whose tiles have
+      changed, copying the rest from the old file.
+    - Added sharded and regional builds (-s/--shard K/N and -b/--band W,E,S,N) and a "merge" command that combines
+      the partial files by copying their packed cells and rebuilding the header.
+    - Added the V2.00 file format (-F 2) with 64 bit cell addresses so the output is no longer limited to 2GB, and
+      optional 4KB page alignment of the cell blocks (-A).  V1.01 is still the default and now fails loudly instead
+      of wrapping if the file gets too big.  The reader library, merge, and update handle both formats.
+    - Added simplified levels of detail (-L/--levels) to V2.00 files.  Each level is the coastline run through
+      Douglas-Peucker at its own tolerance and has its own cell index.  The reader library can get a cell or run a
+      query at any level (ccl_cell_level and ccl_query_level, -l with -Q).
+    - Added an optional segment index (-I/--index) with the bounding box and byte offset of every segment and an 8 X 8
+      sub-cell grid for each cell.  Clipped queries (ccl_query_clip, -c with -Q) only look at the segments whose boxes
+      touch the query box.  The levels and the index are found through a directory at the end of the file.
+    - Added a distance to coast and land/water engine (ccl_distance.c) to the reader library.  Cells are decoded
+      once and their edges binned on a 32 X 32 grid so each point only looks at the nearby edges.  Batches of points
+      are sorted by cell and run on a thread pool.  -P runs a points file, -E benchmarks it.
+    - Added segment stitching (-S/--stitch GAP).  The segments in each cell whose ends meet (within GAP arc seconds)
+      are joined end to start into longer segments and repeated points are dropped, which makes for fewer segment
+      headers and a smaller file.  The gap is saved in the file so -u and merge know about it.
+    - Tiles can now be read straight out of the SWBD distribution zip archives in the input directory (zip_reader.c)
+      instead of having to unpack them first.  A pool of decompression threads (-Z/--zip-threads) inflates them in
+      memory ahead of the cell workers.  The manifest uses the archives' CRCs so -u doesn't have to inflate anything.
+    - Added optional per cell zlib compression of the V2.00 cell blocks (-K/--compress LEVEL).  Each block keeps its
+      uncompressed size in front of it so any cell can still be read on its own.  The reader library inflates a cell
+      the first time it's read (ccl_cell_data).  -X compares file size against per cell decode time for each level.
+    - Added Rice coded segments (-e/--entropy 1|2) to V2.00 files.  The deltas (or, per segment when it's smaller,
+      the delta of deltas) are zigzag coded and Rice coded with a parameter per segment for lon and lat, so one big
+      jump no longer widens every offset in the segment.  -D now prints the bits per vertex.
+    - Added columnar cell blocks (-O/--columnar) to V2.00 files.  All of the segment headers in a cell go in one table
+      of fixed size records (with each segment's position in the offset streams) followed by the lon offsets and then
+      the lat offsets, so any segment in a cell can be read directly and the decoders step through one stream at a time.
+    - Added shape file read-ahead (-a/--read-ahead FILES, read_ahead.c).  A few I/O threads pull the next FILES shape
+      files into the file cache (posix_fadvise and a read through) while the cell workers convert and split the
+      current ones.  The queue depth and the time the workers spent waiting on it are printed.
+    - Added a JSON metrics report (-M/--metrics FILE, metrics.c) with wall and CPU time for each build phase, ingest
+      and output counters, and per cell histograms of the segments' count and offset bit widths, for tracking nightly
+      build performance.
+
 */
@@ -0,0 +1,427 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <zlib.h>
+
+#include "nvutility.h"
+
+#include "shp_map.h"
+#include "zip_reader.h"
+
+
+/*
+
+    Reading SWBD tiles straight out of the distribution zip files.  We only need enough of the zip format (PKWARE
+    APPNOTE.TXT) to find the members and inflate them: the end of central directory record at the end of the archive
+    points to the central directory, which has the name, compression method, sizes, CRC, and local header offset of
+    each member.  The member data follows its local header.  Only stored and deflated members are supported, which is
+    all that the SWBD archives use, and there's no zip64 support since none of the archives come anywhere near 4GB.
+
+*/
+
+
+#define ZIP_EOCD_SIGNATURE   0x06054b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_LOCAL_SIGNATURE  0x04034b50
+#define ZIP_EOCD_SIZE        22
+#define ZIP_CENTRAL_SIZE     46
+#define ZIP_LOCAL_SIZE       30
+
+
+static int32_t get_le16 (const uint8_t *ptr)
+{
+  return ((int32_t) ptr[0] | ((int32_t) ptr[1] << 8));
+}
+
+
+static uint32_t get_le32 (const uint8_t *ptr)
+{
+  return ((uint32_t) ptr[0] | ((uint32_t) ptr[1] << 8) | ((uint32_t) ptr[2] << 16) | ((uint32_t) ptr[3] << 24));
+}
+
+
+
+/*  List the members of an archive.  The entries are allocated (free them when you're done).  Returns 0 or -1 on
+    failure with errno set (EINVAL if it isn't a zip file we can read).  */
+
+int32_t zip_list (char *zipname, ZIP_ENTRY **entry, int32_t *num_entries)
+{
+  MAPPED_FILE       file;
+  const uint8_t     *eocd, *ptr, *end;
+  int64_t           pos, stop, directory, directory_size;
+  int32_t           i, count, name_length, extra_length, comment_length, flags;
+
+
+  *entry = NULL;
+  *num_entries = 0;
+
+  if (map_file (&file, zipname, NVFalse)) return (-1);
+
+
+  /*  The end of central directory record is the last thing in the file, give or take a comment of up to 64KB.  */
+
+  eocd = NULL;
+  stop = MAX (0, file.size - ZIP_EOCD_SIZE - 65535);
+
+  for (pos = file.size - ZIP_EOCD_SIZE ; pos >= stop ; pos--)
+    {
+      if (get_le32 (&file.data[pos]) == ZIP_EOCD_SIGNATURE)
+        {
+          eocd = &file.data[pos];
+          break;
+        }
+    }
+
+  if (eocd == NULL)
+    {
+      unmap_file (&file);
+      errno = EINVAL;
+      return (-1);
+    }
+
+  count = get_le16 (&eocd[10]);
+  directory_size = get_le32 (&eocd[12]);
+  directory = get_le32 (&eocd[16]);
+
+  if (count == 0xffff || directory == 0xffffffff || directory + directory_size > file.size)
+    {
+      unmap_file (&file);
+      errno = EINVAL;
+      return (-1);
+    }
+
+  if (!count)
+    {
+      unmap_file (&file);
+      return (0);
+    }
+
+  if ((*entry = (ZIP_ENTRY *) calloc (count, sizeof (ZIP_ENTRY))) == NULL)
+    {
+      unmap_file (&file);
+      return (-1);
+    }
+
+
+  ptr = &file.data[directory];
+  end = ptr + directory_size;
+
+  for (i = 0 ; i < count ; i++)
+    {
+      if (end - ptr < ZIP_CENTRAL_SIZE || get_le32 (ptr) != ZIP_CENTRAL_SIGNATURE) break;
+
+      flags = get_le16 (&ptr[8]);
+      name_length = get_le16 (&ptr[28]);
+      extra_length = get_le16 (&ptr[30]);
+      comment_length = get_le16 (&ptr[32]);
+
+      if (end - ptr < ZIP_CENTRAL_SIZE + name_length + extra_length + comment_length) break;
+
+
+      /*  Encrypted members get a method that zip_extract won't take.  */
+
+      (*entry)[i].member.method = (flags & 1) ? -1 : get_le16 (&ptr[10]);
+      (*entry)[i].member.crc = get_le32 (&ptr[16]);
+      (*entry)[i].member.compressed_size = get_le32 (&ptr[20]);
+      (*entry)[i].member.size = get_le32 (&ptr[24]);
+      (*entry)[i].member.offset = get_le32 (&ptr[42]);
+
+      name_length = MIN (name_length, (int32_t) sizeof ((*entry)[i].name) - 1);
+      memcpy ((*entry)[i].name, &ptr[ZIP_CENTRAL_SIZE], name_length);
+      (*entry)[i].name[name_length] = 0;
+
+      ptr += ZIP_CENTRAL_SIZE + get_le16 (&ptr[28]) + extra_length + comment_length;
+    }
+
+  unmap_file (&file);
+
+  if (i < count)
+    {
+      free (*entry);
+      *entry = NULL;
+      errno = EINVAL;
+      return (-1);
+    }
+
+  *num_entries = count;
+
+  return (0);
+}
+
+
+
+/*  Read a member of an archive into buffer (member->size bytes) and check its CRC.  Returns 0 or -1 on failure with
+    errno set (EINVAL if the member is bad or isn't stored or deflated).  */
+
+int32_t zip_extract (char *zipname, ZIP_MEMBER *member, uint8_t *buffer)
+{
+  MAPPED_FILE       file;
+  const uint8_t     *local, *data;
+  z_stream          stream;
+  int32_t           status;
+
+
+  if (member->method != 0 && member->method != 8)
+    {
+      errno = EINVAL;
+      return (-1);
+    }
+
+  if (map_file (&file, zipname, NVFalse)) return (-1);
+
+  if (member->offset + ZIP_LOCAL_SIZE > file.size || get_le32 (&file.data[member->offset]) != ZIP_LOCAL_SIGNATURE)
+    {
+      unmap_file (&file);
+      errno = EINVAL;
+      return (-1);
+    }
+
+  local = &file.data[member->offset];
+  data = local + ZIP_LOCAL_SIZE + get_le16 (&local[26]) + get_le16 (&local[28]);
+
+  if (data + member->compressed_size > file.data + file.size)
+    {
+      unmap_file (&file);
+      errno = EINVAL;
+      return (-1);
+    }
+
+
+  status = -1;
+
+  if (member->method == 0)
+    {
+      if (member->compressed_size == member->size)
+        {
+          memcpy (buffer, data, member->size);
+          status = 0;
+        }
+    }
+  else
+    {
+      /*  Raw deflate data (no zlib header), hence the negative window bits.  */
+
+      memset (&stream, 0, sizeof (z_stream));
+
+      if (inflateInit2 (&stream, -MAX_WBITS) == Z_OK)
+        {
+          stream.next_in = (Bytef *) data;
+          stream.avail_in = (uInt) member->compressed_size;
+          stream.next_out = buffer;
+          stream.avail_out = (uInt) member->size;
+
+          if (inflate (&stream, Z_FINISH) == Z_STREAM_END && (int64_t) stream.total_out == member->size) status = 0;
+
+          inflateEnd (&stream);
+        }
+    }
+
+  unmap_file (&file);
+
+  if (!status && crc32 (crc32 (0L, Z_NULL, 0), buffer, (uInt) member->size) != member->crc) status = -1;
+
+  if (status) errno = EINVAL;
+
+  return (status);
+}
+
+
+
+/*  Decompression thread.  Takes the next zipped tile (in order) whenever there's room in the window.  */
+
+static void *zip_feeder_thread (void *data)
+{
+  ZIP_FEEDER        *feeder = (ZIP_FEEDER *) data;
+  ZIP_SOURCE        *source;
+  ZIP_TILE          *tile;
+  int32_t           i;
+
+
+  pthread_mutex_lock (&feeder->mutex);
+
+  for (;;)
+    {
+      while (feeder->next < feeder->num_tiles && !feeder->source[feeder->next]->zipname[0]) feeder->next++;
+
+      if (feeder->next >= feeder->num_tiles) break;
+
+      if (feeder->outstanding >= feeder->window)
+        {
+          pthread_cond_wait (&feeder->cond, &feeder->mutex);
+          continue;
+        }
+
+      i = feeder->next++;
+      feeder->outstanding++;
+
+      pthread_mutex_unlock (&feeder->mutex);
+
+
+      source = feeder->source[i];
+      tile = &feeder->tile[i];
+
+      tile->shp = (uint8_t *) malloc (MAX (source->shp.size, 1));
+      tile->shx = (uint8_t *) malloc (MAX (source->shx.size, 1));
+
+      if (tile->shp == NULL || tile->shx == NULL || zip_extract (source->zipname, &source->shp, tile->shp) ||
+          zip_extract (source->zipname, &source->shx, tile->shx)) tile->failed = NVTrue;
+
+
+      pthread_mutex_lock (&feeder->mutex);
+
+      tile->ready = NVTrue;
+      feeder->compressed_bytes += source->shp.compressed_size + source->shx.compressed_size;
+      feeder->bytes += source->shp.size + source->shx.size;
+
+      pthread_cond_broadcast (&feeder->cond);
+    }
+
+  pthread_mutex_unlock (&feeder->mutex);
+
+  return (NULL);
+}
+
+
+
+/*
+
+    Start the decompression threads for a list of tiles.  source[i] is the shape file for tile i (tiles that aren't
+    in an archive are skipped).  The cell workers call zip_feeder_get for tile i, which waits for it to be inflated,
+    and zip_feeder_release when they're done with it.  The tiles are inflated in order so the workers should take
+    them in (roughly) the same order or the window will fill up with tiles nobody is ready for yet.
+
+*/
+
+void zip_feeder_start (ZIP_FEEDER *feeder, int32_t num_tiles, ZIP_SOURCE **source, int32_t num_threads,
+                       int32_t window)
+{
+  int32_t           i;
+
+
+  memset (feeder, 0, sizeof (ZIP_FEEDER));
+
+  feeder->num_tiles = num_tiles;
+  feeder->source = source;
+  feeder->window = MAX (window, 1);
+  feeder->num_threads = MAX (num_threads, 1);
+
+  feeder->tile = (ZIP_TILE *) calloc (MAX (num_tiles, 1), sizeof (ZIP_TILE));
+  feeder->thread = (pthread_t *) calloc (feeder->num_threads, sizeof (pthread_t));
+
+  if (feeder->tile == NULL || feeder->thread == NULL)
+    {
+      perror ("Allocating decompression memory");
+      exit (-1);
+    }
+
+  pthread_mutex_init (&feeder->mutex, NULL);
+  pthread_cond_init (&feeder->cond, NULL);
+
+  for (i = 0 ; i < feeder->num_threads ; i++)
+    {
+      if (pthread_create (&feeder->thread[i], NULL, zip_feeder_thread, feeder))
+        {
+          perror ("Starting decompression thread");
+          exit (-1);
+        }
+    }
+}
+
+
+
+/*  Wait for tile index to be inflated.  Returns 0 or -1 if it couldn't be read.  */
+
+int32_t zip_feeder_get (ZIP_FEEDER *feeder, int32_t index, uint8_t **shp, uint8_t **shx)
+{
+  pthread_mutex_lock (&feeder->mutex);
+
+  while (!feeder->tile[index].ready) pthread_cond_wait (&feeder->cond, &feeder->mutex);
+
+  pthread_mutex_unlock (&feeder->mutex);
+
+  *shp = feeder->tile[index].shp;
+  *shx = feeder->tile[index].shx;
+
+  if (feeder->tile[index].failed)
+    {
+      errno = EINVAL;
+      return (-1);
+    }
+
+  return (0);
+}
+
+
+
+/*  Free tile index and make room for the decompressors to get another one going.  */
+
+void zip_feeder_release (ZIP_FEEDER *feeder, int32_t index)
+{
+  pthread_mutex_lock (&feeder->mutex);
+
+  free (feeder->tile[index].shp);
+  free (feeder->tile[index].shx);
+  feeder->tile[index].shp = feeder->tile[index].shx = NULL;
+
+  feeder->outstanding--;
+  pthread_cond_broadcast (&feeder->cond);
+
+  pthread_mutex_unlock (&feeder->mutex);
+}
+
+
+
+/*  Wait for the decompression threads to finish and free everything.  Every tile has to have been released.  */
+
+void zip_feeder_finish (ZIP_FEEDER *feeder)
+{
+  int32_t           i;
+
+
+  for (i = 0 ; i < feeder->num_threads ; i++) pthread_join (feeder->thread[i], NULL);
+
+  pthread_mutex_destroy (&feeder->mutex);
+  pthread_cond_destroy (&feeder->cond);
+
+  free (feeder->tile);
+  free (feeder->thread);
+}
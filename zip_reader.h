@@ -0,0 +1,127 @@
+
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! or / / ! are being used by Doxygen to
+    document the software.  Dashes in these comment blocks are used to create bullet lists.
+    The lack of blank lines after a block of dash preceeded comments means that the next
+    block of dash preceeded comments is a new, indented bullet list.  I've tried to keep the
+    Doxygen formatting to a minimum but there are some other items (like <br> and <pre>)
+    that need to be left alone.  If you see a comment that starts with / * ! or / / ! and
+    there is something that looks a bit weird it is probably due to some arcane Doxygen
+    syntax.  Be very careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+#ifndef __ZIP_READER_H__
+#define __ZIP_READER_H__
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <pthread.h>
+
+
+  /*  Where a member's data is in a zip archive.  method is 0 (stored) or 8 (deflated).  */
+
+  typedef struct
+  {
+    int64_t           offset;                 /*  Offset of the member's local header  */
+    int64_t           compressed_size;
+    int64_t           size;                   /*  Uncompressed size  */
+    uint32_t          crc;
+    int32_t           method;
+  } ZIP_MEMBER;
+
+
+  /*  One entry from an archive's central directory.  */
+
+  typedef struct
+  {
+    char              name[256];
+    ZIP_MEMBER        member;
+  } ZIP_ENTRY;
+
+
+  /*  A shape file (.shp and .shx) inside an archive.  zipname is empty for a plain shape file.  */
+
+  typedef struct
+  {
+    char              zipname[512];
+    ZIP_MEMBER        shp;
+    ZIP_MEMBER        shx;
+  } ZIP_SOURCE;
+
+
+  /*  One inflated shape file.  */
+
+  typedef struct
+  {
+    uint8_t           *shp;
+    uint8_t           *shx;
+    uint8_t           ready;
+    uint8_t           failed;
+  } ZIP_TILE;
+
+
+  /*  The decompression stage.  A pool of threads inflates the shape files, in order, into memory for the cell
+      workers.  At most window tiles are inflated and not yet released at any one time so the memory use stays
+      bounded no matter how far the decompressors get ahead.  */
+
+  typedef struct
+  {
+    int32_t           num_tiles;
+    ZIP_SOURCE        **source;
+    ZIP_TILE          *tile;
+    int32_t           window;
+    int32_t           next;                   /*  Next tile to inflate  */
+    int32_t           outstanding;            /*  Tiles inflated (or being inflated) and not released  */
+    int64_t           compressed_bytes;
+    int64_t           bytes;
+    int32_t           num_threads;
+    pthread_t         *thread;
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+  } ZIP_FEEDER;
+
+
+  int32_t zip_list (char *zipname, ZIP_ENTRY **entry, int32_t *num_entries);
+  int32_t zip_extract (char *zipname, ZIP_MEMBER *member, uint8_t *buffer);
+
+  void zip_feeder_start (ZIP_FEEDER *feeder, int32_t num_tiles, ZIP_SOURCE **source, int32_t num_threads,
+                         int32_t window);
+  int32_t zip_feeder_get (ZIP_FEEDER *feeder, int32_t index, uint8_t **shp, uint8_t **shx);
+  void zip_feeder_release (ZIP_FEEDER *feeder, int32_t index);
+  void zip_feeder_finish (ZIP_FEEDER *feeder);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif